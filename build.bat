@@ -13,7 +13,7 @@ IF ["%LIBPATH%"] == [""] goto :no_vcvars
 
 set EXE_NAME=graphgen_win.exe
 set DLL_NAME=graphgen.dll
-set FILES= ../../code/graphgen.cpp ../../code/render.cpp ../../code/nfa_parse.cpp
+set FILES= ../../code/graphgen.cpp ../../code/render.cpp ../../code/nfa_parse.cpp ../../code/repulsion.cpp ../../code/multilevel.cpp ../../code/placement.cpp ../../code/components.cpp ../../code/batch.cpp ../../code/stress.cpp ../../code/layered.cpp ../../code/metrics.cpp ../../code/reorder.cpp ../../code/snapshot.cpp
 set PLATFILES= ../../code/graphgen_win.cpp 
 set CCFLAGS= /MTd /EHsc /O2 /Oi /WX /W4 /wd4201 /wd4505 /FC /Z7 /Fm
 set LDFLAGS= /incremental:no /opt:ref
@@ -0,0 +1,76 @@
+/* adjacency.hpp
+ * by Andrew Chronister, (c) 2016
+ *
+ * Undirected adjacency lists for a graph, built from its edge list for the
+ * algorithms that need to walk from a node to its neighbours (coarsening,
+ * initial placement). Allocated out of a memory_arena and never modified, so
+ * it has to be rebuilt if the edges change.
+ */
+#pragma once
+
+// Purpose: memset/memcpy
+#include <cstring>
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* Undirected adjacency of a graph in compressed form: the neighbours of node i
+ * are Neighbors[Start[i]] .. Neighbors[Start[i+1]-1]. An edge to a self-loop's
+ * control node counts as an edge to that node, since that's what pulls on it
+ * in the simulation. */
+struct adjacency
+{
+    s32* Start;
+    node_id* Neighbors;
+};
+
+/* Returns the two nodes that an edge pulls together, or false if it doesn't
+ * pull two distinct nodes together. */
+inline bool
+EdgeEndpoints(graph_edge* Edge, node_id* A, node_id* B)
+{
+    *A = Edge->Source;
+    *B = (Edge->Source == Edge->Dest) ? Edge->Control : Edge->Dest;
+    return (*A != *B);
+}
+
+/* Builds the adjacency of Graph out of Arena. Every edge appears in the lists
+ * of both of its endpoints, as many times as it occurs in the graph. */
+inline adjacency
+BuildAdjacency(memory_arena* Arena, graph* Graph)
+{
+    adjacency Result = {};
+    Result.Start = PushArray(Arena, Graph->NodeCount + 1, s32);
+    memset(Result.Start, 0, (Graph->NodeCount + 1)*sizeof(s32));
+
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        node_id A, B;
+        if (!EdgeEndpoints(Graph->Edges + EdgeIndex, &A, &B)) { continue; }
+        ++Result.Start[A + 1];
+        ++Result.Start[B + 1];
+    }
+    for (s32 NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+    {
+        Result.Start[NodeIndex + 1] += Result.Start[NodeIndex];
+    }
+
+    Result.Neighbors = PushArray(Arena, Result.Start[Graph->NodeCount], node_id);
+    s32* Cursor = PushArray(Arena, Graph->NodeCount, s32);
+    memcpy(Cursor, Result.Start, Graph->NodeCount*sizeof(s32));
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        node_id A, B;
+        if (!EdgeEndpoints(Graph->Edges + EdgeIndex, &A, &B)) { continue; }
+        Result.Neighbors[Cursor[A]++] = B;
+        Result.Neighbors[Cursor[B]++] = A;
+    }
+
+    return Result;
+}
+
+inline s32
+NodeDegree(adjacency* Adjacency, s32 NodeIndex)
+{
+    return Adjacency->Start[NodeIndex + 1] - Adjacency->Start[NodeIndex];
+}
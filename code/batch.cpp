@@ -0,0 +1,419 @@
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include "batch.h"
+
+// The lanes of a batch are worked on four at a time with SSE2 wherever the
+// compiler can assume it (which includes every x86-64 target), and one at a
+// time anywhere else. Everything below is written against lane_f32, so the
+// simulation itself only exists once.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+#define LANE_WIDTH 4
+
+struct lane_f32 { __m128 V; };
+// All bits set in the lanes where the comparison held
+struct lane_mask { __m128 V; };
+
+inline lane_f32 LaneF32(f32 Value) { lane_f32 Result; Result.V = _mm_set1_ps(Value); return Result; }
+inline lane_f32 LoadLanes(f32* Source) { lane_f32 Result; Result.V = _mm_loadu_ps(Source); return Result; }
+inline void StoreLanes(f32* Dest, lane_f32 Value) { _mm_storeu_ps(Dest, Value.V); }
+
+inline lane_f32 operator+(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = _mm_add_ps(A.V, B.V); return Result; }
+inline lane_f32 operator-(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = _mm_sub_ps(A.V, B.V); return Result; }
+inline lane_f32 operator*(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = _mm_mul_ps(A.V, B.V); return Result; }
+inline lane_f32 operator/(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = _mm_div_ps(A.V, B.V); return Result; }
+inline lane_f32 LaneMax(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = _mm_max_ps(A.V, B.V); return Result; }
+inline lane_f32 LaneSquareRoot(lane_f32 A) { lane_f32 Result; Result.V = _mm_sqrt_ps(A.V); return Result; }
+
+inline lane_mask operator<(lane_f32 A, lane_f32 B) { lane_mask Result; Result.V = _mm_cmplt_ps(A.V, B.V); return Result; }
+inline lane_mask operator>(lane_f32 A, lane_f32 B) { lane_mask Result; Result.V = _mm_cmpgt_ps(A.V, B.V); return Result; }
+inline lane_mask operator&(lane_mask A, lane_mask B) { lane_mask Result; Result.V = _mm_and_ps(A.V, B.V); return Result; }
+
+inline lane_f32
+Select(lane_mask Mask, lane_f32 IfTrue, lane_f32 IfFalse)
+{
+    lane_f32 Result;
+    Result.V = _mm_or_ps(_mm_and_ps(Mask.V, IfTrue.V), _mm_andnot_ps(Mask.V, IfFalse.V));
+    return Result;
+}
+
+#else
+
+#define LANE_WIDTH 1
+
+struct lane_f32 { f32 V; };
+struct lane_mask { bool V; };
+
+inline lane_f32 LaneF32(f32 Value) { lane_f32 Result; Result.V = Value; return Result; }
+inline lane_f32 LoadLanes(f32* Source) { lane_f32 Result; Result.V = *Source; return Result; }
+inline void StoreLanes(f32* Dest, lane_f32 Value) { *Dest = Value.V; }
+
+inline lane_f32 operator+(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = A.V + B.V; return Result; }
+inline lane_f32 operator-(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = A.V - B.V; return Result; }
+inline lane_f32 operator*(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = A.V * B.V; return Result; }
+inline lane_f32 operator/(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = A.V / B.V; return Result; }
+inline lane_f32 LaneMax(lane_f32 A, lane_f32 B) { lane_f32 Result; Result.V = Max(A.V, B.V); return Result; }
+inline lane_f32 LaneSquareRoot(lane_f32 A) { lane_f32 Result; Result.V = sqrtf(A.V); return Result; }
+
+inline lane_mask operator<(lane_f32 A, lane_f32 B) { lane_mask Result; Result.V = A.V < B.V; return Result; }
+inline lane_mask operator>(lane_f32 A, lane_f32 B) { lane_mask Result; Result.V = A.V > B.V; return Result; }
+inline lane_mask operator&(lane_mask A, lane_mask B) { lane_mask Result; Result.V = A.V && B.V; return Result; }
+
+inline lane_f32
+Select(lane_mask Mask, lane_f32 IfTrue, lane_f32 IfFalse)
+{
+    return Mask.V ? IfTrue : IfFalse;
+}
+
+#endif
+
+inline lane_f32
+operator-(lane_f32 A)
+{
+    return LaneF32(0.0f) - A;
+}
+
+/* 1/sqrt(A), or 0 where A is 0 */
+inline lane_f32
+LaneInverseLength(lane_f32 LengthSq)
+{
+    lane_f32 Zero = LaneF32(0.0f);
+    return Select(LengthSq > Zero, LaneF32(1.0f) / LaneSquareRoot(LengthSq), Zero);
+}
+
+graph_batch
+MakeGraphBatch(memory_arena* Arena, s32 NodeSlots, s32 EdgeSlots)
+{
+    graph_batch Batch = {};
+    Batch.NodeSlots = NodeSlots;
+    Batch.EdgeSlots = EdgeSlots;
+
+    s32 NodeValues = NodeSlots*BATCH_LANES;
+    f32** NodeArrays[] = { &Batch.PX, &Batch.PY, &Batch.dPX, &Batch.dPY, &Batch.ddPX, &Batch.ddPY,
+                           &Batch.OldPX, &Batch.OldPY, &Batch.Exists, &Batch.LightMask, &Batch.ControlMask };
+    for (s32 ArrayIndex = 0; ArrayIndex < (s32)ArrayCount(NodeArrays); ++ArrayIndex)
+    {
+        *NodeArrays[ArrayIndex] = PushArray(Arena, NodeValues, f32);
+        memset(*NodeArrays[ArrayIndex], 0, NodeValues*sizeof(f32));
+    }
+
+    s32 EdgeValues = EdgeSlots*BATCH_LANES;
+    Batch.EdgeA = PushArray(Arena, EdgeValues, s32);
+    Batch.EdgeB = PushArray(Arena, EdgeValues, s32);
+    Batch.EdgeScale = PushArray(Arena, EdgeValues, f32);
+    memset(Batch.EdgeA, 0, EdgeValues*sizeof(s32));
+    memset(Batch.EdgeB, 0, EdgeValues*sizeof(s32));
+    memset(Batch.EdgeScale, 0, EdgeValues*sizeof(f32));
+
+    return Batch;
+}
+
+void
+LoadBatchLane(graph_batch* Batch, s32 Lane, graph* Graph)
+{
+    Batch->Graphs[Lane] = Graph;
+    s32 NodeCount = Graph ? Graph->NodeCount : 0;
+    s32 EdgeCount = Graph ? Graph->EdgeCount : 0;
+    assert(NodeCount <= Batch->NodeSlots && EdgeCount <= Batch->EdgeSlots);
+
+    for (s32 Slot = 0; Slot < Batch->NodeSlots; ++Slot)
+    {
+        s32 Index = Slot*BATCH_LANES + Lane;
+        bool Exists = (Slot < NodeCount);
+        node_type Type = Exists ? GetNodeType(Graph, (node_id)Slot) : NODE_REGULAR;
+
+        Batch->PX[Index] = Exists ? Graph->PX[Slot] : 0.0f;
+        Batch->PY[Index] = Exists ? Graph->PY[Slot] : 0.0f;
+        Batch->dPX[Index] = Exists ? Graph->dPX[Slot] : 0.0f;
+        Batch->dPY[Index] = Exists ? Graph->dPY[Slot] : 0.0f;
+        Batch->ddPX[Index] = 0.0f;
+        Batch->ddPY[Index] = 0.0f;
+        Batch->Exists[Index] = Exists ? 1.0f : 0.0f;
+        Batch->LightMask[Index] = (Exists && (Type == NODE_CONTROL || Type == NODE_PRESTART)) ? 1.0f : 0.0f;
+        Batch->ControlMask[Index] = (Exists && Type == NODE_CONTROL) ? 1.0f : 0.0f;
+    }
+
+    // Same choice of edges and strengths as SimulateGraph
+    s32 EdgeSlot = 0;
+    for (s32 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        if (Edge->HalfBidirectional) { continue; }
+
+        node_id Node1 = Edge->Source;
+        node_id Node2 = Edge->Dest;
+        f32 Scale = 1.0f;
+        if (Node1 == Node2)
+        {
+            Node2 = Edge->Control;
+            Scale = 2.0f;
+        }
+        if (GetNodeType(Graph, Node1) == NODE_PRESTART) { Scale = 3.0f; }
+
+        s32 Index = EdgeSlot++*BATCH_LANES + Lane;
+        Batch->EdgeA[Index] = Node1*BATCH_LANES + Lane;
+        Batch->EdgeB[Index] = Node2*BATCH_LANES + Lane;
+        Batch->EdgeScale[Index] = Scale;
+    }
+    for (; EdgeSlot < Batch->EdgeSlots; ++EdgeSlot)
+    {
+        s32 Index = EdgeSlot*BATCH_LANES + Lane;
+        Batch->EdgeA[Index] = Lane;
+        Batch->EdgeB[Index] = Lane;
+        Batch->EdgeScale[Index] = 0.0f;
+    }
+
+    Batch->UsedNodeSlots = 0;
+    Batch->UsedEdgeSlots = 0;
+    for (s32 OtherLane = 0; OtherLane < BATCH_LANES; ++OtherLane)
+    {
+        graph* Other = Batch->Graphs[OtherLane];
+        if (Other == NULL) { continue; }
+        Batch->UsedNodeSlots = Max(Batch->UsedNodeSlots, (s32)Other->NodeCount);
+        Batch->UsedEdgeSlots = Max(Batch->UsedEdgeSlots, (s32)Other->EdgeCount);
+    }
+}
+
+void
+StoreBatchLane(graph_batch* Batch, s32 Lane)
+{
+    graph* Graph = Batch->Graphs[Lane];
+    for (s32 Slot = 0; Slot < Graph->NodeCount; ++Slot)
+    {
+        s32 Index = Slot*BATCH_LANES + Lane;
+        Graph->PX[Slot] = Batch->PX[Index];
+        Graph->PY[Slot] = Batch->PY[Index];
+        Graph->dPX[Slot] = Batch->dPX[Index];
+        Graph->dPY[Slot] = Batch->dPY[Index];
+    }
+}
+
+/* Edge attraction. Edges connect arbitrary nodes of their graph, so this is
+ * the one pass that can't be done across lanes; it's only linear in the
+ * number of edges, though. */
+internal void
+BatchAttraction(graph_batch* Batch, batch_params* Params)
+{
+    for (s32 Index = 0; Index < Batch->UsedEdgeSlots*BATCH_LANES; ++Index)
+    {
+        f32 Scale = Batch->EdgeScale[Index];
+        if (Scale == 0.0f) { continue; }
+
+        s32 A = Batch->EdgeA[Index];
+        s32 B = Batch->EdgeB[Index];
+        vec2 Pull = Scale*Params->AttractionK *
+            Normalize(V2(Batch->PX[B] - Batch->PX[A], Batch->PY[B] - Batch->PY[A]));
+        Batch->ddPX[A] += Pull.x;
+        Batch->ddPY[A] += Pull.y;
+        Batch->ddPX[B] -= Pull.x;
+        Batch->ddPY[B] -= Pull.y;
+    }
+}
+
+/* Node-node repulsion over every pair of slots, with the same strengths as
+ * the repulsion kernels. Pairs involving an empty slot have a strength of 0. */
+internal void
+BatchRepulsion(graph_batch* Batch, batch_params* Params)
+{
+    lane_f32 Zero = LaneF32(0.0f);
+    lane_f32 One = LaneF32(1.0f);
+    lane_f32 RepulsionK = LaneF32(Params->RepulsionK);
+    lane_f32 LightReduction = LaneF32(1.0f - Params->LightScale);
+
+    for (s32 Group = 0; Group < BATCH_LANES; Group += LANE_WIDTH)
+    {
+        for (s32 Slot1 = 0; Slot1 < Batch->UsedNodeSlots; ++Slot1)
+        {
+            s32 Index1 = Slot1*BATCH_LANES + Group;
+            lane_f32 X1 = LoadLanes(Batch->PX + Index1);
+            lane_f32 Y1 = LoadLanes(Batch->PY + Index1);
+            lane_f32 Exists1 = LoadLanes(Batch->Exists + Index1);
+            lane_f32 Light1 = LoadLanes(Batch->LightMask + Index1);
+            lane_f32 Control1 = LoadLanes(Batch->ControlMask + Index1);
+            lane_f32 Force1X = Zero;
+            lane_f32 Force1Y = Zero;
+
+            for (s32 Slot2 = Slot1 + 1; Slot2 < Batch->UsedNodeSlots; ++Slot2)
+            {
+                s32 Index2 = Slot2*BATCH_LANES + Group;
+                lane_f32 DeltaX = LoadLanes(Batch->PX + Index2) - X1;
+                lane_f32 DeltaY = LoadLanes(Batch->PY + Index2) - Y1;
+                lane_f32 InvRadius = LaneInverseLength(DeltaX*DeltaX + DeltaY*DeltaY);
+
+                lane_f32 Scale = ((One - LightReduction*LaneMax(Light1, LoadLanes(Batch->LightMask + Index2))) *
+                                  (One - Control1*LoadLanes(Batch->ControlMask + Index2)) *
+                                  Exists1*LoadLanes(Batch->Exists + Index2));
+                lane_f32 Magnitude = RepulsionK*Scale*InvRadius*InvRadius*InvRadius;
+
+                Force1X = Force1X - DeltaX*Magnitude;
+                Force1Y = Force1Y - DeltaY*Magnitude;
+                StoreLanes(Batch->ddPX + Index2, LoadLanes(Batch->ddPX + Index2) + DeltaX*Magnitude);
+                StoreLanes(Batch->ddPY + Index2, LoadLanes(Batch->ddPY + Index2) + DeltaY*Magnitude);
+            }
+
+            StoreLanes(Batch->ddPX + Index1, LoadLanes(Batch->ddPX + Index1) + Force1X);
+            StoreLanes(Batch->ddPY + Index1, LoadLanes(Batch->ddPY + Index1) + Force1Y);
+        }
+    }
+}
+
+/* Repulsion from the sides of the space, then a semi-implicit Euler step with
+ * drag, exactly as SimulateGraph does per node. */
+internal void
+BatchSidesAndIntegrate(graph_batch* Batch, batch_params* Params)
+{
+    lane_f32 Zero = LaneF32(0.0f);
+    lane_f32 One = LaneF32(1.0f);
+    lane_f32 SideRepulsionK = LaneF32(Params->SideRepulsionK);
+    lane_f32 LightSideReduction = LaneF32(0.9f);
+    lane_f32 DragK = LaneF32(Params->DragK);
+    lane_f32 dt = LaneF32(Params->dt);
+    vec2 Sides[2] = { Params->MinSide, Params->MaxSide };
+
+    for (s32 Index = 0; Index < Batch->UsedNodeSlots*BATCH_LANES; Index += LANE_WIDTH)
+    {
+        lane_f32 PX = LoadLanes(Batch->PX + Index);
+        lane_f32 PY = LoadLanes(Batch->PY + Index);
+        lane_f32 dPX = LoadLanes(Batch->dPX + Index);
+        lane_f32 dPY = LoadLanes(Batch->dPY + Index);
+        lane_f32 ddPX = LoadLanes(Batch->ddPX + Index);
+        lane_f32 ddPY = LoadLanes(Batch->ddPY + Index);
+
+        // Control points aren't as repulsed by the edges
+        lane_f32 SideScale = (One - LightSideReduction*LoadLanes(Batch->LightMask + Index)) *
+                             LoadLanes(Batch->Exists + Index);
+        for (int SideIndex = 0; SideIndex < 2; ++SideIndex)
+        {
+            lane_f32 DeltaX = LaneF32(Sides[SideIndex].x) - PX;
+            lane_f32 DeltaY = LaneF32(Sides[SideIndex].y) - PY;
+            lane_f32 DeltaXSq = DeltaX*DeltaX;
+            lane_f32 DeltaYSq = DeltaY*DeltaY;
+            lane_f32 InvLength = LaneInverseLength(DeltaXSq + DeltaYSq);
+            lane_f32 MagnitudeX = Select(DeltaXSq > Zero, SideRepulsionK / DeltaXSq, Zero);
+            lane_f32 MagnitudeY = Select(DeltaYSq > Zero, SideRepulsionK / DeltaYSq, Zero);
+            ddPX = ddPX - SideScale*DeltaX*InvLength*MagnitudeX;
+            ddPY = ddPY - SideScale*DeltaY*InvLength*MagnitudeY;
+        }
+
+        ddPX = ddPX - dPX*DragK;
+        ddPY = ddPY - dPY*DragK;
+        dPX = dPX + ddPX*dt;
+        dPY = dPY + ddPY*dt;
+
+        StoreLanes(Batch->OldPX + Index, PX);
+        StoreLanes(Batch->OldPY + Index, PY);
+        StoreLanes(Batch->PX + Index, PX + dPX*dt);
+        StoreLanes(Batch->PY + Index, PY + dPY*dt);
+        StoreLanes(Batch->dPX + Index, dPX);
+        StoreLanes(Batch->dPY + Index, dPY);
+        StoreLanes(Batch->ddPX + Index, Zero);
+        StoreLanes(Batch->ddPY + Index, Zero);
+    }
+}
+
+/* Pushes overlapping nodes apart and bounces nodes off the sides, as in
+ * SimulateGraph. Every pair is checked (graphs in a batch are small enough
+ * that a spatial hash wouldn't pay off), each node against the ones after it,
+ * and a node is kept inside the sides once all its pairs are resolved. */
+internal void
+BatchCollide(graph_batch* Batch, batch_params* Params)
+{
+    lane_f32 Zero = LaneF32(0.0f);
+    lane_f32 Half = LaneF32(0.5f);
+    lane_f32 Radius = LaneF32(Params->NodeRadius);
+    lane_f32 DiameterSq = LaneF32(Square(2.0f*Params->NodeRadius));
+    lane_f32 MinX = LaneF32(Params->MinSide.x + Params->NodeRadius);
+    lane_f32 MinY = LaneF32(Params->MinSide.y + Params->NodeRadius);
+    lane_f32 MaxX = LaneF32(Params->MaxSide.x - Params->NodeRadius);
+    lane_f32 MaxY = LaneF32(Params->MaxSide.y - Params->NodeRadius);
+
+    for (s32 Group = 0; Group < BATCH_LANES; Group += LANE_WIDTH)
+    {
+        for (s32 Slot1 = 0; Slot1 < Batch->UsedNodeSlots; ++Slot1)
+        {
+            s32 Index1 = Slot1*BATCH_LANES + Group;
+            lane_f32 X1 = LoadLanes(Batch->PX + Index1);
+            lane_f32 Y1 = LoadLanes(Batch->PY + Index1);
+            lane_f32 VX1 = LoadLanes(Batch->dPX + Index1);
+            lane_f32 VY1 = LoadLanes(Batch->dPY + Index1);
+            lane_f32 Exists1 = LoadLanes(Batch->Exists + Index1);
+
+            for (s32 Slot2 = Slot1 + 1; Slot2 < Batch->UsedNodeSlots; ++Slot2)
+            {
+                s32 Index2 = Slot2*BATCH_LANES + Group;
+                lane_f32 X2 = LoadLanes(Batch->PX + Index2);
+                lane_f32 Y2 = LoadLanes(Batch->PY + Index2);
+                lane_f32 DiffX = X2 - X1;
+                lane_f32 DiffY = Y2 - Y1;
+                lane_f32 DistanceSq = DiffX*DiffX + DiffY*DiffY;
+                lane_mask Hit = ((DistanceSq < DiameterSq) &
+                                 (Exists1*LoadLanes(Batch->Exists + Index2) > Zero));
+
+                // Move both nodes to exactly touching, either side of their
+                // midpoint, and take away their velocity towards each other
+                lane_f32 InvDistance = LaneInverseLength(DistanceSq);
+                lane_f32 CenterX = X1 + Half*DiffX;
+                lane_f32 CenterY = Y1 + Half*DiffY;
+                lane_f32 OffsetX = Radius*DiffX*InvDistance;
+                lane_f32 OffsetY = Radius*DiffY*InvDistance;
+                lane_f32 SeparationX = -(OffsetX + OffsetX);
+                lane_f32 SeparationY = -(OffsetY + OffsetY);
+                lane_f32 SeparationSq = SeparationX*SeparationX + SeparationY*SeparationY;
+
+                lane_f32 VX2 = LoadLanes(Batch->dPX + Index2);
+                lane_f32 VY2 = LoadLanes(Batch->dPY + Index2);
+                lane_f32 Closing = (VX1 - VX2)*SeparationX + (VY1 - VY2)*SeparationY;
+                lane_f32 Exchange = Select(SeparationSq > Zero, Closing / SeparationSq, Zero);
+
+                X1 = Select(Hit, CenterX - OffsetX, X1);
+                Y1 = Select(Hit, CenterY - OffsetY, Y1);
+                VX1 = Select(Hit, VX1 - Exchange*SeparationX, VX1);
+                VY1 = Select(Hit, VY1 - Exchange*SeparationY, VY1);
+                StoreLanes(Batch->PX + Index2, Select(Hit, CenterX + OffsetX, X2));
+                StoreLanes(Batch->PY + Index2, Select(Hit, CenterY + OffsetY, Y2));
+                StoreLanes(Batch->dPX + Index2, Select(Hit, VX2 + Exchange*SeparationX, VX2));
+                StoreLanes(Batch->dPY + Index2, Select(Hit, VY2 + Exchange*SeparationY, VY2));
+            }
+
+            lane_mask OffLeft = X1 < MinX;
+            lane_mask OffRight = X1 > MaxX;
+            lane_mask OffBottom = Y1 < MinY;
+            lane_mask OffTop = Y1 > MaxY;
+            X1 = Select(OffLeft, MinX, Select(OffRight, MaxX, X1));
+            Y1 = Select(OffBottom, MinY, Select(OffTop, MaxY, Y1));
+            VX1 = Select(OffLeft, -VX1, Select(OffRight, -VX1, VX1));
+            VY1 = Select(OffBottom, -VY1, Select(OffTop, -VY1, VY1));
+
+            StoreLanes(Batch->PX + Index1, X1);
+            StoreLanes(Batch->PY + Index1, Y1);
+            StoreLanes(Batch->dPX + Index1, VX1);
+            StoreLanes(Batch->dPY + Index1, VY1);
+        }
+    }
+}
+
+void
+SimulateBatch(graph_batch* Batch, batch_params* Params)
+{
+    BatchAttraction(Batch, Params);
+    BatchRepulsion(Batch, Params);
+    BatchSidesAndIntegrate(Batch, Params);
+    BatchCollide(Batch, Params);
+
+    for (s32 Lane = 0; Lane < BATCH_LANES; ++Lane)
+    {
+        f32 KineticEnergy = 0.0f;
+        f32 MaxDisplacementSq = 0.0f;
+        for (s32 Slot = 0; Slot < Batch->UsedNodeSlots; ++Slot)
+        {
+            s32 Index = Slot*BATCH_LANES + Lane;
+            KineticEnergy += 0.5f*(Square(Batch->dPX[Index]) + Square(Batch->dPY[Index]));
+            MaxDisplacementSq = Max(MaxDisplacementSq, Square(Batch->PX[Index] - Batch->OldPX[Index]) +
+                                                       Square(Batch->PY[Index] - Batch->OldPY[Index]));
+        }
+        Batch->KineticEnergy[Lane] = KineticEnergy;
+        Batch->MaxDisplacement[Lane] = sqrtf(MaxDisplacementSq);
+    }
+}
@@ -0,0 +1,113 @@
+/* batch.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Lane-parallel simulation of many small, independent graphs at once. Most
+ * NFAs only have a few dozen states, which is far too little work per step to
+ * keep the SIMD units (or the job system) busy when each graph is simulated
+ * on its own. A batch instead holds BATCH_LANES graphs side by side, and every
+ * pass of the simulation works on the same node of all of them at once.
+ *
+ * The physics are those of SimulateGraph with the fixed-step Euler integrator
+ * and exact repulsion, minus the mouse and sleeping, so a batch lays a graph
+ * out much as the interactive simulation would (though not bit for bit, since
+ * the forces are added up in a different order).
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+// Number of graphs in a batch. Every per-node and per-edge quantity of a batch
+// is stored as BATCH_LANES consecutive values, one per graph ("lane"), so the
+// vector code can load the same node of several graphs in one go.
+#define BATCH_LANES 8
+
+/* Constants of the simulation, passed in from the application (see the top of
+ * graphgen.cpp) along with the space the graphs are laid out in. */
+struct batch_params
+{
+    // Strength of the repulsion between two regular nodes, counting each pair
+    // once
+    f32 RepulsionK;
+    // Multiplier on RepulsionK when either node of a pair is a control point
+    // or the prestart node
+    f32 LightScale;
+    f32 SideRepulsionK;
+    f32 AttractionK;
+    f32 DragK;
+    f32 NodeRadius;
+    vec2 MinSide;
+    vec2 MaxSide;
+    // Length of a step
+    f32 dt;
+};
+
+/* Up to BATCH_LANES graphs being simulated together. The arrays are indexed
+ * by [Slot*BATCH_LANES + Lane]: node (or edge) Slot of the graph in Lane.
+ * Graphs with fewer nodes or edges than there are slots leave the rest of
+ * their slots empty, which the simulation skips by masking. */
+struct graph_batch
+{
+    // Number of node and edge slots of every lane
+    s32 NodeSlots;
+    s32 EdgeSlots;
+    // Number of those slots in use: the most nodes and edges of any graph
+    // loaded. The simulation stops there, so a batch that has been refilled
+    // with smaller graphs speeds up accordingly.
+    s32 UsedNodeSlots;
+    s32 UsedEdgeSlots;
+
+    // Graph loaded into each lane, or NULL if the lane is empty
+    graph* Graphs[BATCH_LANES];
+
+    // Simulation state of each node slot, as on graph
+    f32* PX;
+    f32* PY;
+    f32* dPX;
+    f32* dPY;
+    f32* ddPX;
+    f32* ddPY;
+    // Positions at the start of the last step
+    f32* OldPX;
+    f32* OldPY;
+    // 1.0f where the slot holds a node, 0.0f where it's empty
+    f32* Exists;
+    // 1.0f for control points and the prestart node, 0.0f otherwise
+    f32* LightMask;
+    // 1.0f for control points, 0.0f otherwise
+    f32* ControlMask;
+
+    // The two nodes each edge slot pulls together, as indices into the node
+    // arrays, and the multiple of AttractionK it pulls them with (0.0f for
+    // empty slots)
+    s32* EdgeA;
+    s32* EdgeB;
+    f32* EdgeScale;
+
+    // Written by SimulateBatch: the kinetic energy and largest displacement
+    // of each lane's graph over the last step, as in simulation_stats
+    f32 KineticEnergy[BATCH_LANES];
+    f32 MaxDisplacement[BATCH_LANES];
+};
+
+/* Allocates an empty batch with room for graphs of up to NodeSlots nodes and
+ * EdgeSlots edges out of Arena. */
+extern graph_batch
+MakeGraphBatch(memory_arena* Arena, s32 NodeSlots, s32 EdgeSlots);
+
+/* Copies the nodes and edges of Graph into Lane of Batch, replacing whatever
+ * was there, and starts them from Graph's positions and velocities. Graph must
+ * fit the batch's slots. Passing NULL empties the lane. */
+extern void
+LoadBatchLane(graph_batch* Batch, s32 Lane, graph* Graph);
+
+/* Copies the positions and velocities of the nodes in Lane back into the graph
+ * that was loaded there. */
+extern void
+StoreBatchLane(graph_batch* Batch, s32 Lane);
+
+/* Advances every graph in Batch by one step of Params->dt, and records the
+ * per-lane statistics of the step in the batch. Empty lanes and slots stay
+ * empty. */
+extern void
+SimulateBatch(graph_batch* Batch, batch_params* Params);
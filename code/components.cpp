@@ -0,0 +1,171 @@
+#include <cstring>
+#include "components.h"
+#include "adjacency.hpp"
+
+graph_components
+SplitComponents(memory_arena* Arena, graph* Graph, s32 MaxCount)
+{
+    s32 NodeCount = Graph->NodeCount;
+    graph_components Result = {};
+
+    adjacency Adjacency = BuildAdjacency(Arena, Graph);
+    s32* ComponentOf = PushArray(Arena, NodeCount, s32);
+    s32* Queue = PushArray(Arena, NodeCount, s32);
+    s32* Size = PushArray(Arena, NodeCount, s32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex) { ComponentOf[NodeIndex] = -1; }
+
+    s32 FoundCount = 0;
+    for (s32 RootIndex = 0; RootIndex < NodeCount; ++RootIndex)
+    {
+        if (ComponentOf[RootIndex] != -1) { continue; }
+
+        s32 QueueRead = 0;
+        s32 QueueWrite = 0;
+        ComponentOf[RootIndex] = FoundCount;
+        Queue[QueueWrite++] = RootIndex;
+        while (QueueRead < QueueWrite)
+        {
+            s32 Node = Queue[QueueRead++];
+            for (s32 Slot = Adjacency.Start[Node]; Slot < Adjacency.Start[Node + 1]; ++Slot)
+            {
+                s32 Neighbor = Adjacency.Neighbors[Slot];
+                if (ComponentOf[Neighbor] != -1) { continue; }
+                ComponentOf[Neighbor] = FoundCount;
+                Queue[QueueWrite++] = Neighbor;
+            }
+        }
+        Size[FoundCount++] = QueueWrite;
+    }
+
+    // Rank the components by size (insertion sort; there are few of them,
+    // and ties keep their order), then map each onto its output slot
+    s32* Ranked = PushArray(Arena, FoundCount, s32);
+    for (s32 ComponentIndex = 0; ComponentIndex < FoundCount; ++ComponentIndex)
+    {
+        s32 Position = ComponentIndex;
+        while (Position > 0 && Size[Ranked[Position - 1]] < Size[ComponentIndex])
+        {
+            Ranked[Position] = Ranked[Position - 1];
+            --Position;
+        }
+        Ranked[Position] = ComponentIndex;
+    }
+
+    Result.Count = Min(FoundCount, MaxCount);
+    s32* SlotOf = PushArray(Arena, FoundCount, s32);
+    for (s32 Rank = 0; Rank < FoundCount; ++Rank)
+    {
+        SlotOf[Ranked[Rank]] = Min(Rank, Result.Count - 1);
+    }
+
+    // Each component graph is made exactly big enough, up front
+    s32* SlotNodeCount = PushArray(Arena, Result.Count, s32);
+    s32* SlotEdgeCount = PushArray(Arena, Result.Count, s32);
+    memset(SlotNodeCount, 0, Result.Count*sizeof(s32));
+    memset(SlotEdgeCount, 0, Result.Count*sizeof(s32));
+    for (s32 ComponentIndex = 0; ComponentIndex < FoundCount; ++ComponentIndex)
+    {
+        SlotNodeCount[SlotOf[ComponentIndex]] += Size[ComponentIndex];
+    }
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        ++SlotEdgeCount[SlotOf[ComponentOf[Graph->Edges[EdgeIndex].Source]]];
+    }
+
+    Result.Components = PushArray(Arena, Result.Count, graph_component);
+    node_id* NewNodeOf = PushArray(Arena, NodeCount, node_id);
+    for (s32 Slot = 0; Slot < Result.Count; ++Slot)
+    {
+        graph_component* Component = Result.Components + Slot;
+        Component->Graph = PushStruct(Arena, graph);
+        if (!InitializeGraph(Component->Graph, Arena, SlotNodeCount[Slot], SlotEdgeCount[Slot]))
+        {
+            graph_components Empty = {};
+            return Empty;
+        }
+        Component->Graph->Random = RandomSplit(&Graph->Random);
+        Component->OriginalNodeOf = PushArray(Arena, NodeCount, node_id);
+    }
+
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        graph_component* Component = Result.Components + SlotOf[ComponentOf[NodeIndex]];
+        graph* Sub = Component->Graph;
+        node_id NewIndex = Sub->NodeCount++;
+
+        Sub->Nodes[NewIndex] = Graph->Nodes[NodeIndex];
+        Sub->Nodes[NewIndex].ID = NewIndex;
+        Sub->Types[NewIndex] = Graph->Types[NodeIndex];
+        SetNodeP(Sub, NewIndex, GetNodeP(Graph, (node_id)NodeIndex));
+        SetNodedP(Sub, NewIndex, GetNodedP(Graph, (node_id)NodeIndex));
+        Component->OriginalNodeOf[NewIndex] = (node_id)NodeIndex;
+        NewNodeOf[NodeIndex] = NewIndex;
+    }
+
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        graph_edge Edge = Graph->Edges[EdgeIndex];
+        graph* Sub = Result.Components[SlotOf[ComponentOf[Edge.Source]]].Graph;
+
+        Edge.Source = NewNodeOf[Edge.Source];
+        Edge.Dest = NewNodeOf[Edge.Dest];
+        if (Graph->Edges[EdgeIndex].Source == Graph->Edges[EdgeIndex].Dest)
+        {
+            Edge.Control = NewNodeOf[Edge.Control];
+        }
+        Sub->Edges[Sub->EdgeCount++] = Edge;
+    }
+
+    return Result;
+}
+
+vec2
+PackShelves(memory_arena* Arena, s32 Count, vec2* Sizes, f32 Width, f32 Gap, vec2* Offsets)
+{
+    temporary_memory PackMemory = BeginTemporaryMemory(Arena);
+
+    s32* Order = PushArray(Arena, Count, s32);
+    for (s32 BoxIndex = 0; BoxIndex < Count; ++BoxIndex)
+    {
+        s32 Position = BoxIndex;
+        while (Position > 0 && Sizes[Order[Position - 1]].y < Sizes[BoxIndex].y)
+        {
+            Order[Position] = Order[Position - 1];
+            --Position;
+        }
+        Order[Position] = BoxIndex;
+    }
+
+    // Shelves are stacked downwards from the top, so the tallest shelf ends
+    // up on top; flip them over at the end so offsets count from the bottom
+    vec2 Extent = V2(0.0f, 0.0f);
+    f32 ShelfTop = 0.0f;
+    f32 ShelfHeight = 0.0f;
+    f32 CursorX = 0.0f;
+    for (s32 OrderIndex = 0; OrderIndex < Count; ++OrderIndex)
+    {
+        s32 BoxIndex = Order[OrderIndex];
+        vec2 Size = Sizes[BoxIndex];
+        if (CursorX > 0.0f && CursorX + Size.x > Width)
+        {
+            ShelfTop += ShelfHeight + Gap;
+            ShelfHeight = 0.0f;
+            CursorX = 0.0f;
+        }
+
+        Offsets[BoxIndex] = V2(CursorX, ShelfTop + Size.y);
+        CursorX += Size.x + Gap;
+        ShelfHeight = Max(ShelfHeight, Size.y);
+        Extent.x = Max(Extent.x, CursorX - Gap);
+    }
+    Extent.y = ShelfTop + ShelfHeight;
+
+    for (s32 BoxIndex = 0; BoxIndex < Count; ++BoxIndex)
+    {
+        Offsets[BoxIndex].y = Extent.y - Offsets[BoxIndex].y;
+    }
+
+    EndTemporaryMemory(PackMemory);
+
+    return Extent;
+}
@@ -0,0 +1,49 @@
+/* components.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Splitting a graph into its connected components, and packing laid out
+ * components back together. Several NFAs loaded at once make a graph with
+ * several components that have nothing to do with each other; laying each out
+ * on its own is cheaper than simulating them all together (the repulsion is
+ * quadratic in the node count), and stops them fighting over space.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* One connected component (or, see SplitComponents, several small ones) of a
+ * larger graph, as a graph of its own. */
+struct graph_component
+{
+    // The component's nodes and edges. Nodes keep their names, types and
+    // positions, edges their transitions and flags.
+    graph* Graph;
+    // Entry i is the node of the original graph that node i of Graph was
+    // copied from.
+    node_id* OriginalNodeOf;
+};
+
+struct graph_components
+{
+    s32 Count;
+    // Largest component first
+    graph_component* Components;
+};
+
+/* Splits Graph into its connected components, largest first. At most MaxCount
+ * components are returned; if there are more, the smallest ones are all put
+ * together into the last. Control and prestart nodes go with the nodes they
+ * hang off. All memory is taken from Arena; if it can't hold the component
+ * graphs, no components are returned. */
+extern graph_components
+SplitComponents(memory_arena* Arena, graph* Graph, s32 MaxCount);
+
+/* Packs Count boxes of the given Sizes into rows ("shelves") no wider than
+ * Width where possible, leaving Gap between neighbouring boxes, tallest boxes
+ * first. Writes the offset of the bottom left corner of each box from the
+ * bottom left corner of the packing into Offsets, and returns the size of the
+ * whole packing. Scratch memory is taken from Arena and released before
+ * returning. */
+extern vec2
+PackShelves(memory_arena* Arena, s32 Count, vec2* Sizes, f32 Width, f32 Gap, vec2* Offsets);
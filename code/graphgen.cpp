@@ -1,12 +1,26 @@
-#include <cstdlib>
 #include <cstring>
+#include <cstddef>
 #include <cmath>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 #include "types.h"
 #include "math.hpp"
 #include "bezier.hpp"
 #include "graphgen.h"
 #include "render.h"
 #include "nfa_parse.h"
+#include "quadtree.hpp"
+#include "spatial_hash.hpp"
+#include "multilevel.h"
+#include "placement.h"
+#include "components.h"
+#include "layered.h"
+#include "metrics.h"
+#include "reorder.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "adjacency.hpp"
 
 static const f32 RepulsionK = 45.0f;
 static const f32 SideRepulsionK = 600.0f;
@@ -14,315 +28,2041 @@ static const f32 AttractionK = 4.0f;
 static const f32 DragK = 6.0f;
 static const f32 NodeRadius = 0.8f;
 
+#if GRAPHGEN_PROFILE
+profile_counter* GlobalProfile;
+#endif
+
+// Zoom level the app starts at, and that LayoutBatch lays graphs out at
+static const f32 DefaultPixelsPerUnit = 40.0f;
+
+// Limits on the adaptive integrator's timestep, as multiples of the platform's
+// dt, and the furthest the largest force may move a node from rest in one step
+static const f32 MinTimestepScale = 0.1f;
+static const f32 MaxTimestepScale = 8.0f;
+static const f32 MaxStepLength = 0.5f*NodeRadius;
+
+// Multilevel layout: graphs are coarsened down to about this many nodes, the
+// coarsest is simulated for at most this many steps (less if it settles), and
+// every finer level gets a fixed number of refinement steps
+static const s32 MultilevelMinNodes = 8;
+static const s32 MultilevelCoarsestSteps = 300;
+static const s32 MultilevelRefineSteps = 50;
+static const f32 MultilevelSettledEnergy = 0.01f;
+
+// Component layout: every component of the graph is laid out in a box with
+// at least ComponentSpacing^2 of room per node, for at most ComponentMaxSteps
+// steps (less once it settles), and the boxes are packed ComponentGap apart
+static const f32 ComponentSpacing = 3.0f;
+static const s32 ComponentMaxSteps = 500;
+static const f32 ComponentSettledEnergy = 0.01f;
+static const f32 ComponentGap = 2.0f*NodeRadius;
+
+// Sleeping: a node falls asleep after SleepSteps steps in a row slower than
+// SleepSpeed under a net force weaker than SleepForce, and is woken when a
+// node near it (or joined to it) moves faster than WakeSpeed. Every sleeping
+// node has its forces rechecked once every SleepCheckInterval steps, in case
+// the layout around it has slowly shifted.
+static const f32 SleepSpeed = 0.1f;
+static const f32 SleepForce = DragK*SleepSpeed;
+static const f32 WakeSpeed = 2.0f*SleepSpeed;
+static const s32 SleepSteps = 30;
+static const u32 SleepCheckInterval = 16;
+
+// Incremental reload: number of steps the nodes new to a reloaded graph are
+// simulated for while the nodes carried over from the old graph hold still
+static const s32 ReloadRelaxSteps = 30;
+
+u64
+SimulationConstantsHash()
+{
+    f32 Constants[] = {
+        RepulsionK, SideRepulsionK, AttractionK, DragK, NodeRadius, DefaultPixelsPerUnit,
+        MinTimestepScale, MaxTimestepScale, MaxStepLength,
+        (f32)MultilevelMinNodes, (f32)MultilevelCoarsestSteps, (f32)MultilevelRefineSteps, MultilevelSettledEnergy,
+        ComponentSpacing, (f32)ComponentMaxSteps, ComponentSettledEnergy, ComponentGap,
+        SleepSpeed, SleepForce, WakeSpeed, (f32)SleepSteps, (f32)SleepCheckInterval,
+        (f32)ReloadRelaxSteps,
+    };
+    return HashBytes(HASH_INITIAL, Constants, sizeof(Constants));
+}
+
 internal f32
-RandRange(f32 MinVal, f32 MaxVal)
+RandRange(random_series* Series, f32 MinVal, f32 MaxVal)
+{
+    f32 Result = RandomUnilateral(Series) * (MaxVal - MinVal) + MinVal;
+    return Result;
+}
+
+vec2 InitialNodePlacement(random_series* Series)
+{
+    f32 X = 7.0f*RandRange(Series, -1, 1);
+    f32 Y = 7.0f*RandRange(Series, -1, 1);
+    return V2(X, Y);
+}
+
+// Node and edge capacities are multiples of this, so that the arrays carved
+// out of one block all start at the same alignment as the block itself (which
+// PushSize doesn't round up), and the least a graph grows to
+#define GRAPH_CAPACITY_GRANULARITY 16
+
+/* Returns the number of bytes it takes to store the arrays of Capacity nodes. */
+internal memory_index
+NodeArraysSize(s32 Capacity)
+{
+    return (memory_index)Capacity*(6*sizeof(f32) + sizeof(graph_node) + sizeof(u16) + 2*sizeof(u8));
+}
+
+bool InitializeGraph(graph* Graph, memory_arena* Arena, s32 NodeCapacity, s32 EdgeCapacity)
+{
+    memset(Graph, 0, sizeof(graph));
+    Graph->Arena = Arena;
+    return ReserveGraph(Graph, NodeCapacity, EdgeCapacity);
+}
+
+bool ReserveGraph(graph* Graph, s32 NodeCapacity, s32 EdgeCapacity)
+{
+    s32 Granularity = GRAPH_CAPACITY_GRANULARITY;
+    bool GrowNodes = (NodeCapacity > Graph->NodeCapacity);
+    bool GrowEdges = (EdgeCapacity > Graph->EdgeCapacity);
+    if (!GrowNodes && !GrowEdges) { return true; }
+    if (!Graph->Arena || NodeCapacity > INT32_MAX - Granularity || EdgeCapacity > INT32_MAX - Granularity)
+    {
+        return false;
+    }
+
+    NodeCapacity = (NodeCapacity + Granularity - 1) / Granularity * Granularity;
+    EdgeCapacity = (EdgeCapacity + Granularity - 1) / Granularity * Granularity;
+    memory_index Needed = ((GrowNodes ? NodeArraysSize(NodeCapacity) : 0) +
+                           (GrowEdges ? (memory_index)EdgeCapacity*sizeof(graph_edge) : 0));
+    if (Needed > GetArenaSizeRemaining(Graph->Arena)) { return false; }
+
+    if (GrowNodes)
+    {
+        // Widest elements first, so that every array stays aligned. Room not
+        // yet used starts out zeroed, as in a freshly initialized graph.
+        s32 Count = Graph->NodeCount;
+        u8* Block = (u8*)PushSize(Graph->Arena, NodeArraysSize(NodeCapacity));
+        memset(Block, 0, NodeArraysSize(NodeCapacity));
+        f32** FloatArrays[] = {&Graph->PX, &Graph->PY, &Graph->dPX, &Graph->dPY, &Graph->ddPX, &Graph->ddPY};
+        for (u32 ArrayIndex = 0; ArrayIndex < ArrayCount(FloatArrays); ++ArrayIndex)
+        {
+            f32* Array = (f32*)Block;
+            Block += NodeCapacity*sizeof(f32);
+            if (Count) { memcpy(Array, *FloatArrays[ArrayIndex], Count*sizeof(f32)); }
+            *FloatArrays[ArrayIndex] = Array;
+        }
+
+        graph_node* Nodes = (graph_node*)Block;
+        Block += NodeCapacity*sizeof(graph_node);
+        if (Count) { memcpy(Nodes, Graph->Nodes, Count*sizeof(graph_node)); }
+        Graph->Nodes = Nodes;
+
+        u16* StillSteps = (u16*)Block;
+        Block += NodeCapacity*sizeof(u16);
+        if (Count) { memcpy(StillSteps, Graph->StillSteps, Count*sizeof(u16)); }
+        Graph->StillSteps = StillSteps;
+
+        u8** ByteArrays[] = {&Graph->Types, &Graph->Asleep};
+        for (u32 ArrayIndex = 0; ArrayIndex < ArrayCount(ByteArrays); ++ArrayIndex)
+        {
+            u8* Array = Block;
+            Block += NodeCapacity*sizeof(u8);
+            if (Count) { memcpy(Array, *ByteArrays[ArrayIndex], Count*sizeof(u8)); }
+            *ByteArrays[ArrayIndex] = Array;
+        }
+        Graph->NodeCapacity = NodeCapacity;
+    }
+
+    if (GrowEdges)
+    {
+        graph_edge* Edges = PushArray(Graph->Arena, EdgeCapacity, graph_edge);
+        memset(Edges, 0, EdgeCapacity*sizeof(graph_edge));
+        if (Graph->EdgeCount) { memcpy(Edges, Graph->Edges, Graph->EdgeCount*sizeof(graph_edge)); }
+        Graph->Edges = Edges;
+        Graph->EdgeCapacity = EdgeCapacity;
+    }
+    return true;
+}
+
+/* Returns the capacity an array holding Capacity things grows to when it is
+ * full, doubling it so that filling it one at a time copies each thing only a
+ * few times over. */
+internal s32
+GrownCapacity(s32 Capacity)
+{
+    return (Capacity > INT32_MAX / 2) ? INT32_MAX : Max(2*Capacity, 4*GRAPH_CAPACITY_GRANULARITY);
+}
+
+internal bool
+StringSegmentsEqual(size_t CompareLength, const char* String1, const char* String2)
+{
+	for (uint i = 0;
+		i < CompareLength;
+		++i)
+	{
+		if (String1[i] != String2[i]) { return false; }
+	}
+
+	return true;
+}
+
+internal bool
+StringsEqual(string A, string B)
+{
+    return A.Length == B.Length && StringSegmentsEqual(A.Length, A.Start, B.Start);
+}
+
+// Fewest slots a node_index is made with
+#define NODE_INDEX_MIN_SLOTS 64
+
+/* Returns the string of Node at KeyOffset (offsetof a string in graph_node),
+ * which is the key a node_index of those strings files it under. */
+inline string
+NodeKey(graph_node* Node, memory_index KeyOffset)
+{
+    return *(string*)((u8*)Node + KeyOffset);
+}
+
+/* Returns the slot the probe sequence for Key starts at in Index. */
+inline s32
+NodeIndexHome(node_index* Index, string Key)
+{
+    return (s32)(HashBytes(HASH_INITIAL, Key.Start, Key.Length) & (u64)(Index->SlotCount - 1));
+}
+
+/* Files node ID of Graph in Index, which must have room for it. */
+internal void
+InsertIntoNodeIndex(graph* Graph, node_index* Index, memory_index KeyOffset, node_id ID)
 {
-    // rand isn't great but it'll suffice here
-    f32 Result = ((f32)rand() / (f32)RAND_MAX) * (MaxVal - MinVal) + MinVal;
+    s32 Slot = NodeIndexHome(Index, NodeKey(Graph->Nodes + ID, KeyOffset));
+    while (Index->Slots[Slot] != NO_NODE) { Slot = (Slot + 1) & (Index->SlotCount - 1); }
+    Index->Slots[Slot] = ID;
+    ++Index->FilledCount;
+}
+
+/* Refiles every node of Graph with a nonempty key in Index, first moving it to
+ * more slots out of the graph's Arena if it has too few for every node. If the
+ * arena doesn't have room, leaves the graph without the index. */
+internal bool
+FillNodeIndex(graph* Graph, node_index* Index, memory_index KeyOffset)
+{
+    if (Index->SlotCount < 2*Graph->NodeCount)
+    {
+        s32 SlotCount = NODE_INDEX_MIN_SLOTS;
+        while (SlotCount < 2*Graph->NodeCount) { SlotCount *= 2; }
+
+        if (!Graph->Arena || SlotCount*sizeof(node_id) > GetArenaSizeRemaining(Graph->Arena))
+        {
+            *Index = {};
+            return false;
+        }
+        Index->Slots = PushArray(Graph->Arena, SlotCount, node_id);
+        Index->SlotCount = SlotCount;
+    }
+
+    for (s32 Slot = 0; Slot < Index->SlotCount; ++Slot) { Index->Slots[Slot] = NO_NODE; }
+    Index->FilledCount = 0;
+    for (node_id NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+    {
+        if (NodeKey(Graph->Nodes + NodeIndex, KeyOffset).Length == 0) { continue; }
+        InsertIntoNodeIndex(Graph, Index, KeyOffset, NodeIndex);
+    }
+    return true;
+}
+
+/* Files node ID, just added to Graph, in Index, growing it (to twice the
+ * slots, refiling everything) when it would otherwise fill past half way. */
+internal void
+AddToNodeIndex(graph* Graph, node_index* Index, memory_index KeyOffset, node_id ID)
+{
+    if (NodeKey(Graph->Nodes + ID, KeyOffset).Length == 0) { return; }
+
+    if (2*(Index->FilledCount + 1) > Index->SlotCount)
+    {
+        FillNodeIndex(Graph, Index, KeyOffset);
+    }
+    else
+    {
+        InsertIntoNodeIndex(Graph, Index, KeyOffset, ID);
+    }
+}
+
+/* Returns the lowest-numbered node of Graph from IndexStart on whose string at
+ * KeyOffset is Key, passing over any marked in Taken (if it isn't NULL), or
+ * NULL if there is none. Looks it up in Index, the index of those strings,
+ * when there is one, and otherwise checks every node. */
+internal graph_node*
+FindNodeByKey(graph* Graph, node_index* Index, memory_index KeyOffset, string Key,
+              node_id IndexStart, bool* Taken)
+{
+    graph_node* Result = NULL;
+    if (Index->SlotCount == 0 || Key.Length == 0)
+    {
+        for (node_id NodeIndex = IndexStart; NodeIndex < Graph->NodeCount; ++NodeIndex)
+        {
+            if ((!Taken || !Taken[NodeIndex]) &&
+                StringsEqual(NodeKey(Graph->Nodes + NodeIndex, KeyOffset), Key))
+            {
+                Result = Graph->Nodes + NodeIndex;
+                break;
+            }
+        }
+        return Result;
+    }
+
+    // Nodes sharing the key can be anywhere along the probe sequence
+    for (s32 Slot = NodeIndexHome(Index, Key);
+         Index->Slots[Slot] != NO_NODE;
+         Slot = (Slot + 1) & (Index->SlotCount - 1))
+    {
+        node_id NodeIndex = Index->Slots[Slot];
+        if (NodeIndex < IndexStart || (Result && NodeIndex > Result->ID) ||
+            (Taken && Taken[NodeIndex]) ||
+            !StringsEqual(NodeKey(Graph->Nodes + NodeIndex, KeyOffset), Key))
+        {
+            continue;
+        }
+        Result = Graph->Nodes + NodeIndex;
+    }
     return Result;
 }
 
-vec2 InitialNodePlacement(node_id NodeID)
+bool IndexNodes(graph* Graph)
+{
+    bool NamesIndexed = FillNodeIndex(Graph, &Graph->NameIndex, offsetof(graph_node, Name));
+    bool JavaIDsIndexed = FillNodeIndex(Graph, &Graph->JavaIDIndex, offsetof(graph_node, JavaID));
+    return NamesIndexed && JavaIDsIndexed;
+}
+
+// Fewest slots an edge_index is made with
+#define EDGE_INDEX_MIN_SLOTS 64
+
+/* Returns the slot the probe sequence for edges from Source to Dest starts at
+ * in Index. */
+inline s32
+EdgeIndexHome(edge_index* Index, node_id Source, node_id Dest)
 {
-    NodeID;
-    return V2(7.0f*RandRange(-1,1), 7.0f*RandRange(-1,1));
+    u64 Key = ((u64)(u32)Source << 32) | (u32)Dest;
+    return (s32)(HashBytes(HASH_INITIAL, &Key, sizeof(Key)) & (u64)(Index->SlotCount - 1));
 }
 
-node_id AddNode(graph* NodeGraph, graph_node Node)
+/* Files edge EdgeIndex of Graph in its EndpointIndex, which must have room. */
+internal void
+InsertIntoEdgeIndex(graph* Graph, s32 EdgeIndex)
 {
+    edge_index* Index = &Graph->EndpointIndex;
+    graph_edge* Edge = Graph->Edges + EdgeIndex;
+    s32 Slot = EdgeIndexHome(Index, Edge->Source, Edge->Dest);
+    while (Index->Slots[Slot] != -1) { Slot = (Slot + 1) & (Index->SlotCount - 1); }
+    Index->Slots[Slot] = EdgeIndex;
+    ++Index->FilledCount;
+}
+
+bool IndexEdges(graph* Graph)
+{
+    edge_index* Index = &Graph->EndpointIndex;
+    if (Index->SlotCount < 2*Graph->EdgeCount)
+    {
+        s32 SlotCount = EDGE_INDEX_MIN_SLOTS;
+        while (SlotCount < 2*Graph->EdgeCount) { SlotCount *= 2; }
+
+        if (!Graph->Arena || SlotCount*sizeof(s32) > GetArenaSizeRemaining(Graph->Arena))
+        {
+            *Index = {};
+            return false;
+        }
+        Index->Slots = PushArray(Graph->Arena, SlotCount, s32);
+        Index->SlotCount = SlotCount;
+    }
+
+    for (s32 Slot = 0; Slot < Index->SlotCount; ++Slot) { Index->Slots[Slot] = -1; }
+    Index->FilledCount = 0;
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        InsertIntoEdgeIndex(Graph, EdgeIndex);
+    }
+    return true;
+}
+
+node_id AddNode(graph* NodeGraph, graph_node Node, node_type Type)
+{
+    if (NodeGraph->NodeCount == NodeGraph->NodeCapacity &&
+        !ReserveGraph(NodeGraph, GrownCapacity(NodeGraph->NodeCapacity), NodeGraph->EdgeCapacity))
+    {
+        return NO_NODE;
+    }
+
     graph_node NewNode = Node;
     NewNode.ID = NodeGraph->NodeCount++;
-    NewNode.P = InitialNodePlacement(NewNode.ID);
+    NewNode.DeclarationIndex = NewNode.ID;
     NodeGraph->Nodes[NewNode.ID] = NewNode;
+
+    SetNodeP(NodeGraph, NewNode.ID, InitialNodePlacement(&NodeGraph->Random));
+    SetNodedP(NodeGraph, NewNode.ID, V2(0.0f, 0.0f));
+    NodeGraph->ddPX[NewNode.ID] = 0.0f;
+    NodeGraph->ddPY[NewNode.ID] = 0.0f;
+    NodeGraph->Types[NewNode.ID] = (u8)Type;
+
+    AddToNodeIndex(NodeGraph, &NodeGraph->NameIndex, offsetof(graph_node, Name), NewNode.ID);
+    AddToNodeIndex(NodeGraph, &NodeGraph->JavaIDIndex, offsetof(graph_node, JavaID), NewNode.ID);
+
     return NewNode.ID;
 }
 
 node_id AddNode(graph* NodeGraph, node_type Type)
 {
     graph_node NewNode = {};
-    NewNode.ID = NodeGraph->NodeCount++;
-    NewNode.Type = Type;
-    NewNode.P = InitialNodePlacement(NewNode.ID);
-    NodeGraph->Nodes[NewNode.ID] = NewNode;
-    return NewNode.ID;
+    return AddNode(NodeGraph, NewNode, Type);
 }
 
-void AddEdge(graph* NodeGraph, graph_edge Edge)
+bool AddEdge(graph* NodeGraph, graph_edge Edge)
 {
+    if (NodeGraph->EdgeCount == NodeGraph->EdgeCapacity &&
+        !ReserveGraph(NodeGraph, NodeGraph->NodeCapacity, GrownCapacity(NodeGraph->EdgeCapacity)))
+    {
+        return false;
+    }
+
     NodeGraph->Edges[NodeGraph->EdgeCount++] = Edge;
+
+    // Grows the index (to twice the slots, refiling everything) when it would
+    // otherwise fill past half way
+    edge_index* Index = &NodeGraph->EndpointIndex;
+    if (2*(Index->FilledCount + 1) > Index->SlotCount)
+    {
+        IndexEdges(NodeGraph);
+    }
+    else
+    {
+        InsertIntoEdgeIndex(NodeGraph, NodeGraph->EdgeCount - 1);
+    }
+    return true;
 }
 
-void AddEdge(graph* NodeGraph, node_id Node1, node_id Node2)
+bool AddEdge(graph* NodeGraph, node_id Node1, node_id Node2)
 {
     graph_edge NewEdge = {};
     NewEdge.Source = Node1;
     NewEdge.Dest = Node2;
-    NodeGraph->Edges[NodeGraph->EdgeCount++] = NewEdge;
+    return AddEdge(NodeGraph, NewEdge);
 }
 
-internal bool
-StringSegmentsEqual(size_t CompareLength, const char* String1, const char* String2)
+graph_node* FindNodeByName(graph* Graph, 
+                           char* NameStart, size_t NameLength, node_id IndexStart)
 {
-	for (uint i = 0;
-		i < CompareLength;
-		++i)
-	{
-		if (String1[i] != String2[i]) { return false; }
-	}
+    string Name = {NameStart, NameLength};
+    return FindNodeByKey(Graph, &Graph->NameIndex, offsetof(graph_node, Name), Name, IndexStart, NULL);
+}
+
+graph_node* FindNodeByJavaID(graph* Graph, 
+                             char* JavaIDStart, size_t JavaIDLength, node_id IndexStart)
+{
+    string JavaID = {JavaIDStart, JavaIDLength};
+    return FindNodeByKey(Graph, &Graph->JavaIDIndex, offsetof(graph_node, JavaID), JavaID, IndexStart, NULL);
+}
+
+graph_edge* FindEdgeByNodes(graph* Graph, 
+                            node_id StartNode, node_id EndNode, s32 IndexStart)
+{
+    graph_edge* Result = NULL;
+    edge_index* Index = &Graph->EndpointIndex;
+    if (Index->SlotCount == 0)
+    {
+        for (s32 EdgeIndex = IndexStart; EdgeIndex < Graph->EdgeCount; ++EdgeIndex) {
+            graph_edge* Edge = Graph->Edges + EdgeIndex;
+
+            if (Edge->Source == StartNode && Edge->Dest == EndNode)
+            {
+                Result = Edge;
+                break;
+            }
+        }
+        return Result;
+    }
+
+    // Edges between the same nodes can be anywhere along the probe sequence
+    for (s32 Slot = EdgeIndexHome(Index, StartNode, EndNode);
+         Index->Slots[Slot] != -1;
+         Slot = (Slot + 1) & (Index->SlotCount - 1))
+    {
+        s32 EdgeIndex = Index->Slots[Slot];
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        if (EdgeIndex < IndexStart || (Result && Edge > Result) ||
+            Edge->Source != StartNode || Edge->Dest != EndNode)
+        {
+            continue;
+        }
+        Result = Edge;
+    }
+    return Result;
+}
+
+internal vec2
+BounceVector(vec2 SurfaceVec, vec2 Incoming)
+{
+    vec2 SurfaceNormal = LeftNormal(SurfaceVec);
+    vec2 Result = -(2*Inner(SurfaceNormal, Incoming) * SurfaceNormal - Incoming);
+    return Result;
+}
+
+// Nodes are grouped into classes that repel each other with different
+// strengths: regular nodes, curve control points, and the prestart node.
+enum repulsion_class
+{
+    REPULSION_CLASS_REGULAR,
+    REPULSION_CLASS_CONTROL,
+    REPULSION_CLASS_PRESTART,
+};
+
+// Multiplier on RepulsionK felt by a node of the row class from a node of the
+// column class. Matches the special cases in the exact repulsion pass.
+global_variable f32 RepulsionClassScale[QUADTREE_CLASS_COUNT][QUADTREE_CLASS_COUNT] =
+{
+    //  REGULAR  CONTROL  PRESTART
+    {   1.0f,    0.3f,    0.3f },   // REGULAR
+    {   0.3f,    0.0f,    0.3f },   // CONTROL
+    {   0.3f,    0.3f,    0.3f },   // PRESTART
+};
+
+inline u8
+RepulsionClass(node_type Type)
+{
+    u8 Result = REPULSION_CLASS_REGULAR;
+    if (Type == NODE_CONTROL) { Result = REPULSION_CLASS_CONTROL; }
+    else if (Type == NODE_PRESTART) { Result = REPULSION_CLASS_PRESTART; }
+    return Result;
+}
+
+inline bool
+CellContainsPoint(quadtree_cell* Cell, vec2 P)
+{
+    vec2 Offset = P - Cell->Center;
+    bool Result = (fabsf(Offset.x) <= Cell->HalfSize &&
+                   fabsf(Offset.y) <= Cell->HalfSize);
+    return Result;
+}
+
+/* Runs Callback on each of the JobCount structures of JobSize bytes starting at
+ * Jobs, spread across the platform's worker threads when there are any, and
+ * returns once they have all finished. */
+internal void
+RunJobs(app_state* State, platform_work_queue_callback* Callback,
+        void* Jobs, size_t JobSize, s32 JobCount)
+{
+    for (s32 JobIndex = 0; JobIndex < JobCount; ++JobIndex)
+    {
+        void* Job = (u8*)Jobs + JobIndex*JobSize;
+        if (State->WorkQueue) { State->AddWorkEntry(State->WorkQueue, Callback, Job); }
+        else { Callback(Job); }
+    }
+
+    if (State->WorkQueue) { State->CompleteAllWork(State->WorkQueue); }
+}
+
+// Upper bound on the number of jobs a parallel pass is split into. Several
+// per thread gives the queue some room to balance the load.
+#define MAX_SIMULATION_JOBS 64
+
+struct barnes_hut_job
+{
+    graph* NodeGraph;
+    quadtree* Tree;
+    u8* Classes;
+    s32* Receivers;
+    f32 ThetaSq;
+    s32 ReceiverStart;
+    s32 ReceiverEnd;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(BarnesHutJob)
+{
+    barnes_hut_job* Job = (barnes_hut_job*)Data;
+    graph* NodeGraph = Job->NodeGraph;
+    quadtree* Tree = Job->Tree;
+    u8* Classes = Job->Classes;
+    f32* X = NodeGraph->PX;
+    f32* Y = NodeGraph->PY;
+
+    for (s32 ReceiverIndex = Job->ReceiverStart; ReceiverIndex < Job->ReceiverEnd; ++ReceiverIndex)
+    {
+        s32 Node1Index = Job->Receivers[ReceiverIndex];
+        vec2 P1 = V2(X[Node1Index], Y[Node1Index]);
+        f32* ClassScale = RepulsionClassScale[Classes[Node1Index]];
+        vec2 Force = V2(0.0f, 0.0f);
+
+        s32 Stack[4*QUADTREE_MAX_DEPTH];
+        s32 StackCount = 0;
+        Stack[StackCount++] = 0;
+        while (StackCount > 0)
+        {
+            quadtree_cell* Cell = Tree->Cells + Stack[--StackCount];
+            if (Cell->Count == 0) { continue; }
+
+            if (!Cell->FirstChild)
+            {
+                for (s32 Slot = Cell->First; Slot < Cell->First + Cell->Count; ++Slot)
+                {
+                    s32 Node2Index = Tree->Indices[Slot];
+                    if (Node2Index == Node1Index) { continue; }
+
+                    vec2 DeltaX = V2(X[Node2Index], Y[Node2Index]) - P1;
+                    f32 RepulsionMagnitude = SafeRatio0(ClassScale[Classes[Node2Index]] * RepulsionK,
+                                                        LengthSq(DeltaX));
+                    Force += -Normalize(DeltaX) * RepulsionMagnitude;
+                }
+            }
+            else if (!CellContainsPoint(Cell, P1) &&
+                     Square(2.0f*Cell->HalfSize) < Job->ThetaSq * LengthSq(Cell->CenterOfMass - P1))
+            {
+                for (int Class = 0; Class < QUADTREE_CLASS_COUNT; ++Class)
+                {
+                    if (Cell->Mass[Class] == 0.0f) { continue; }
+
+                    vec2 DeltaX = Cell->ClassCenterOfMass[Class] - P1;
+                    f32 RepulsionMagnitude = SafeRatio0(Cell->Mass[Class] * ClassScale[Class] * RepulsionK,
+                                                        LengthSq(DeltaX));
+                    Force += -Normalize(DeltaX) * RepulsionMagnitude;
+                }
+            }
+            else
+            {
+                for (s32 ChildIndex = 0; ChildIndex < 4; ++ChildIndex)
+                {
+                    Stack[StackCount++] = Cell->FirstChild + ChildIndex;
+                }
+            }
+        }
+
+        // The exact pass visits every pair from both sides, so each node
+        // feels every interaction twice; do the same here.
+        AddNodeddP(NodeGraph, (node_id)Node1Index, 2.0f * Force);
+    }
+}
+
+/* Barnes-Hut approximation of the node-node repulsion. Accumulates into ddP
+ * the same forces as the exact pass, except that quadtree cells which appear
+ * small enough from a node are treated as one body per repulsion class.
+ * Only the first ReceiverCount nodes listed in Order have their forces
+ * computed, though every node exerts them. Every node only writes its own
+ * ddP, so the receivers are simply split into contiguous ranges across the
+ * work queue. */
+internal void
+ApplyBarnesHutRepulsion(app_state* State, graph* NodeGraph, s32* Order, s32 ReceiverCount)
+{
+    temporary_memory TreeMemory = BeginTemporaryMemory(&State->TempArena);
+
+    s32 NodeCount = NodeGraph->NodeCount;
+    u8* Classes = PushArray(&State->TempArena, NodeCount, u8);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Classes[NodeIndex] = RepulsionClass(GetNodeType(NodeGraph, (node_id)NodeIndex));
+    }
+
+    quadtree Tree = BuildQuadtree(&State->TempArena, NodeCount, NodeGraph->PX, NodeGraph->PY, Classes);
+
+    s32 JobCount = Min(MAX_SIMULATION_JOBS, ReceiverCount);
+    barnes_hut_job* Jobs = PushArray(&State->TempArena, JobCount, barnes_hut_job);
+    for (s32 JobIndex = 0; JobIndex < JobCount; ++JobIndex)
+    {
+        barnes_hut_job* Job = Jobs + JobIndex;
+        Job->NodeGraph = NodeGraph;
+        Job->Tree = &Tree;
+        Job->Classes = Classes;
+        Job->Receivers = Order;
+        Job->ThetaSq = Square(State->Settings.BarnesHutTheta);
+        Job->ReceiverStart = (s32)((s64)ReceiverCount * JobIndex / JobCount);
+        Job->ReceiverEnd = (s32)((s64)ReceiverCount * (JobIndex + 1) / JobCount);
+    }
+
+    RunJobs(State, BarnesHutJob, Jobs, sizeof(barnes_hut_job), JobCount);
+
+    EndTemporaryMemory(TreeMemory);
+}
+
+// A tile of the exact repulsion pass is never given fewer pairs than this,
+// so small graphs aren't split into jobs that cost more to hand out than to
+// run.
+#define MIN_REPULSION_TILE_PAIRS 4096
+
+/* A block of consecutive rows of the pair matrix, evaluated into a private
+ * force buffer. The kernels only ever touch entries from RowStart onwards. */
+struct repulsion_tile_job
+{
+    repulsion_input* Input;
+    repulsion_kernel* Kernel;
+    s32 RowStart;
+    s32 RowEnd;
+    f32* ForceX;
+    f32* ForceY;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(RepulsionTileJob)
+{
+    repulsion_tile_job* Job = (repulsion_tile_job*)Data;
+    s32 Count = Job->Input->Count;
+    memset(Job->ForceX + Job->RowStart, 0, (Count - Job->RowStart)*sizeof(f32));
+    memset(Job->ForceY + Job->RowStart, 0, (Count - Job->RowStart)*sizeof(f32));
+
+    Job->Kernel(Job->Input, Job->RowStart, Job->RowEnd, Job->ForceX, Job->ForceY);
+}
+
+/* Sums the tile buffers into ddP for a range of entries of the kernel's node
+ * order, scattering them back to the nodes they belong to. Every node adds up
+ * the tiles in tile order no matter which job or thread gets to it. */
+struct repulsion_reduce_job
+{
+    repulsion_tile_job* Tiles;
+    s32 TileCount;
+    s32* Order;
+    s32 SlotStart;
+    s32 SlotEnd;
+    f32* ddPX;
+    f32* ddPY;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(RepulsionReduceJob)
+{
+    repulsion_reduce_job* Job = (repulsion_reduce_job*)Data;
+    for (s32 TileIndex = 0; TileIndex < Job->TileCount; ++TileIndex)
+    {
+        repulsion_tile_job* Tile = Job->Tiles + TileIndex;
+        for (s32 Slot = Max(Job->SlotStart, Tile->RowStart); Slot < Job->SlotEnd; ++Slot)
+        {
+            s32 NodeIndex = Job->Order[Slot];
+            Job->ddPX[NodeIndex] += Tile->ForceX[Slot];
+            Job->ddPY[NodeIndex] += Tile->ForceY[Slot];
+        }
+    }
+}
+
+/* Exact all-pairs node-node repulsion, evaluated by the kernel for the
+ * configured simd_level. Accumulates into ddP.
+ *
+ * The kernel sees the nodes in the given Order. Only the first ReceiverCount
+ * of them have their forces computed; since the kernel visits each pair from
+ * its earlier node, that's done by only evaluating the first ReceiverCount
+ * rows, which skips exactly the pairs between two non-receivers.
+ *
+ * The rows of the pair matrix are cut into tiles holding roughly equal numbers
+ * of pairs, each tile is evaluated into its own buffer, and the buffers are
+ * then summed in tile order. The tiling only depends on the node and receiver
+ * counts, so the result is bitwise identical however many threads (if any) do
+ * the work. */
+internal void
+ApplyExactRepulsion(app_state* State, graph* NodeGraph, s32* Order, s32 ReceiverCount)
+{
+    temporary_memory RepulsionMemory = BeginTemporaryMemory(&State->TempArena);
+
+    s32 NodeCount = NodeGraph->NodeCount;
+    repulsion_input Input = {};
+    Input.Count = NodeCount;
+    Input.PX = PushArray(&State->TempArena, NodeCount, f32);
+    Input.PY = PushArray(&State->TempArena, NodeCount, f32);
+    Input.LightMask = PushArray(&State->TempArena, NodeCount, f32);
+    Input.ControlMask = PushArray(&State->TempArena, NodeCount, f32);
+    // Every pair used to be visited from both sides, each time pushing both
+    // nodes apart; the kernels visit each pair once, so double the strength.
+    Input.RepulsionK = 2.0f * RepulsionK;
+    // Allow control points to be a lot closer to other nodes
+    Input.LightScale = 0.3f;
+
+    for (s32 Slot = 0; Slot < NodeCount; ++Slot)
+    {
+        s32 NodeIndex = Order[Slot];
+        node_type Type = GetNodeType(NodeGraph, (node_id)NodeIndex);
+        Input.PX[Slot] = NodeGraph->PX[NodeIndex];
+        Input.PY[Slot] = NodeGraph->PY[NodeIndex];
+        Input.LightMask[Slot] = (Type == NODE_CONTROL || Type == NODE_PRESTART) ? 1.0f : 0.0f;
+        // Control points shouldn't really affect each other
+        Input.ControlMask[Slot] = (Type == NODE_CONTROL) ? 1.0f : 0.0f;
+    }
+
+    repulsion_kernel* Kernel = GetRepulsionKernel(State->Settings.SIMDLevel);
+
+    s64 PairCount = (s64)ReceiverCount * (NodeCount - 1) - (s64)ReceiverCount * (ReceiverCount - 1) / 2;
+    s32 TileCount = (s32)Min((s64)MAX_SIMULATION_JOBS, Max(PairCount / MIN_REPULSION_TILE_PAIRS, (s64)1));
+    repulsion_tile_job* Tiles = PushArray(&State->TempArena, TileCount, repulsion_tile_job);
+
+    // Row i holds NodeCount-1-i pairs, so cut whenever the running total
+    // passes the next multiple of PairCount/TileCount.
+    s32 TileIndex = 0;
+    s32 RowStart = 0;
+    s64 PairsSoFar = 0;
+    for (s32 Row = 0; Row < ReceiverCount && TileIndex < TileCount; ++Row)
+    {
+        PairsSoFar += NodeCount - 1 - Row;
+        if (Row == ReceiverCount - 1 ||
+            PairsSoFar * TileCount >= PairCount * (TileIndex + 1))
+        {
+            repulsion_tile_job* Tile = Tiles + TileIndex++;
+            Tile->Input = &Input;
+            Tile->Kernel = Kernel;
+            Tile->RowStart = RowStart;
+            Tile->RowEnd = Row + 1;
+            Tile->ForceX = PushArray(&State->TempArena, NodeCount, f32);
+            Tile->ForceY = PushArray(&State->TempArena, NodeCount, f32);
+            RowStart = Row + 1;
+        }
+    }
+    TileCount = TileIndex;
+
+    RunJobs(State, RepulsionTileJob, Tiles, sizeof(repulsion_tile_job), TileCount);
+
+    s32 ReduceJobCount = Min(MAX_SIMULATION_JOBS, Max(ReceiverCount / 64, 1));
+    repulsion_reduce_job* ReduceJobs = PushArray(&State->TempArena, ReduceJobCount, repulsion_reduce_job);
+    for (s32 JobIndex = 0; JobIndex < ReduceJobCount; ++JobIndex)
+    {
+        repulsion_reduce_job* Job = ReduceJobs + JobIndex;
+        Job->Tiles = Tiles;
+        Job->TileCount = TileCount;
+        Job->Order = Order;
+        Job->SlotStart = (s32)((s64)ReceiverCount * JobIndex / ReduceJobCount);
+        Job->SlotEnd = (s32)((s64)ReceiverCount * (JobIndex + 1) / ReduceJobCount);
+        Job->ddPX = NodeGraph->ddPX;
+        Job->ddPY = NodeGraph->ddPY;
+    }
+
+    RunJobs(State, RepulsionReduceJob, ReduceJobs, sizeof(repulsion_reduce_job), ReduceJobCount);
+
+    EndTemporaryMemory(RepulsionMemory);
+}
+
+internal void
+ResetIntegrator(app_state* State)
+{
+    State->Integrator = {};
+    State->Integrator.TimestepScale = 1.0f;
+}
+
+/* One velocity Verlet (kick-drift-kick) step, given the forces at the current
+ * positions in ddP. dP holds velocities that are still missing the second
+ * half-kick of the previous step, since that needs the forces at the current
+ * positions; it's applied here, before starting the next step. Drag is applied
+ * as exact exponential decay, which stays stable however long the step.
+ *
+ * The timestep is the platform's dt times a scale that grows slowly while the
+ * layout keeps releasing energy and is halved as soon as it doesn't, further
+ * limited so that the largest force can't fling a node too far.
+ * Returns the timestep taken. */
+internal f32
+IntegrateAdaptiveVerlet(app_state* State, graph* NodeGraph, f32 dt)
+{
+    integrator_state* Integrator = &State->Integrator;
+    f32* PX = NodeGraph->PX;
+    f32* PY = NodeGraph->PY;
+    f32* dPX = NodeGraph->dPX;
+    f32* dPY = NodeGraph->dPY;
+    f32* ddPX = NodeGraph->ddPX;
+    f32* ddPY = NodeGraph->ddPY;
+
+    f32 MaxAccelerationSq = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeGraph->NodeCount; ++NodeIndex)
+    {
+        MaxAccelerationSq = Max(MaxAccelerationSq, Square(ddPX[NodeIndex]) + Square(ddPY[NodeIndex]));
+    }
+
+    f32 Timestep = dt * Integrator->TimestepScale;
+    if (MaxAccelerationSq > 0.0f)
+    {
+        Timestep = Min(Timestep, sqrtf(2.0f*MaxStepLength / sqrtf(MaxAccelerationSq)));
+    }
+
+    f32 PreviousHalfStep = 0.5f*Integrator->PreviousTimestep;
+    f32 HalfStep = 0.5f*Timestep;
+    f32 Damping = expf(-DragK*Timestep);
+    f32 Power = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeGraph->NodeCount; ++NodeIndex)
+    {
+        dPX[NodeIndex] = (dPX[NodeIndex] + PreviousHalfStep*ddPX[NodeIndex]) * Damping;
+        dPY[NodeIndex] = (dPY[NodeIndex] + PreviousHalfStep*ddPY[NodeIndex]) * Damping;
+        Power += ddPX[NodeIndex]*dPX[NodeIndex] + ddPY[NodeIndex]*dPY[NodeIndex];
+
+        dPX[NodeIndex] += HalfStep*ddPX[NodeIndex];
+        dPY[NodeIndex] += HalfStep*ddPY[NodeIndex];
+        PX[NodeIndex] += Timestep*dPX[NodeIndex];
+        PY[NodeIndex] += Timestep*dPY[NodeIndex];
+
+        ddPX[NodeIndex] = 0.0f;
+        ddPY[NodeIndex] = 0.0f;
+    }
+
+    // The power F.v is the rate at which the potential energy of the layout
+    // is being released. While it's positive, the nodes are all heading
+    // downhill and a longer step is safe; once it goes negative they are
+    // overshooting, so back off quickly.
+    if (Power > 0.0f)
+    {
+        if (++Integrator->Progress >= 5)
+        {
+            Integrator->TimestepScale = Min(Integrator->TimestepScale * 1.1f, MaxTimestepScale);
+        }
+    }
+    else
+    {
+        Integrator->Progress = 0;
+        Integrator->TimestepScale = Max(Integrator->TimestepScale * 0.5f, MinTimestepScale);
+    }
+    Integrator->PreviousTimestep = Timestep;
+
+    return Timestep;
+}
+
+inline void
+WakeNode(graph* NodeGraph, s32 NodeIndex)
+{
+    NodeGraph->Asleep[NodeIndex] = false;
+    NodeGraph->StillSteps[NodeIndex] = 0;
+}
+
+/* Advances the simulation of NodeGraph by dt and returns statistics on how
+ * much it moved.
+ *
+ * Forces are only computed for the receivers: the nodes that are awake, plus
+ * the sleeping nodes due a check this step, which are woken if they turn out
+ * not to be at rest after all. The rest of the sleeping nodes have no force
+ * and no velocity, so integrating them leaves them where they are. */
+internal simulation_stats
+SimulateGraph(app_state* State, graph* NodeGraph, vec2 MinSide, vec2 MaxSide, vec2 MouseP, f32 dt)
+{
+    f32* PX = NodeGraph->PX;
+    f32* PY = NodeGraph->PY;
+    f32* dPX = NodeGraph->dPX;
+    f32* dPY = NodeGraph->dPY;
+    f32* ddPX = NodeGraph->ddPX;
+    f32* ddPY = NodeGraph->ddPY;
+    u8* Types = NodeGraph->Types;
+    u8* Asleep = NodeGraph->Asleep;
+    s32 NodeCount = NodeGraph->NodeCount;
+
+    BEGIN_PROFILE(SIMULATE);
+    temporary_memory StepMemory = BeginTemporaryMemory(&State->TempArena);
+
+    if (!State->Settings.Sleeping) { memset(Asleep, 0, NodeCount*sizeof(u8)); }
+    u32 CheckPhase = NodeGraph->StepCount++ % SleepCheckInterval;
+
+    // Receivers first, then everything else
+    s32* Order = PushArray(&State->TempArena, NodeCount, s32);
+    u8* Receives = PushArray(&State->TempArena, NodeCount, u8);
+    s32 ReceiverCount = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        // Anything the mouse pushes hard enough to move gets woken
+        if (Asleep[NodeIndex] &&
+            SafeRatio0(RepulsionK, LengthSq(MouseP - GetNodeP(NodeGraph, (node_id)NodeIndex))) > SleepForce)
+        {
+            WakeNode(NodeGraph, NodeIndex);
+        }
+
+        Receives[NodeIndex] = (!Asleep[NodeIndex] || (u32)NodeIndex % SleepCheckInterval == CheckPhase);
+        if (Receives[NodeIndex]) { Order[ReceiverCount++] = NodeIndex; }
+    }
+    for (s32 NodeIndex = 0, Slot = ReceiverCount; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        if (!Receives[NodeIndex]) { Order[Slot++] = NodeIndex; }
+    }
+
+    BEGIN_PROFILE(ATTRACTION);
+    for (s32 EdgeIndex = 0; EdgeIndex < NodeGraph->EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = NodeGraph->Edges + EdgeIndex;
+        if (Edge->HalfBidirectional) { continue; }
+        node_id Node1 = Edge->Source;
+        node_id Node2 = Edge->Dest;
+
+        f32 AttractionKLocal = AttractionK;
+
+        if (Node1 == Node2)
+        {
+            // Always maintain a short length for aesthetic reasons
+            Node2 = Edge->Control;
+            AttractionKLocal = 2.0f*AttractionK;
+        }
+        if (!Receives[Node1] && !Receives[Node2]) { continue; }
+        if (Types[Node1] == NODE_PRESTART)
+        {
+            AttractionKLocal = 3.0f*AttractionK;
+        }
+
+        // Attraction:
+        // Usually, people use Hookian springs here,
+        // but I found that for my purposes, a simple generic attraction
+        // in the direction of the link seems to work well with the other
+        // parts of the simulation.
+
+        vec2 Diff = V2(PX[Node2] - PX[Node1], PY[Node2] - PY[Node1]);
+        vec2 nDiff = Normalize(Diff);
+
+        ddPX[Node1] += AttractionKLocal * nDiff.x;
+        ddPY[Node1] += AttractionKLocal * nDiff.y;
+        ddPX[Node2] -= AttractionKLocal * nDiff.x;
+        ddPY[Node2] -= AttractionKLocal * nDiff.y;
+    }
+    END_PROFILE(ATTRACTION);
+
+    BEGIN_PROFILE(REPULSION);
+    if (State->Settings.RepulsionMode == REPULSION_BARNES_HUT)
+    {
+        ApplyBarnesHutRepulsion(State, NodeGraph, Order, ReceiverCount);
+    }
+    else
+    {
+        ApplyExactRepulsion(State, NodeGraph, Order, ReceiverCount);
+    }
+    END_PROFILE(REPULSION);
+
+    BEGIN_PROFILE(SIDE_FORCES);
+    for (s32 ReceiverIndex = 0; ReceiverIndex < ReceiverCount; ++ReceiverIndex)
+    {
+        node_id Node1Index = (node_id)Order[ReceiverIndex];
+        vec2 DeltaX, nDeltaX;
+
+        vec2 P1 = V2(PX[Node1Index], PY[Node1Index]);
+        u8 Type1 = Types[Node1Index];
+
+        // Repulsive force from edges
+        vec2 Sides[2] = { MinSide, MaxSide }; 
+
+        for (int SideIndex = 0; SideIndex < 2; ++SideIndex)
+        {
+            // Min side
+            DeltaX = Sides[SideIndex] - P1;
+            nDeltaX = Normalize(DeltaX);
+            vec2 RadiusSq = V2(Square(DeltaX.x), Square(DeltaX.y));
+            vec2 RepulsionMagnitude = SideRepulsionK * V2(SafeRatio0(1.0f , RadiusSq.x), SafeRatio0(1.0f, RadiusSq.y));
+
+            if (Type1 == NODE_CONTROL ||
+                Type1 == NODE_PRESTART) 
+            {
+                // Control points aren't as repulsed by the edges
+                RepulsionMagnitude = 0.1f * RepulsionMagnitude;
+            }
+
+            AddNodeddP(NodeGraph, Node1Index, -Hadamard(nDeltaX, RepulsionMagnitude));
+        }
+
+        // Repulsive force from mouse cursor
+        DeltaX =(vec2)(MouseP) - P1;
+        nDeltaX = Normalize(DeltaX);
+        f32 RadiusSq = LengthSq(DeltaX);
+        f32 RepulsionMagnitude = SafeRatio0(RepulsionK, RadiusSq);
+        
+        AddNodeddP(NodeGraph, Node1Index, -nDeltaX * RepulsionMagnitude);
+    }
+    END_PROFILE(SIDE_FORCES);
+
+    BEGIN_PROFILE(INTEGRATION);
+    // Sleeping nodes that are being pushed after all wake up; the rest
+    // shouldn't feel what their awake neighbours along edges pulled on them
+    f32* ForceSq = PushArray(&State->TempArena, NodeCount, f32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        ForceSq[NodeIndex] = Square(ddPX[NodeIndex]) + Square(ddPY[NodeIndex]);
+        if (!Asleep[NodeIndex]) { continue; }
+
+        if (Receives[NodeIndex] && ForceSq[NodeIndex] > Square(SleepForce))
+        {
+            WakeNode(NodeGraph, NodeIndex);
+        }
+        else
+        {
+            ddPX[NodeIndex] = 0.0f;
+            ddPY[NodeIndex] = 0.0f;
+        }
+    }
+
+    f32* OldPX = PushArray(&State->TempArena, NodeGraph->NodeCount, f32);
+    f32* OldPY = PushArray(&State->TempArena, NodeGraph->NodeCount, f32);
+    memcpy(OldPX, PX, NodeGraph->NodeCount*sizeof(f32));
+    memcpy(OldPY, PY, NodeGraph->NodeCount*sizeof(f32));
+
+    // Do the update
+    f32 Timestep = dt;
+    if (State->Settings.Integrator == INTEGRATOR_ADAPTIVE_VERLET)
+    {
+        Timestep = IntegrateAdaptiveVerlet(State, NodeGraph, dt);
+    }
+    else
+    {
+        for (s32 NodeIndex = 0; NodeIndex < NodeGraph->NodeCount; ++NodeIndex)
+        {
+            ddPX[NodeIndex] += -dPX[NodeIndex] * DragK;
+            ddPY[NodeIndex] += -dPY[NodeIndex] * DragK;
+
+            dPX[NodeIndex] += ddPX[NodeIndex] * dt;
+            dPY[NodeIndex] += ddPY[NodeIndex] * dt;
+            PX[NodeIndex] += dPX[NodeIndex] * dt;
+            PY[NodeIndex] += dPY[NodeIndex] * dt;
+
+            ddPX[NodeIndex] = 0.0f;
+            ddPY[NodeIndex] = 0.0f;
+        }
+    }
+    END_PROFILE(INTEGRATION);
+
+    // Collision detection last
+    // Only nodes closer than 2*NodeRadius can collide, so bucket the nodes
+    // into a grid of that size and only check the 3x3 block of cells around
+    // each node, which holds every node within 2*NodeRadius of any point in
+    // the middle cell. The walls are bounced off before the grid is built,
+    // and the two nodes of every collision are filed again where it left
+    // them; when Node1 is pushed into another cell, the block around that one
+    // is searched as well. So over Node1's turn every other node is compared
+    // with it at most once, and one that isn't stays farther than
+    // 2*NodeRadius from it the whole time, as with comparing every pair.
+    BEGIN_PROFILE(COLLISION);
+    for (s32 Node1Index = 0; Node1Index < NodeGraph->NodeCount; ++Node1Index)
+    {
+        if (Asleep[Node1Index]) { continue; }
+
+        if (PX[Node1Index] - NodeRadius < MinSide.x) {
+            PX[Node1Index] = MinSide.x + NodeRadius;
+            dPX[Node1Index] = -dPX[Node1Index];
+        }
+        else if (PX[Node1Index] + NodeRadius > MaxSide.x) {
+            PX[Node1Index] = MaxSide.x - NodeRadius;
+            dPX[Node1Index] = -dPX[Node1Index];
+        }
+
+        if (PY[Node1Index] - NodeRadius < MinSide.y) {
+            PY[Node1Index] = MinSide.y + NodeRadius;
+            dPY[Node1Index] = -dPY[Node1Index];
+        }
+        else if (PY[Node1Index] + NodeRadius > MaxSide.y) {
+            PY[Node1Index] = MaxSide.y - NodeRadius;
+            dPY[Node1Index] = -dPY[Node1Index];
+        }
+    }
+
+    temporary_memory CollisionMemory = BeginTemporaryMemory(&State->TempArena);
+
+    spatial_hash Hash = BuildSpatialHash(&State->TempArena, NodeGraph->NodeCount, 
+                                         PX, PY, 2*NodeRadius);
+    // The last Node1 each node was compared with, and each bucket was
+    // searched through for
+    s32* ComparedWith = PushArray(&State->TempArena, NodeGraph->NodeCount, s32);
+    s32* SearchedFor = PushArray(&State->TempArena, Hash.BucketCount, s32);
+    memset(ComparedWith, 0xFF, NodeGraph->NodeCount*sizeof(s32));
+    memset(SearchedFor, 0xFF, Hash.BucketCount*sizeof(s32));
+
+    for (s32 Node1Index = 0; Node1Index < NodeGraph->NodeCount; ++Node1Index)
+    {
+        // Sleeping nodes don't move, so they only collide with awake ones
+        if (Asleep[Node1Index]) { continue; }
+        bool Moving = (LengthSq(GetNodedP(NodeGraph, Node1Index)) > Square(WakeSpeed));
+
+        // Every rescan follows a collision with a node not compared before,
+        // so this ends
+        bool Rescan = true;
+        while (Rescan)
+        {
+            Rescan = false;
+            ivec2 Cell = SpatialHashCell(&Hash, GetNodeP(NodeGraph, Node1Index));
+            for (int NeighborIndex = 0; NeighborIndex < 9 && !Rescan; ++NeighborIndex)
+            {
+                ivec2 NeighborCell = IV2(Cell.X + (NeighborIndex % 3) - 1, 
+                                         Cell.Y + (NeighborIndex / 3) - 1);
+                u32 Bucket = SpatialHashBucket(&Hash, NeighborCell);
+
+                // Neighboring cells may hash to the same bucket, and the only
+                // nodes to join a bucket after it has been searched through
+                // are ones already compared
+                if (SearchedFor[Bucket] == Node1Index) { continue; }
+
+                // Node2 may be filed elsewhere before the next one is taken
+                s32 NextIndex = -1;
+                for (s32 Node2Index = Hash.BucketFirst[Bucket]; Node2Index >= 0 && !Rescan;
+                     Node2Index = NextIndex)
+                {
+                    NextIndex = Hash.Next[Node2Index];
+                    if (Node2Index == Node1Index || ComparedWith[Node2Index] == Node1Index) { continue; }
+                    ComparedWith[Node2Index] = Node1Index;
+                    if (Moving && Asleep[Node2Index]) { WakeNode(NodeGraph, Node2Index); }
+
+                    vec2 Diff = GetNodeP(NodeGraph, Node2Index) - GetNodeP(NodeGraph, Node1Index);
+                    vec2 NormalDiff = Normalize(Diff);
+                    if (LengthSq(Diff) < Square(2*NodeRadius))
+                    {
+                        if (Asleep[Node2Index]) { WakeNode(NodeGraph, Node2Index); }
+                        vec2 Center = GetNodeP(NodeGraph, Node1Index) + 0.5f*Diff;
+                        vec2 X1 = Center - NodeRadius*NormalDiff;
+                        vec2 X2 = Center + NodeRadius*NormalDiff;
+                        SetNodeP(NodeGraph, Node1Index, X1);
+                        SetNodeP(NodeGraph, Node2Index, X2);
+                        MoveSpatialHashPoint(&Hash, Node2Index, X2);
+                        MoveSpatialHashPoint(&Hash, Node1Index, X1);
+
+                        // NextIndex may be Node1, so the bucket is left as
+                        // soon as Node1 leaves the cell it was in
+                        ivec2 Node1Cell = SpatialHashCell(&Hash, X1);
+                        Rescan = (Node1Cell.X != Cell.X || Node1Cell.Y != Cell.Y);
+
+                        vec2 V1 = GetNodedP(NodeGraph, Node1Index);
+                        vec2 V2 = GetNodedP(NodeGraph, Node2Index);
+
+                        SetNodedP(NodeGraph, Node1Index, V1 - SafeRatio0(Inner(V1 - V2, X1 - X2),LengthSq(X1 - X2))*(X1 - X2));
+                        SetNodedP(NodeGraph, Node2Index, V2 - SafeRatio0(Inner(V2 - V1, X2 - X1),LengthSq(X2 - X1))*(X2 - X1));
+                    }
+                }
+                if (!Rescan) { SearchedFor[Bucket] = Node1Index; }
+            }
+        }
+    }
+
+    EndTemporaryMemory(CollisionMemory);
+    END_PROFILE(COLLISION);
+
+    BEGIN_PROFILE(SLEEP);
+    if (State->Settings.Sleeping)
+    {
+        for (s32 EdgeIndex = 0; EdgeIndex < NodeGraph->EdgeCount; ++EdgeIndex)
+        {
+            node_id Node1, Node2;
+            if (!EdgeEndpoints(NodeGraph->Edges + EdgeIndex, &Node1, &Node2)) { continue; }
+            if (Asleep[Node1] == Asleep[Node2]) { continue; }
+
+            node_id Awake = Asleep[Node1] ? Node2 : Node1;
+            if (LengthSq(GetNodedP(NodeGraph, Awake)) > Square(WakeSpeed))
+            {
+                WakeNode(NodeGraph, Asleep[Node1] ? Node1 : Node2);
+            }
+        }
+
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            if (Asleep[NodeIndex]) { continue; }
+
+            u16* StillSteps = NodeGraph->StillSteps + NodeIndex;
+            if (LengthSq(GetNodedP(NodeGraph, (node_id)NodeIndex)) > Square(SleepSpeed) ||
+                ForceSq[NodeIndex] > Square(SleepForce))
+            {
+                *StillSteps = 0;
+            }
+            else if (++*StillSteps >= SleepSteps)
+            {
+                Asleep[NodeIndex] = true;
+                SetNodedP(NodeGraph, (node_id)NodeIndex, V2(0.0f, 0.0f));
+            }
+        }
+    }
+
+    simulation_stats Stats = {};
+    Stats.NodeCount = NodeGraph->NodeCount;
+    Stats.Timestep = Timestep;
+    f32 MaxDisplacementSq = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeGraph->NodeCount; ++NodeIndex)
+    {
+        Stats.AwakeCount += !Asleep[NodeIndex];
+        Stats.KineticEnergy += 0.5f*(Square(dPX[NodeIndex]) + Square(dPY[NodeIndex]));
+        MaxDisplacementSq = Max(MaxDisplacementSq, Square(PX[NodeIndex] - OldPX[NodeIndex]) +
+                                                   Square(PY[NodeIndex] - OldPY[NodeIndex]));
+    }
+    Stats.MaxDisplacement = sqrtf(MaxDisplacementSq);
+    END_PROFILE(SLEEP);
+
+    EndTemporaryMemory(StepMemory);
+    END_PROFILE(SIMULATE);
+
+    return Stats;
+}
+
+/* Places the nodes of Fine on top of the nodes of Coarse they were merged
+ * into, jittered a little so that the simulation can tell them apart, and
+ * brings them to rest. */
+internal void
+ProlongLayout(graph* Coarse, node_id* CoarseNodeOf, graph* Fine)
+{
+    for (s32 NodeIndex = 0; NodeIndex < Fine->NodeCount; ++NodeIndex)
+    {
+        f32 JitterX = RandRange(&Fine->Random, -1, 1);
+        f32 JitterY = RandRange(&Fine->Random, -1, 1);
+        vec2 Jitter = 0.5f*NodeRadius*V2(JitterX, JitterY);
+        SetNodeP(Fine, (node_id)NodeIndex, GetNodeP(Coarse, CoarseNodeOf[NodeIndex]) + Jitter);
+        SetNodedP(Fine, (node_id)NodeIndex, V2(0.0f, 0.0f));
+    }
+}
+
+/* Lays out NodeGraph from its initial placement by coarsening it into a
+ * hierarchy of smaller graphs (each starting from the centroids of the one
+ * below), simulating the coarsest until it settles, and then working back
+ * down, giving each finer level a short refinement run starting from the
+ * positions of the level above. Leaves NodeGraph at rest for the normal
+ * simulation to finish off. */
+internal void
+MultilevelLayout(app_state* State, graph* NodeGraph, vec2 MinSide, vec2 MaxSide, f32 dt)
+{
+    temporary_memory HierarchyMemory = BeginTemporaryMemory(&State->TempArena);
+
+    graph_hierarchy Hierarchy = BuildGraphHierarchy(&State->TempArena, NodeGraph, MultilevelMinNodes);
+    vec2 NoMouseP = V2(-50000, -50000);
 
-	return true;
+    for (s32 LevelIndex = Hierarchy.LevelCount - 1; LevelIndex >= 0; --LevelIndex)
+    {
+        graph_level* Level = Hierarchy.Levels + LevelIndex;
+        bool Coarsest = (LevelIndex == Hierarchy.LevelCount - 1);
+
+        ResetIntegrator(State);
+        s32 StepCount = Coarsest ? MultilevelCoarsestSteps : MultilevelRefineSteps;
+        for (s32 Step = 0; Step < StepCount; ++Step)
+        {
+            simulation_stats Stats = SimulateGraph(State, Level->Graph, MinSide, MaxSide, NoMouseP, dt);
+            if (Coarsest && Step > 0 &&
+                Stats.KineticEnergy < MultilevelSettledEnergy*Stats.NodeCount)
+            {
+                break;
+            }
+        }
+
+        graph* Fine = (LevelIndex > 0) ? Hierarchy.Levels[LevelIndex - 1].Graph : NodeGraph;
+        ProlongLayout(Level->Graph, Level->CoarseNodeOf, Fine);
+    }
+
+    ResetIntegrator(State);
+    EndTemporaryMemory(HierarchyMemory);
 }
 
-graph_node* FindNodeByName(graph* Graph, 
-                           char* NameStart, size_t NameLength, s16 IndexStart)
+/* Lays out one component of a graph, starting from scratch, on a private copy
+ * of the app_state: it has its own scratch memory and integrator, and no work
+ * queue, since it's already running on it. */
+struct component_layout_job
 {
-    graph_node* Result = NULL;
-    for (s16 NodeIndex = IndexStart; NodeIndex < Graph->NodeCount; ++NodeIndex) {
-        graph_node* Node = Graph->Nodes + NodeIndex;
+    app_state State;
+    graph* Graph;
+    initial_placement Placement;
+    vec2 MinSide;
+    vec2 MaxSide;
+    f32 dt;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(ComponentLayoutJob)
+{
+    component_layout_job* Job = (component_layout_job*)Data;
+    app_state* State = &Job->State;
+
+    PlaceNodes(&State->TempArena, Job->Graph, Job->Placement, Job->MinSide, Job->MaxSide);
+    if (State->Settings.Multilevel)
+    {
+        MultilevelLayout(State, Job->Graph, Job->MinSide, Job->MaxSide, Job->dt);
+    }
 
-        if (Node->Name.Length != NameLength) { continue; }
-        if (StringSegmentsEqual((int)Node->Name.Length, Node->Name.Start, NameStart))
+    // Nodes start at rest, so only call it settled once the energy has
+    // climbed and fallen again (or everything has gone to sleep)
+    ResetIntegrator(State);
+    vec2 NoMouseP = V2(-50000, -50000);
+    f32 PeakEnergy = 0.0f;
+    for (s32 Step = 0; Step < ComponentMaxSteps; ++Step)
+    {
+        simulation_stats Stats = SimulateGraph(State, Job->Graph, Job->MinSide, Job->MaxSide, NoMouseP, Job->dt);
+        f32 SettledEnergy = ComponentSettledEnergy*Stats.NodeCount;
+        PeakEnergy = Max(PeakEnergy, Stats.KineticEnergy);
+        if (Stats.AwakeCount == 0 ||
+            (PeakEnergy > SettledEnergy && Stats.KineticEnergy < SettledEnergy))
         {
-            Result = Node;
             break;
         }
     }
-    return Result;
 }
 
-graph_edge* FindEdgeByNodes(graph* Graph, 
-                            node_id StartNode, node_id EndNode, s16 IndexStart)
+/* Lays out NodeGraph from scratch one connected component at a time, spread
+ * across the work queue, side by side in the space between MinSide and
+ * MaxSide. Each component gets a box of the same shape as the whole space,
+ * sized in proportion to its share of the nodes (but never less than it
+ * needs). The boxes are scaled down until they pack onto shelves that fit
+ * the space, and every component is then placed and laid out within its box
+ * just as a whole graph would be. Leaves NodeGraph at rest for the normal
+ * simulation to finish off.
+ * Returns false, leaving NodeGraph alone, if it only has one component (or
+ * there's no room to split it up). */
+internal bool
+ComponentLayout(app_state* State, graph* NodeGraph, initial_placement Placement,
+                vec2 MinSide, vec2 MaxSide, f32 dt)
 {
-    graph_edge* Result = NULL;
-    for (s16 EdgeIndex = IndexStart; EdgeIndex < Graph->EdgeCount; ++EdgeIndex) {
-        graph_edge* Edge = Graph->Edges + EdgeIndex;
+    temporary_memory ComponentMemory = BeginTemporaryMemory(&State->TempArena);
+
+    graph_components Components = SplitComponents(&State->TempArena, NodeGraph, MAX_SIMULATION_JOBS);
+    if (Components.Count < 2)
+    {
+        EndTemporaryMemory(ComponentMemory);
+        return false;
+    }
+
+    s32 Count = Components.Count;
+    component_layout_job* Jobs = PushArray(&State->TempArena, Count, component_layout_job);
+    vec2* Share = PushArray(&State->TempArena, Count, vec2);
+    f32* Needed = PushArray(&State->TempArena, Count, f32);
+    vec2* Boxes = PushArray(&State->TempArena, Count, vec2);
+    vec2* Offsets = PushArray(&State->TempArena, Count, vec2);
+
+    vec2 SpaceSize = MaxSide - MinSide;
+    for (s32 ComponentIndex = 0; ComponentIndex < Count; ++ComponentIndex)
+    {
+        f32 ComponentNodeCount = (f32)Components.Components[ComponentIndex].Graph->NodeCount;
+        Share[ComponentIndex] = sqrtf(ComponentNodeCount / (f32)NodeGraph->NodeCount) * SpaceSize;
+        Needed[ComponentIndex] = ComponentSpacing*sqrtf(ComponentNodeCount);
+    }
 
-        if (Edge->Source == StartNode && Edge->Dest == EndNode)
+    // Bisect for the largest scale on the shares at which the boxes still fit.
+    // If they don't even fit at their minimum sizes, they'll have to overflow.
+    f32 FitScale = 0.0f;
+    f32 TooBigScale = 1.0f;
+    for (s32 Iteration = 0; Iteration < 16; ++Iteration)
+    {
+        f32 Scale = (Iteration == 0) ? TooBigScale : 0.5f*(FitScale + TooBigScale);
+        for (s32 ComponentIndex = 0; ComponentIndex < Count; ++ComponentIndex)
         {
-            Result = Edge;
-            break;
+            Boxes[ComponentIndex] = V2(Max(Scale*Share[ComponentIndex].x, Needed[ComponentIndex]),
+                                       Max(Scale*Share[ComponentIndex].y, Needed[ComponentIndex]));
         }
+        vec2 Extent = PackShelves(&State->TempArena, Count, Boxes, SpaceSize.x, ComponentGap, Offsets);
+        bool Fits = (Extent.x <= SpaceSize.x && Extent.y <= SpaceSize.y);
+
+        if (Fits) { FitScale = Scale; }
+        else { TooBigScale = Scale; }
+        if (Fits && Iteration == 0) { break; }
     }
-    return Result;
-}
 
-internal vec2
-BounceVector(vec2 SurfaceVec, vec2 Incoming)
-{
-    vec2 SurfaceNormal = LeftNormal(SurfaceVec);
-    vec2 Result = -(2*Inner(SurfaceNormal, Incoming) * SurfaceNormal - Incoming);
-    return Result;
-}
+    for (s32 ComponentIndex = 0; ComponentIndex < Count; ++ComponentIndex)
+    {
+        Boxes[ComponentIndex] = V2(Max(FitScale*Share[ComponentIndex].x, Needed[ComponentIndex]),
+                                   Max(FitScale*Share[ComponentIndex].y, Needed[ComponentIndex]));
+    }
+    vec2 Extent = PackShelves(&State->TempArena, Count, Boxes, SpaceSize.x, ComponentGap, Offsets);
+    vec2 Origin = 0.5f*(MinSide + MaxSide) - 0.5f*Extent;
 
-internal void
-SimulateGraph(graph* NodeGraph, vec2 MinSide, vec2 MaxSide, vec2 MouseP, f32 dt)
-{
-    for (s16 EdgeIndex = 0; EdgeIndex < NodeGraph->EdgeCount; ++EdgeIndex)
+    // Share out the rest of the scratch memory between the jobs
+    memory_index JobArenaSize = (State->TempArena.Size - State->TempArena.Used) / Count;
+    for (s32 ComponentIndex = 0; ComponentIndex < Count; ++ComponentIndex)
     {
-        graph_edge* Edge = NodeGraph->Edges + EdgeIndex;
-        if (Edge->HalfBidirectional) { continue; }
-        graph_node* Node1 = NodeGraph->Nodes + Edge->Source;
-        graph_node* Node2 = NodeGraph->Nodes + Edge->Dest;
+        component_layout_job* Job = Jobs + ComponentIndex;
+        Job->Graph = Components.Components[ComponentIndex].Graph;
+        Job->Placement = Placement;
+        Job->MinSide = -0.5f*Boxes[ComponentIndex];
+        Job->MaxSide = 0.5f*Boxes[ComponentIndex];
+        Job->dt = dt;
+
+        Job->State = *State;
+        Job->State.WorkQueue = NULL;
+        InitializeArena(&Job->State.TempArena, JobArenaSize, PushSize(&State->TempArena, JobArenaSize));
+    }
 
-        f32 AttractionKLocal = AttractionK;
+    RunJobs(State, ComponentLayoutJob, Jobs, sizeof(component_layout_job), Count);
 
-        if (Node1->ID == Node2->ID)
+    // The layouts don't necessarily fill their boxes, so center them in them
+    for (s32 ComponentIndex = 0; ComponentIndex < Count; ++ComponentIndex)
+    {
+        graph_component* Component = Components.Components + ComponentIndex;
+        vec2 Lowest = GetNodeP(Component->Graph, 0);
+        vec2 Highest = Lowest;
+        for (s32 NodeIndex = 1; NodeIndex < Component->Graph->NodeCount; ++NodeIndex)
         {
-            // Always maintain a short length for aesthetic reasons
-            Node2 = NodeGraph->Nodes + Edge->Control;
-            AttractionKLocal = 2.0f*AttractionK;
+            vec2 P = GetNodeP(Component->Graph, (node_id)NodeIndex);
+            Lowest = V2(Min(Lowest.x, P.x), Min(Lowest.y, P.y));
+            Highest = V2(Max(Highest.x, P.x), Max(Highest.y, P.y));
         }
-        if (Node1->Type == NODE_PRESTART)
+
+        vec2 BoxCenter = Origin + Offsets[ComponentIndex] + 0.5f*Boxes[ComponentIndex];
+        vec2 Shift = BoxCenter - 0.5f*(Lowest + Highest);
+        for (s32 NodeIndex = 0; NodeIndex < Component->Graph->NodeCount; ++NodeIndex)
         {
-            AttractionKLocal = 3.0f*AttractionK;
+            node_id Original = Component->OriginalNodeOf[NodeIndex];
+            SetNodeP(NodeGraph, Original, GetNodeP(Component->Graph, (node_id)NodeIndex) + Shift);
+            SetNodedP(NodeGraph, Original, V2(0.0f, 0.0f));
         }
+    }
 
-        // Attraction:
-        // Usually, people use Hookian springs here,
-        // but I found that for my purposes, a simple generic attraction
-        // in the direction of the link seems to work well with the other
-        // parts of the simulation.
+    EndTemporaryMemory(ComponentMemory);
 
-        vec2 Diff = Node2->P - Node1->P;
-        vec2 nDiff = Normalize(Diff);
+    return true;
+}
 
-        Node1->ddP += AttractionKLocal * nDiff;
-        Node2->ddP += -AttractionKLocal * nDiff;
+/* One job's share of a LayoutBatch call, simulated through a single
+ * graph_batch. The layouts are ordered largest first, and a lane is refilled
+ * with the next one as soon as the graph in it finishes. */
+struct batch_layout_job
+{
+    graph_batch Batch;
+    batch_params* Params;
+    settle_criteria* Criteria;
+    batch_layout** Layouts;
+    s32 LayoutCount;
+};
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(BatchLayoutJob)
+{
+    batch_layout_job* Job = (batch_layout_job*)Data;
+    graph_batch* Batch = &Job->Batch;
+
+    batch_layout* InLane[BATCH_LANES] = {};
+    settle_state Settle[BATCH_LANES] = {};
+    s32 NextLayout = 0;
+    s32 OccupiedCount = 0;
+    for (s32 Lane = 0; Lane < BATCH_LANES; ++Lane)
+    {
+        if (NextLayout < Job->LayoutCount)
+        {
+            InLane[Lane] = Job->Layouts[NextLayout++];
+            ++OccupiedCount;
+        }
+        LoadBatchLane(Batch, Lane, InLane[Lane] ? InLane[Lane]->Graph : NULL);
     }
 
-    // Hooray, n^2 Updates
-    for (s16 Node1Index = 0; Node1Index < NodeGraph->NodeCount; ++Node1Index)
+    while (OccupiedCount > 0)
     {
-        vec2 DeltaX, nDeltaX;
+        SimulateBatch(Batch, Job->Params);
 
-        graph_node* Node1 = NodeGraph->Nodes + Node1Index;
-        for (s16 Node2Index = 0; Node2Index < NodeGraph->NodeCount; ++Node2Index)
+        for (s32 Lane = 0; Lane < BATCH_LANES; ++Lane)
         {
-            if (Node2Index == Node1Index) { continue; }
-            graph_node* Node2 = NodeGraph->Nodes + Node2Index;
-
-            DeltaX = Node2->P - Node1->P;
-            nDeltaX = Normalize(DeltaX);
-
-            if (Node1->Type == NODE_CONTROL &&
-                Node2->Type == NODE_CONTROL)
+            batch_layout* Layout = InLane[Lane];
+            if (Layout == NULL) { continue; }
+
+            simulation_stats Stats = {};
+            Stats.NodeCount = Layout->Graph->NodeCount;
+            Stats.KineticEnergy = Batch->KineticEnergy[Lane];
+            Stats.MaxDisplacement = Batch->MaxDisplacement[Lane];
+            Stats.Timestep = Job->Params->dt;
+            Stats.AwakeCount = Stats.NodeCount;
+            if (!LayoutSettled(Settle + Lane, Job->Criteria, Stats) &&
+                Settle[Lane].Steps < Job->Criteria->MaxIterations)
             {
-                // Control points shouldn't really affect each other
                 continue;
             }
 
-            f32 RepulsionKLocal = RepulsionK;
+            StoreBatchLane(Batch, Lane);
+            Layout->StepCount = Settle[Lane].Steps;
 
-            if (Node1->Type == NODE_CONTROL ||
-                Node2->Type == NODE_CONTROL ||
-                Node1->Type == NODE_PRESTART ||
-                Node2->Type == NODE_PRESTART)
+            Settle[Lane] = {};
+            InLane[Lane] = NULL;
+            --OccupiedCount;
+            if (NextLayout < Job->LayoutCount)
             {
-                // Allow control points to be a lot closer to other nodes
-                RepulsionKLocal = 0.3f*RepulsionK;
+                InLane[Lane] = Job->Layouts[NextLayout++];
+                ++OccupiedCount;
             }
+            LoadBatchLane(Batch, Lane, InLane[Lane] ? InLane[Lane]->Graph : NULL);
+        }
+    }
+}
+
+/* Finds, for every node of New, the node of Old it corresponds to, or -1.
+ * Nodes are matched by JavaID where possible and by name otherwise, each old
+ * node being used at most once, in order (so that nodes sharing a name across
+ * several NFAs pair up file by file). Unnamed nodes with a single neighbour,
+ * i.e. the prestart and control nodes, are matched to an unnamed node of the
+ * same type hanging off the corresponding old neighbour. */
+internal node_id*
+MatchReloadedNodes(memory_arena* Arena, graph* Old, graph* New)
+{
+    node_id* OldNodeOf = PushArray(Arena, New->NodeCount, node_id);
+    bool* Taken = PushArray(Arena, Old->NodeCount, bool);
+    memset(Taken, 0, Old->NodeCount*sizeof(bool));
+
+    for (s32 NewIndex = 0; NewIndex < New->NodeCount; ++NewIndex)
+    {
+        OldNodeOf[NewIndex] = -1;
+    }
 
-            // Coloumbesque repulsion: Fr = k(q1*q2)/r^2
-            // Except things don't have "charge", so the numerator term is entirely arbitrary
-            // And there's not really mass, so it's only loosely treated as a force.
+    for (s32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (s32 NewIndex = 0; NewIndex < New->NodeCount; ++NewIndex)
+        {
+            graph_node* NewNode = New->Nodes + NewIndex;
+            string Key = (Pass == 0) ? NewNode->JavaID : NewNode->Name;
+            if (OldNodeOf[NewIndex] != -1 || Key.Length == 0) { continue; }
 
-            f32 RadiusSq = LengthSq(DeltaX);
-            f32 RepulsionMagnitude = SafeRatio0(RepulsionKLocal, RadiusSq);
-            
-            Node1->ddP += -nDeltaX * RepulsionMagnitude;
-            Node2->ddP += nDeltaX * RepulsionMagnitude;
+            graph_node* OldNode = (Pass == 0)
+                ? FindNodeByKey(Old, &Old->JavaIDIndex, offsetof(graph_node, JavaID), Key, 0, Taken)
+                : FindNodeByKey(Old, &Old->NameIndex, offsetof(graph_node, Name), Key, 0, Taken);
+            if (!OldNode) { continue; }
+
+            OldNodeOf[NewIndex] = OldNode->ID;
+            Taken[OldNode->ID] = true;
         }
+    }
 
+    adjacency OldAdjacency = BuildAdjacency(Arena, Old);
+    adjacency NewAdjacency = BuildAdjacency(Arena, New);
+    for (s32 NewIndex = 0; NewIndex < New->NodeCount; ++NewIndex)
+    {
+        if (OldNodeOf[NewIndex] != -1 || NodeDegree(&NewAdjacency, NewIndex) != 1) { continue; }
 
-        // Repulsive force from edges
-        vec2 Sides[2] = { MinSide, MaxSide }; 
+        node_id Neighbor = NewAdjacency.Neighbors[NewAdjacency.Start[NewIndex]];
+        node_id OldNeighbor = OldNodeOf[Neighbor];
+        if (OldNeighbor == -1) { continue; }
 
-        for (int SideIndex = 0; SideIndex < 2; ++SideIndex)
+        for (s32 Slot = OldAdjacency.Start[OldNeighbor]; Slot < OldAdjacency.Start[OldNeighbor + 1]; ++Slot)
         {
-            // Min side
-            DeltaX = Sides[SideIndex] - Node1->P;
-            nDeltaX = Normalize(DeltaX);
-            vec2 RadiusSq = V2(Square(DeltaX.x), Square(DeltaX.y));
-            vec2 RepulsionMagnitude = SideRepulsionK * V2(SafeRatio0(1.0f , RadiusSq.x), SafeRatio0(1.0f, RadiusSq.y));
-
-            if (Node1->Type == NODE_CONTROL ||
-                Node1->Type == NODE_PRESTART) 
+            node_id OldIndex = OldAdjacency.Neighbors[Slot];
+            if (Taken[OldIndex] || NodeDegree(&OldAdjacency, OldIndex) != 1 ||
+                Old->Nodes[OldIndex].Name.Length != 0 ||
+                GetNodeType(Old, OldIndex) != GetNodeType(New, (node_id)NewIndex))
             {
-                // Control points aren't as repulsed by the edges
-                RepulsionMagnitude = 0.1f * RepulsionMagnitude;
+                continue;
             }
 
-            Node1->ddP += -Hadamard(nDeltaX, RepulsionMagnitude);
+            OldNodeOf[NewIndex] = OldIndex;
+            Taken[OldIndex] = true;
+            break;
         }
+    }
 
-        // Repulsive force from mouse cursor
-        DeltaX =(vec2)(MouseP) -  Node1->P ;
-        nDeltaX = Normalize(DeltaX);
-        f32 RadiusSq = LengthSq(DeltaX);
-        f32 RepulsionMagnitude = SafeRatio0(RepulsionK, RadiusSq);
-        
-        Node1->ddP += -nDeltaX * RepulsionMagnitude;
+    return OldNodeOf;
+}
+
+/* Returns a copy of Graph with its arrays in Arena, exactly big enough for
+ * what it holds, or NULL if Arena can't hold them. */
+internal graph*
+CopyGraph(memory_arena* Arena, graph* Graph)
+{
+    graph* Result = PushStruct(Arena, graph);
+    if (!InitializeGraph(Result, Arena, Graph->NodeCount, Graph->EdgeCount)) { return NULL; }
+    s32 NodeCount = Graph->NodeCount;
+    memcpy(Result->PX, Graph->PX, NodeCount*sizeof(f32));
+    memcpy(Result->PY, Graph->PY, NodeCount*sizeof(f32));
+    memcpy(Result->dPX, Graph->dPX, NodeCount*sizeof(f32));
+    memcpy(Result->dPY, Graph->dPY, NodeCount*sizeof(f32));
+    memcpy(Result->ddPX, Graph->ddPX, NodeCount*sizeof(f32));
+    memcpy(Result->ddPY, Graph->ddPY, NodeCount*sizeof(f32));
+    memcpy(Result->Types, Graph->Types, NodeCount*sizeof(u8));
+    memcpy(Result->Asleep, Graph->Asleep, NodeCount*sizeof(u8));
+    memcpy(Result->StillSteps, Graph->StillSteps, NodeCount*sizeof(u16));
+    memcpy(Result->Nodes, Graph->Nodes, NodeCount*sizeof(graph_node));
+    memcpy(Result->Edges, Graph->Edges, Graph->EdgeCount*sizeof(graph_edge));
+    Result->NodeCount = NodeCount;
+    Result->EdgeCount = Graph->EdgeCount;
+    Result->StepCount = Graph->StepCount;
+    Result->Random = Graph->Random;
+    Result->Name = Graph->Name;
+    Result->JavaID = Graph->JavaID;
+    return Result;
+}
+
+/* Empties State's graph, giving back all the memory its arrays took, ready
+ * for it to be generated again with a random series of its own. */
+internal void
+ClearGraph(app_state* State)
+{
+    EndTemporaryMemory(State->GraphMemory);
+    State->GraphMemory = BeginTemporaryMemory(&State->GraphArena);
+    InitializeGraph(State->Graph, &State->GraphArena);
+    State->Graph->Random = RandomSplit(&State->Random);
+}
+
+/* Regenerates the graph from the NFA files while keeping as much of the
+ * current layout as possible. Nodes that can be matched to a node of the old
+ * graph (see MatchReloadedNodes) keep its position and velocity. The rest are
+ * placed next to their matched neighbours, spreading outwards from them, and
+ * then given a short run of the simulation to settle in while the matched
+ * nodes are held still. Returns the number of nodes matched; if that is zero
+ * the graph is left exactly as freshly generated. */
+internal s32
+ReloadGraph(app_state* State, app_memory* Memory, vec2 MinSide, vec2 MaxSide, f32 dt)
+{
+    temporary_memory ReloadMemory = BeginTemporaryMemory(&State->TempArena);
+
+    // The new graph takes over the memory of the old one, so the old one has
+    // to be copied out of the way first
+    graph* Old = CopyGraph(&State->TempArena, State->Graph);
+    if (Old)
+    {
+        // Matching by name relies on the old nodes being in declaration order
+        ReorderNodes(&State->TempArena, Old, NODE_ORDER_DECLARATION);
+        IndexNodes(Old);
     }
 
-    // Do the update
-    for (s16 NodeIndex = 0; NodeIndex < NodeGraph->NodeCount; ++NodeIndex)
+    graph* New = State->Graph;
+    ClearGraph(State);
+    for (int NFAFileIndex = 0; NFAFileIndex < Memory->NFAFileCount; ++NFAFileIndex)
     {
-        graph_node* Node = NodeGraph->Nodes + NodeIndex;
+        nfa_parse::GenerateGraph(Memory->NFAFiles[NFAFileIndex], New);
+    }
 
-        Node->ddP += -Node->dP * DragK;
+    // Without the room to copy it aside, nothing of the old graph is kept
+    if (!Old)
+    {
+        EndTemporaryMemory(ReloadMemory);
+        return 0;
+    }
 
-        Node->dP += Node->ddP * dt;
-        Node->P += Node->dP * dt;
+    node_id* OldNodeOf = MatchReloadedNodes(&State->TempArena, Old, New);
+    bool* Placed = PushArray(&State->TempArena, New->NodeCount, bool);
+    s32 MatchedCount = 0;
+    for (s32 NodeIndex = 0; NodeIndex < New->NodeCount; ++NodeIndex)
+    {
+        node_id OldIndex = OldNodeOf[NodeIndex];
+        Placed[NodeIndex] = (OldIndex != -1);
+        if (OldIndex == -1) { continue; }
 
-        Node->ddP = V2(0.0f, 0.0f);
+        SetNodeP(New, (node_id)NodeIndex, GetNodeP(Old, OldIndex));
+        SetNodedP(New, (node_id)NodeIndex, V2(Old->dPX[OldIndex], Old->dPY[OldIndex]));
+        ++MatchedCount;
     }
-            
-    // Collision detection last
-    // Hooray, n^2 Updates
-    for (s16 Node1Index = 0; Node1Index < NodeGraph->NodeCount; ++Node1Index)
+
+    s32 NewCount = New->NodeCount - MatchedCount;
+    if (MatchedCount > 0 && NewCount > 0)
     {
-        graph_node* Node1 = NodeGraph->Nodes + Node1Index;
-        for (s16 Node2Index = 0; Node2Index < NodeGraph->NodeCount; ++Node2Index)
+        // Grow outwards from the matched nodes one ring of neighbours at a
+        // time. Anything not connected to them keeps its random position.
+        adjacency Adjacency = BuildAdjacency(&State->TempArena, New);
+        bool* PlacedThisRing = PushArray(&State->TempArena, New->NodeCount, bool);
+        bool Grew = true;
+        while (Grew)
         {
-            if (Node2Index == Node1Index) { continue; }
-            graph_node* Node2 = NodeGraph->Nodes + Node2Index;
+            Grew = false;
+            memset(PlacedThisRing, 0, New->NodeCount*sizeof(bool));
+            for (s32 NodeIndex = 0; NodeIndex < New->NodeCount; ++NodeIndex)
+            {
+                if (Placed[NodeIndex]) { continue; }
+
+                vec2 NeighborSum = V2(0.0f, 0.0f);
+                s32 NeighborCount = 0;
+                for (s32 Slot = Adjacency.Start[NodeIndex]; Slot < Adjacency.Start[NodeIndex + 1]; ++Slot)
+                {
+                    node_id Neighbor = Adjacency.Neighbors[Slot];
+                    if (!Placed[Neighbor]) { continue; }
+                    NeighborSum += GetNodeP(New, Neighbor);
+                    ++NeighborCount;
+                }
+                if (NeighborCount == 0) { continue; }
+
+                f32 OffsetX = RandRange(&New->Random, -1, 1);
+                f32 OffsetY = RandRange(&New->Random, -1, 1);
+                vec2 Offset = 2.0f*NodeRadius*V2(OffsetX, OffsetY);
+                SetNodeP(New, (node_id)NodeIndex, NeighborSum / (f32)NeighborCount + Offset);
+                SetNodedP(New, (node_id)NodeIndex, V2(0.0f, 0.0f));
+                PlacedThisRing[NodeIndex] = true;
+                Grew = true;
+            }
+            for (s32 NodeIndex = 0; NodeIndex < New->NodeCount; ++NodeIndex)
+            {
+                Placed[NodeIndex] = Placed[NodeIndex] || PlacedThisRing[NodeIndex];
+            }
+        }
 
-            vec2 Diff = Node2->P - Node1->P;
-            vec2 NormalDiff = Normalize(Diff);
-            if (LengthSq(Diff) < Square(2*NodeRadius))
+        f32* HeldPX = PushArray(&State->TempArena, New->NodeCount, f32);
+        f32* HeldPY = PushArray(&State->TempArena, New->NodeCount, f32);
+        f32* HelddPX = PushArray(&State->TempArena, New->NodeCount, f32);
+        f32* HelddPY = PushArray(&State->TempArena, New->NodeCount, f32);
+        memcpy(HeldPX, New->PX, New->NodeCount*sizeof(f32));
+        memcpy(HeldPY, New->PY, New->NodeCount*sizeof(f32));
+        memcpy(HelddPX, New->dPX, New->NodeCount*sizeof(f32));
+        memcpy(HelddPY, New->dPY, New->NodeCount*sizeof(f32));
+
+        vec2 NoMouseP = V2(-50000, -50000);
+        for (s32 Step = 0; Step < ReloadRelaxSteps; ++Step)
+        {
+            SimulateGraph(State, New, MinSide, MaxSide, NoMouseP, dt);
+            for (s32 NodeIndex = 0; NodeIndex < New->NodeCount; ++NodeIndex)
             {
-                vec2 Center = Node1->P + 0.5f*Diff;
-                vec2 X1 = Node1->P = Center - NodeRadius*NormalDiff;
-                vec2 X2 = Node2->P = Center + NodeRadius*NormalDiff;
+                if (OldNodeOf[NodeIndex] == -1) { continue; }
+                New->PX[NodeIndex] = HeldPX[NodeIndex];
+                New->PY[NodeIndex] = HeldPY[NodeIndex];
+                New->dPX[NodeIndex] = HelddPX[NodeIndex];
+                New->dPY[NodeIndex] = HelddPY[NodeIndex];
+            }
+        }
+    }
 
-                vec2 V1 = Node1->dP;
-                vec2 V2 = Node2->dP;
+    ResetIntegrator(State);
+    EndTemporaryMemory(ReloadMemory);
 
-                Node1->dP = V1 - SafeRatio0(Inner(V1 - V2, X1 - X2),LengthSq(X1 - X2))*(X1 - X2);
-                Node2->dP = V2 - SafeRatio0(Inner(V2 - V1, X2 - X1),LengthSq(X2 - X1))*(X2 - X1);
+    return MatchedCount;
+}
 
-                Diff = Node2->P - Node1->P;
-                NormalDiff = Normalize(Diff);
-            }
-        }
+/* Moves the nodes of the freshly loaded Graph to the finished layout the
+ * platform layer gave as Memory->Preset, and numbers them in its order.
+ * Returns false, leaving Graph alone, if the preset doesn't fit the graph. */
+internal bool
+ApplyPreset(memory_arena* Arena, app_memory* Memory, graph* Graph)
+{
+    s32 NodeCount = Graph->NodeCount;
+    if (!Memory->Preset || Memory->PresetCount != NodeCount) { return false; }
 
-        if (Node1->P.x - NodeRadius < MinSide.x) {
-            Node1->P.x = MinSide.x + NodeRadius;
-            Node1->dP.x = -Node1->dP.x;
-        }
-        else if (Node1->P.x + NodeRadius > MaxSide.x) {
-            Node1->P.x = MaxSide.x - NodeRadius;
-            Node1->dP.x = -Node1->dP.x;
-        }
+    temporary_memory PresetMemory = BeginTemporaryMemory(Arena);
+    node_id* OldNodeOf = PushArray(Arena, NodeCount, node_id);
+    bool* Placed = PushArray(Arena, NodeCount, bool);
+    memset(Placed, 0, NodeCount*sizeof(bool));
 
-        if (Node1->P.y - NodeRadius < MinSide.y) {
-            Node1->P.y = MinSide.y + NodeRadius;
-            Node1->dP.y = -Node1->dP.y;
+    bool Fits = true;
+    for (s32 NodeIndex = 0; Fits && NodeIndex < NodeCount; ++NodeIndex)
+    {
+        u32 Declared = Memory->Preset[NodeIndex].DeclarationIndex;
+        Fits = (Declared < (u32)NodeCount && !Placed[Declared]);
+        if (Fits)
+        {
+            Placed[Declared] = true;
+            OldNodeOf[NodeIndex] = (node_id)Declared;
         }
-        else if (Node1->P.y + NodeRadius > MaxSide.y) {
-            Node1->P.y = MaxSide.y - NodeRadius;
-            Node1->dP.y = -Node1->dP.y;
+    }
+
+    if (Fits)
+    {
+        // A freshly loaded graph is still numbered in declaration order.
+        // Renumbering sorts the edges, which changes the order they're drawn
+        // in, so a graph that was never renumbered is left as it is.
+        bool Unchanged = true;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            preset_node* Preset = Memory->Preset + NodeIndex;
+            SetNodeP(Graph, (node_id)Preset->DeclarationIndex, V2(Preset->X, Preset->Y));
+            Unchanged = Unchanged && (OldNodeOf[NodeIndex] == NodeIndex);
         }
+        if (!Unchanged) { RenumberNodes(Arena, Graph, OldNodeOf); }
+    }
+
+    EndTemporaryMemory(PresetMemory);
+    return Fits;
+}
+
+/* Exchanges the value at Target for Value, with a full memory barrier, and
+ * returns the value that was there. */
+inline u32
+AtomicExchange(u32 volatile* Target, u32 Value)
+{
+#if defined(_MSC_VER)
+    u32 Result = (u32)_InterlockedExchange((long volatile*)Target, (long)Value);
+#else
+    u32 Result = __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+#endif
+    return Result;
+}
+
+// Pipelined simulation: the number of position snapshots passed between the
+// simulation and drawing, the bit that marks the snapshot in
+// simulation_pipeline::Ready as not yet drawn
+#define PIPELINE_SNAPSHOT_COUNT 3
+#define PIPELINE_SNAPSHOT_FRESH 0x80000000u
+
+/* Positions of the nodes after one step, and the step's statistics. */
+struct simulation_snapshot
+{
+    f32* PX;
+    f32* PY;
+    simulation_stats Stats;
+};
+
+/* The simulation running on its own on a worker thread (see
+ * layout_settings::Pipelined). It steps a private copy of the app_state, like
+ * a component_layout_job, and after every step copies the positions into
+ * one of the snapshots. At any time one snapshot is being written, one is
+ * being drawn, and the third holds the latest finished step; the simulation
+ * and UpdateAndRender trade theirs for that one by swapping indices, so
+ * neither ever waits for the other. */
+struct simulation_pipeline
+{
+    bool Running;
+    // Set once the job has returned by itself, because every node was asleep
+    bool volatile Idle;
+    // Set once the job has returned by itself, because the nodes are due to
+    // be renumbered, which it can't do under drawing
+    bool volatile ReorderDue;
+    bool volatile StopRequested;
+
+    app_memory* Memory;
+    app_state JobState;
+    // Carved out of the top of State->TempArena while the job runs, so it
+    // grows with the graph like the scratch memory of a step on this thread
+    temporary_memory ArenaMemory;
+    memory_arena Arena;
+    graph* Graph;
+
+    // Written by UpdateAndRender every frame and read by the job every step
+    f32 volatile MinX, MinY;
+    f32 volatile MaxX, MaxY;
+    f32 volatile MouseX, MouseY;
+    f32 volatile dt;
+
+    // The snapshot arrays are sized to the graph whenever the job starts, at
+    // the bottom of Arena, and the job's TempArena takes the rest
+    simulation_snapshot Snapshots[PIPELINE_SNAPSHOT_COUNT];
+    // Only touched by the job
+    u32 WriteIndex;
+    // Only touched by UpdateAndRender
+    u32 DrawIndex;
+    // Index of the snapshot of the latest finished step, with
+    // PIPELINE_SNAPSHOT_FRESH set if UpdateAndRender hasn't taken it yet
+    u32 volatile Ready;
+};
+
+/* Copies the positions of the graph after Stats into the snapshot being
+ * written, and hands it over as the latest one. */
+internal void
+PublishSnapshot(simulation_pipeline* Pipeline, simulation_stats Stats)
+{
+    simulation_snapshot* Snapshot = Pipeline->Snapshots + Pipeline->WriteIndex;
+    s32 NodeCount = Pipeline->Graph->NodeCount;
+    memcpy(Snapshot->PX, Pipeline->Graph->PX, NodeCount*sizeof(f32));
+    memcpy(Snapshot->PY, Pipeline->Graph->PY, NodeCount*sizeof(f32));
+    Snapshot->Stats = Stats;
+
+    u32 Previous = AtomicExchange(&Pipeline->Ready, Pipeline->WriteIndex | PIPELINE_SNAPSHOT_FRESH);
+    Pipeline->WriteIndex = Previous & ~PIPELINE_SNAPSHOT_FRESH;
+}
+
+/* Returns the snapshot of the latest finished step, which stays untouched
+ * until the next call. */
+internal simulation_snapshot*
+TakeLatestSnapshot(simulation_pipeline* Pipeline)
+{
+    // Only this side clears the fresh bit, so it can't go away in between
+    if (Pipeline->Ready & PIPELINE_SNAPSHOT_FRESH)
+    {
+        u32 Latest = AtomicExchange(&Pipeline->Ready, Pipeline->DrawIndex);
+        Pipeline->DrawIndex = Latest & ~PIPELINE_SNAPSHOT_FRESH;
+    }
+    return Pipeline->Snapshots + Pipeline->DrawIndex;
+}
+
+internal
+PLATFORM_WORK_QUEUE_CALLBACK(PipelinedSimulationJob)
+{
+    simulation_pipeline* Pipeline = (simulation_pipeline*)Data;
+
+    // Give up once the whole graph has stayed asleep for a full round of
+    // checks, and leave it to UpdateAndRender to notice it waking up
+    u32 AsleepSteps = 0;
+    layout_settings* Settings = &Pipeline->JobState.Settings;
+    bool ReorderDue = false;
+    while (!Pipeline->StopRequested && !Pipeline->Memory->StopSimulation &&
+           AsleepSteps < SleepCheckInterval && !ReorderDue)
+    {
+        vec2 MinSide = V2(Pipeline->MinX, Pipeline->MinY);
+        vec2 MaxSide = V2(Pipeline->MaxX, Pipeline->MaxY);
+        vec2 MouseP = V2(Pipeline->MouseX, Pipeline->MouseY);
+        simulation_stats Stats = SimulateGraph(&Pipeline->JobState, Pipeline->Graph,
+                                               MinSide, MaxSide, MouseP, Pipeline->dt);
+        PublishSnapshot(Pipeline, Stats);
+        AsleepSteps = (Stats.AwakeCount == 0) ? AsleepSteps + 1 : 0;
+        // On the same steps as UpdateAndRender renumbers an unpipelined graph
+        ReorderDue = (Settings->NodeOrder == NODE_ORDER_HILBERT && Settings->ReorderInterval > 0 &&
+                      Pipeline->Graph->StepCount % Settings->ReorderInterval == 0);
+    }
+    Pipeline->ReorderDue = ReorderDue;
+    Pipeline->Idle = !ReorderDue;
+}
+
+/* Passes the current view and mouse on to the pipelined simulation. */
+internal void
+SteerPipeline(simulation_pipeline* Pipeline, vec2 MinSide, vec2 MaxSide, vec2 MouseP, f32 dt)
+{
+    Pipeline->MinX = MinSide.x;
+    Pipeline->MinY = MinSide.y;
+    Pipeline->MaxX = MaxSide.x;
+    Pipeline->MaxY = MaxSide.y;
+    Pipeline->MouseX = MouseP.x;
+    Pipeline->MouseY = MouseP.y;
+    Pipeline->dt = dt;
+}
+
+/* Returns whether the settings SimulateGraph reads differ between A and B. */
+internal bool
+SimulationSettingsChanged(layout_settings* A, layout_settings* B)
+{
+    bool Result = (A->RepulsionMode != B->RepulsionMode ||
+                   A->BarnesHutTheta != B->BarnesHutTheta ||
+                   A->SIMDLevel != B->SIMDLevel ||
+                   A->Integrator != B->Integrator ||
+                   A->Sleeping != B->Sleeping);
+    return Result;
+}
+
+/* Stops the pipelined simulation, if it is running, after the step it is on,
+ * and gives the simulation state of the graph back to State. */
+internal void
+StopPipeline(app_state* State)
+{
+    simulation_pipeline* Pipeline = State->Pipeline;
+    if (!Pipeline->Running) { return; }
+
+    Pipeline->StopRequested = true;
+    State->CompleteAllWork(State->WorkQueue);
+    State->Integrator = Pipeline->JobState.Integrator;
+    EndTemporaryMemory(Pipeline->ArenaMemory);
+    Pipeline->Running = false;
+}
+
+/* Starts simulating State's graph continuously on the work queue, from a
+ * snapshot of where it is now. */
+internal void
+StartPipeline(app_state* State, app_memory* Memory, simulation_stats Stats)
+{
+    simulation_pipeline* Pipeline = State->Pipeline;
+    assert(!Pipeline->Running);
+
+    Pipeline->Memory = Memory;
+    Pipeline->Graph = State->Graph;
+    Pipeline->JobState = *State;
+    Pipeline->JobState.WorkQueue = NULL;
+    Pipeline->Idle = false;
+    Pipeline->ReorderDue = false;
+    Pipeline->StopRequested = false;
+
+    // Half of what's left leaves this thread the same room for its own
+    // scratch memory while the job runs
+    Pipeline->ArenaMemory = BeginTemporaryMemory(&State->TempArena);
+    memory_index ArenaSize = GetArenaSizeRemaining(&State->TempArena) / 2;
+    InitializeArena(&Pipeline->Arena, ArenaSize, PushSize(&State->TempArena, ArenaSize));
+    for (s32 SnapshotIndex = 0; SnapshotIndex < PIPELINE_SNAPSHOT_COUNT; ++SnapshotIndex)
+    {
+        simulation_snapshot* Snapshot = Pipeline->Snapshots + SnapshotIndex;
+        Snapshot->PX = PushArray(&Pipeline->Arena, State->Graph->NodeCount, f32);
+        Snapshot->PY = PushArray(&Pipeline->Arena, State->Graph->NodeCount, f32);
     }
+    Pipeline->JobState.TempArena = Pipeline->Arena;
+
+    Pipeline->DrawIndex = 0;
+    Pipeline->WriteIndex = 1;
+    Pipeline->Ready = 2;
+    simulation_snapshot* Snapshot = Pipeline->Snapshots + Pipeline->DrawIndex;
+    memcpy(Snapshot->PX, State->Graph->PX, State->Graph->NodeCount*sizeof(f32));
+    memcpy(Snapshot->PY, State->Graph->PY, State->Graph->NodeCount*sizeof(f32));
+    Snapshot->Stats = Stats;
+
+    State->AddWorkEntry(State->WorkQueue, PipelinedSimulationJob, Pipeline);
+    Pipeline->Running = true;
 }
 
+/* Draws Graph with its nodes at the positions in PX and PY. */
 internal void
-DrawGraph(app_state* State, bitmap* Target, rgba_color BGColor, graph* Graph)
+DrawGraph(app_state* State, bitmap* Target, rgba_color BGColor, graph* Graph, f32* PX, f32* PY)
 {
     BGColor;
+    BEGIN_PROFILE(DRAW_GRAPH);
     f32 LineWidth = 2.0f / State->PixelsPerUnit;
-    for (s16 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
     {
         graph_edge* Edge = Graph->Edges + EdgeIndex;
-        graph_node* StartNode = Graph->Nodes + Edge->Source;
-        graph_node* EndNode = Graph->Nodes + Edge->Dest;
+        vec2 StartP = V2(PX[Edge->Source], PY[Edge->Source]);
+        vec2 EndP = V2(PX[Edge->Dest], PY[Edge->Dest]);
 
-        vec2 Diff = EndNode->P - StartNode->P;
-        vec2 P1 = StartNode->P + NodeRadius * Normalize(Diff); 
-        vec2 P2 = EndNode->P - NodeRadius * Normalize(Diff); 
+        vec2 Diff = EndP - StartP;
+        vec2 P1 = StartP + NodeRadius * Normalize(Diff); 
+        vec2 P2 = EndP - NodeRadius * Normalize(Diff); 
 
-        if (StartNode->Type == NODE_PRESTART) {
-            P1 = EndNode->P - NodeRadius * 3 * Normalize(Diff);
+        if (GetNodeType(Graph, Edge->Source) == NODE_PRESTART) {
+            P1 = EndP - NodeRadius * 3 * Normalize(Diff);
         }
 
         vec2 LabelP;
-        if (StartNode->ID == EndNode->ID)
+        if (Edge->Source == Edge->Dest)
         {
-            graph_node* ControlNode = Graph->Nodes + Edge->Control;
-            vec2 ControlP = ControlNode->P;
-            vec2 NodeDir = Normalize(ControlP - StartNode->P);
+            vec2 ControlP = V2(PX[Edge->Control], PY[Edge->Control]);
+            vec2 NodeDir = Normalize(ControlP - StartP);
             f32 ControlDist = 4.0f;
-            bezier_cubic<1> EdgeCurve = CurveCubic<1>(StartNode->P, StartNode->P + (0.5f*ControlDist)*NodeDir + (0.5f*ControlDist)*Perp(NodeDir), 
-                                                                    StartNode->P + (0.5f*ControlDist)*NodeDir - (0.5f*ControlDist)*Perp(NodeDir), StartNode->P);
+            bezier_cubic<1> EdgeCurve = CurveCubic<1>(StartP, StartP + (0.5f*ControlDist)*NodeDir + (0.5f*ControlDist)*Perp(NodeDir), 
+                                                              StartP + (0.5f*ControlDist)*NodeDir - (0.5f*ControlDist)*Perp(NodeDir), StartP);
             DrawBezierCubicSegment(State, Target, EdgeCurve.Segments[0], 
                                    LineWidth, V4(0,0,0,1), 15, true);
 
-            LabelP = StartNode->P + 0.45f*ControlDist * NodeDir;
+            LabelP = StartP + 0.45f*ControlDist * NodeDir;
         }
         else {
             DrawLinearArrow(State, Target, P1, P2, 1.5f*LineWidth, 4.0f*LineWidth, V4(0,0,0,1));
 
-            LabelP = StartNode->P + 0.5f*Diff + 0.3f*LeftNormal(Diff);
+            LabelP = StartP + 0.5f*Diff + 0.3f*LeftNormal(Diff);
         }
 
         if (Edge->Transition.Start != NULL)
@@ -343,43 +2083,46 @@ DrawGraph(app_state* State, bitmap* Target, rgba_color BGColor, graph* Graph)
         }
     }
 
-    for (s16 NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+    for (s32 NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
     {
         graph_node* Node = Graph->Nodes + NodeIndex;
-        switch (Node->Type)
+        node_type Type = GetNodeType(Graph, NodeIndex);
+        vec2 NodeP = V2(PX[NodeIndex], PY[NodeIndex]);
+        switch (Type)
         {
             case NODE_START:
             case NODE_REGULAR:
             {
-                DrawOval(State, Target, Node->P, V2(NodeRadius,NodeRadius), V4(0,0,0,1));
-                DrawOval(State, Target, Node->P, V2(NodeRadius-LineWidth,NodeRadius-LineWidth), V4(1,1,1,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius,NodeRadius), V4(0,0,0,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius-LineWidth,NodeRadius-LineWidth), V4(1,1,1,1));
             } break;
 
             case NODE_FINAL:
             {
-                DrawOval(State, Target, Node->P, V2(NodeRadius,NodeRadius), V4(0,0,0,1));
-                DrawOval(State, Target, Node->P, V2(NodeRadius-LineWidth,NodeRadius-LineWidth), V4(1,1,1,1));
-                DrawOval(State, Target, Node->P, V2(NodeRadius-2*LineWidth,NodeRadius-2*LineWidth), V4(0,0,0,1));
-                DrawOval(State, Target, Node->P, V2(NodeRadius-3*LineWidth,NodeRadius-3*LineWidth), V4(1,1,1,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius,NodeRadius), V4(0,0,0,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius-LineWidth,NodeRadius-LineWidth), V4(1,1,1,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius-2*LineWidth,NodeRadius-2*LineWidth), V4(0,0,0,1));
+                DrawOval(State, Target, NodeP, V2(NodeRadius-3*LineWidth,NodeRadius-3*LineWidth), V4(1,1,1,1));
             } break;
 
             case NODE_PRESTART:
             case NODE_CONTROL:
+            default:
             {
 #if 0
-                DrawOval(State, Target, Node->P, V2(0.2f,0.2f), V4(0,0,0,0.4f));
+                DrawOval(State, Target, NodeP, V2(0.2f,0.2f), V4(0,0,0,0.4f));
 #endif
             } break;
         }
 
-        if (Node->Type != NODE_PRESTART && Node->Name.Start != NULL)
+        if (Type != NODE_PRESTART && Node->Name.Start != NULL)
         {
             f32 Scale = 0.42f;
-            if (Node->Type == NODE_FINAL) {
+            if (Type == NODE_FINAL) {
                 Scale = 0.33f;
             }
             DrawWorldString(State, Target, Node->Name.Length, Node->Name.Start,
-                               Node->P, Scale, V4(0,0,0,1));
+                               NodeP, Scale, V4(0,0,0,1));
         }
     }
 
@@ -387,14 +2130,31 @@ DrawGraph(app_state* State, bitmap* Target, rgba_color BGColor, graph* Graph)
     DrawString(State, Target, 8, "GraphGen",
                V2(0.0f, Target->Height/2 - 27.0f), 27.0f, V4(0,0,0,1));
 #endif
+    END_PROFILE(DRAW_GRAPH);
 }
 
 extern "C"
 UPDATE_AND_RENDER(UpdateAndRender)
 {
     if (!Memory->IsInitialized) { return; }
+#if GRAPHGEN_PROFILE
+    GlobalProfile = Memory->Profile;
+#endif
 
     app_state* State = (app_state*)Memory->PermanentBlock;
+    State->Settings = Memory->Settings;
+    State->WorkQueue = Memory->WorkQueue;
+    State->AddWorkEntry = Memory->AddWorkEntry;
+    State->CompleteAllWork = Memory->CompleteAllWork;
+    if (State->SnapshotMemory.Arena)
+    {
+        EndTemporaryMemory(State->SnapshotMemory);
+        State->SnapshotMemory.Arena = NULL;
+        Memory->Snapshot = NULL;
+        Memory->SnapshotSize = 0;
+    }
+    bool GraphLoaded = false;
+    initial_placement Placement = State->Settings.Placement;
     if (!State->IsInitialized) 
     {
         InitializeArena(&State->GraphArena, 
@@ -409,28 +2169,65 @@ UPDATE_AND_RENDER(UpdateAndRender)
                        Memory->TTFFile,
                        stbtt_GetFontOffsetForIndex(Memory->TTFFile, 0));
 
-        State->PixelsPerUnit = 40;
+        State->PixelsPerUnit = DefaultPixelsPerUnit;
 
         State->Graph = PushStruct(&State->GraphArena, graph);
+        ResetIntegrator(State);
 
-        memset(State->Graph, 0, sizeof(graph));
+        State->Pipeline = PushStruct(&State->GraphArena, simulation_pipeline);
+        memset(State->Pipeline, 0, sizeof(simulation_pipeline));
 
-        for (int NFAFileIndex = 0; NFAFileIndex < Memory->NFAFileCount; ++NFAFileIndex)
+        State->Random = RandomSeries(State->Settings.Seed);
+        State->GraphMemory = BeginTemporaryMemory(&State->GraphArena);
+        ClearGraph(State);
+
+        bool Resumed = (Memory->ResumeSnapshot &&
+                        ReadSnapshot(Memory->ResumeSnapshot, Memory->ResumeSnapshotSize,
+                                     State->Graph, &State->Integrator, &Memory->Settle));
+        if (!Resumed)
         {
-            nfa_parse::GenerateGraph(Memory->NFAFiles[NFAFileIndex], State->Graph);
+            for (int NFAFileIndex = 0; NFAFileIndex < Memory->NFAFileCount; ++NFAFileIndex)
+            {
+                nfa_parse::GenerateGraph(Memory->NFAFiles[NFAFileIndex], State->Graph);
+            }
+            // The platform layer may already have the finished layout
+            Memory->PresetApplied = ApplyPreset(&State->TempArena, Memory, State->Graph);
+            GraphLoaded = !Memory->PresetApplied;
         }
 
         State->IsInitialized = true;
     }
 
-    if (Input->ResetButton.IsPressed && !Input->ResetButton.WasPressed)
+    bool ResetPressed = (Input->ResetButton.IsPressed && !Input->ResetButton.WasPressed);
+    bool ReloadPressed = (Input->ReloadButton.IsPressed && !Input->ReloadButton.WasPressed);
+    bool Layered = (State->Settings.Engine == LAYOUT_LAYERED);
+
+    // The pipelined simulation owns the simulation state of the graph while
+    // it runs, so it has to stop before anything else touches the graph or
+    // changes how it is simulated. It is restarted after the next step.
+    simulation_pipeline* Pipeline = State->Pipeline;
+    bool Pipelined = (State->Settings.Pipelined && State->WorkQueue && !Layered);
+    if (Pipeline->Running &&
+        (!Pipelined || Pipeline->Idle || Pipeline->ReorderDue || ResetPressed || ReloadPressed ||
+         Input->MeasureLayout || Input->SkipSimulation || Input->SaveSnapshot ||
+         SimulationSettingsChanged(&Pipeline->JobState.Settings, &State->Settings)))
+    {
+        StopPipeline(State);
+    }
+
+    if (ResetPressed)
     {
-        memset(State->Graph, 0, sizeof(graph));
+        ClearGraph(State);
+        ResetIntegrator(State);
 
         for (int NFAFileIndex = 0; NFAFileIndex < Memory->NFAFileCount; ++NFAFileIndex)
         {
             nfa_parse::GenerateGraph(Memory->NFAFiles[NFAFileIndex], State->Graph);
         }
+        GraphLoaded = true;
+        // The structured placements would only reproduce the layout being
+        // reset, so resetting always rerolls
+        Placement = PLACEMENT_RANDOM;
     }
 
     State->PixelsPerUnit = State->PixelsPerUnit * powf(1.1f, Input->Mouse.ScrollDelta);
@@ -438,18 +2235,189 @@ UPDATE_AND_RENDER(UpdateAndRender)
     vec2 VirtualMouseP = Input->Mouse.P/State->PixelsPerUnit;
     if (!Input->Mouse.Buttons[0].IsPressed) { VirtualMouseP = V2(-50000, -50000); }
 
-    SimulateGraph(State->Graph, 
-                  -0.5f*Buffer->Dim/State->PixelsPerUnit, 
-                  0.5f*Buffer->Dim/State->PixelsPerUnit, 
-                  VirtualMouseP,
-                  Input->dt);
+    vec2 MinSide = -0.5f*Buffer->Dim/State->PixelsPerUnit;
+    vec2 MaxSide = 0.5f*Buffer->Dim/State->PixelsPerUnit;
+
+    if (ReloadPressed && !GraphLoaded && Layered)
+    {
+        // The layered layout of the new graph doesn't depend on the old one
+        ClearGraph(State);
+        for (int NFAFileIndex = 0; NFAFileIndex < Memory->NFAFileCount; ++NFAFileIndex)
+        {
+            nfa_parse::GenerateGraph(Memory->NFAFiles[NFAFileIndex], State->Graph);
+        }
+        GraphLoaded = true;
+    }
+    else if (ReloadPressed && !GraphLoaded)
+    {
+        // A reload that shares nothing with the old graph is a fresh load
+        GraphLoaded = (ReloadGraph(State, Memory, MinSide, MaxSide, Input->dt) == 0);
+    }
+
+    if (GraphLoaded && Layered)
+    {
+        LayeredLayout(&State->TempArena, State->Graph, MinSide, MaxSide);
+    }
+    else if (GraphLoaded &&
+             !(State->Settings.SeparateComponents &&
+               ComponentLayout(State, State->Graph, Placement, MinSide, MaxSide, Input->dt)))
+    {
+        PlaceNodes(&State->TempArena, State->Graph, Placement, MinSide, MaxSide);
+        if (State->Settings.Multilevel)
+        {
+            MultilevelLayout(State, State->Graph, MinSide, MaxSide, Input->dt);
+        }
+    }
+
+    // A reload regenerates the graph in declaration order, even when it keeps
+    // the layout
+    node_order NodeOrder = State->Settings.NodeOrder;
+    bool Renumber = (GraphLoaded || ReloadPressed);
+    if (NodeOrder == NODE_ORDER_HILBERT && !Layered && State->Settings.ReorderInterval > 0 &&
+        !Pipeline->Running && !Input->SkipSimulation)
+    {
+        Renumber = Renumber || (State->Graph->StepCount % State->Settings.ReorderInterval == 0);
+    }
+    if (Renumber && NodeOrder != NODE_ORDER_DECLARATION)
+    {
+        ReorderNodes(&State->TempArena, State->Graph, NodeOrder);
+    }
+
+    f32* DrawPX = State->Graph->PX;
+    f32* DrawPY = State->Graph->PY;
+    SteerPipeline(Pipeline, MinSide, MaxSide, VirtualMouseP, Input->dt);
+    if (Layered || Input->SkipSimulation)
+    {
+        simulation_stats Stats = {};
+        Stats.NodeCount = State->Graph->NodeCount;
+        Stats.Timestep = Input->dt;
+        Memory->Stats = Stats;
+    }
+    else if (!Pipeline->Running)
+    {
+        Memory->Stats = SimulateGraph(State, State->Graph, MinSide, MaxSide, VirtualMouseP, Input->dt);
+
+        // A graph that is fast asleep is cheaper to step here once a frame
+        if (Pipelined && !Input->MeasureLayout && !Input->SaveSnapshot &&
+            Memory->Stats.AwakeCount > 0)
+        {
+            StartPipeline(State, Memory, Memory->Stats);
+        }
+    }
+
+    if (Pipeline->Running)
+    {
+        simulation_snapshot* Snapshot = TakeLatestSnapshot(Pipeline);
+        Memory->Stats = Snapshot->Stats;
+        DrawPX = Snapshot->PX;
+        DrawPY = Snapshot->PY;
+    }
+
+    if (Input->MeasureLayout)
+    {
+        Memory->Metrics = MeasureLayout(&State->TempArena, State->Graph, NodeRadius);
+    }
+    Memory->Graph = State->Graph;
 
     if (!Input->SimulateOnly)
     {
         ClearBitmap(Buffer, V4(1,1,1,1));
-        DrawGraph(State, Buffer, V4(1,1,1,0), State->Graph);
+        DrawGraph(State, Buffer, V4(1,1,1,0), State->Graph, DrawPX, DrawPY);
 
         DrawOval(State, Buffer, V2(Input->Mouse.P.X, Input->Mouse.P.Y) / State->PixelsPerUnit,
                  V2(0.2f, 0.2f), V4(0,0,0,0.5f));
     }
+
+    if (Input->SaveSnapshot)
+    {
+        // Kept until the next call, for the platform layer to write out
+        State->SnapshotMemory = BeginTemporaryMemory(&State->TempArena);
+        Memory->Snapshot = WriteSnapshot(&State->TempArena, State->Graph, &State->Integrator,
+                                         &Memory->Settle, &Memory->SnapshotSize);
+    }
+}
+
+extern "C"
+LAYOUT_BATCH(LayoutBatch)
+{
+    if (!Memory->IsInitialized) { return; }
+#if GRAPHGEN_PROFILE
+    GlobalProfile = Memory->Profile;
+#endif
+
+    app_state State = {};
+    InitializeArena(&State.TempArena, Memory->TemporarySize, Memory->TemporaryBlock);
+    State.Settings = Memory->Settings;
+    State.WorkQueue = Memory->WorkQueue;
+    State.AddWorkEntry = Memory->AddWorkEntry;
+    State.CompleteAllWork = Memory->CompleteAllWork;
+
+    batch_params Params = {};
+    // The kernels visit each pair once, as in ApplyExactRepulsion
+    Params.RepulsionK = 2.0f*RepulsionK;
+    Params.LightScale = 0.3f;
+    Params.SideRepulsionK = SideRepulsionK;
+    Params.AttractionK = AttractionK;
+    Params.DragK = DragK;
+    Params.NodeRadius = NodeRadius;
+    Params.MaxSide = 0.5f*V2((f32)Dim.X, (f32)Dim.Y)/DefaultPixelsPerUnit;
+    Params.MinSide = -Params.MaxSide;
+    Params.dt = dt;
+
+    // Every graph gets its own random numbers, in the order they were given,
+    // so that a graph lays out the same whatever else is in the batch
+    random_series Random = RandomSeries(State.Settings.Seed);
+    batch_layout** Sorted = PushArray(&State.TempArena, LayoutCount, batch_layout*);
+    s32 SortedCount = 0;
+    for (s32 LayoutIndex = 0; LayoutIndex < LayoutCount; ++LayoutIndex)
+    {
+        batch_layout* Layout = Layouts + LayoutIndex;
+        Layout->Graph = PushStruct(&State.TempArena, graph);
+        Layout->StepCount = 0;
+        InitializeGraph(Layout->Graph, &State.TempArena);
+        Layout->Graph->Random = RandomSplit(&Random);
+
+        nfa_parse::GenerateGraph(Layout->NFAFile, Layout->Graph);
+        if (Layout->Graph->NodeCount == 0) { continue; }
+        if (State.Settings.Engine == LAYOUT_LAYERED)
+        {
+            LayeredLayout(&State.TempArena, Layout->Graph, Params.MinSide, Params.MaxSide);
+            continue;
+        }
+        PlaceNodes(&State.TempArena, Layout->Graph, State.Settings.Placement, Params.MinSide, Params.MaxSide);
+
+        // Largest first (insertion sort, ties keep their order), so that the
+        // graphs sharing a batch are about the same size
+        s32 Position = SortedCount++;
+        while (Position > 0 && Sorted[Position - 1]->Graph->NodeCount < Layout->Graph->NodeCount)
+        {
+            Sorted[Position] = Sorted[Position - 1];
+            --Position;
+        }
+        Sorted[Position] = Layout;
+    }
+    if (SortedCount == 0) { return; }
+
+    // Each job takes every JobCount'th graph, so they all get a similar mix of
+    // sizes, and enough graphs to keep refilling their lanes for a while
+    s32 JobCount = Min(MAX_SIMULATION_JOBS, Max(SortedCount / (4*BATCH_LANES), 1));
+    batch_layout_job* Jobs = PushArray(&State.TempArena, JobCount, batch_layout_job);
+    for (s32 JobIndex = 0; JobIndex < JobCount; ++JobIndex)
+    {
+        batch_layout_job* Job = Jobs + JobIndex;
+        Job->Params = &Params;
+        Job->Criteria = &Criteria;
+        Job->LayoutCount = (SortedCount - JobIndex + JobCount - 1) / JobCount;
+        Job->Layouts = PushArray(&State.TempArena, Job->LayoutCount, batch_layout*);
+
+        s32 MostEdges = 0;
+        for (s32 LayoutIndex = 0; LayoutIndex < Job->LayoutCount; ++LayoutIndex)
+        {
+            Job->Layouts[LayoutIndex] = Sorted[JobIndex + LayoutIndex*JobCount];
+            MostEdges = Max(MostEdges, (s32)Job->Layouts[LayoutIndex]->Graph->EdgeCount);
+        }
+        Job->Batch = MakeGraphBatch(&State.TempArena, Job->Layouts[0]->Graph->NodeCount, MostEdges);
+    }
+
+    RunJobs(&State, BatchLayoutJob, Jobs, sizeof(batch_layout_job), JobCount);
 }
@@ -14,6 +14,9 @@
 // Purpose: memory management structures
 #include "memory_arena.hpp"
 
+// Purpose: random_series
+#include "random.hpp"
+
 // Purpose: font-rendering related structures
 #include "stb_truetype.h"
 
@@ -24,6 +27,310 @@ struct app_state;
 // Purpose: bitmap structure
 #include "render.h"
 
+// Purpose: simd_level enumeration
+#include "repulsion.h"
+
+// Purpose: profile_counter and the profile zones
+#include "profile.h"
+
+/* Enumeration describing the algorithms available for computing the
+ * node-node repulsion in the simulation. */
+enum repulsion_mode
+{
+    // Every pair of nodes is evaluated directly. Exact, but O(n^2) per step.
+    REPULSION_EXACT,
+    // Nodes are bucketed into a quadtree each step and distant groups of nodes
+    // are treated as a single body at their center of mass. O(n log n) per
+    // step, with accuracy controlled by BarnesHutTheta.
+    REPULSION_BARNES_HUT,
+};
+
+/* Enumeration describing the ways of advancing the node positions and
+ * velocities by one simulation step. */
+enum integrator_type
+{
+    // Semi-implicit Euler with a fixed timestep (the platform's dt) and
+    // velocity drag applied as a force.
+    INTEGRATOR_EULER,
+    // Velocity Verlet with exact exponential drag, whose timestep adapts to
+    // the largest force on any node and to whether the layout is still
+    // releasing energy.
+    INTEGRATOR_ADAPTIVE_VERLET,
+};
+
+/* Enumeration describing where the nodes of a freshly loaded graph start out
+ * before the simulation takes over. */
+enum initial_placement
+{
+    // Uniformly random positions around the origin, as given by AddNode
+    PLACEMENT_RANDOM,
+    // Columns by breadth-first distance from the start states
+    PLACEMENT_BFS,
+    // Coordinates from the two leading nontrivial eigenvectors of the
+    // degree-normalized adjacency matrix
+    PLACEMENT_SPECTRAL,
+    // Stress majorization on the shortest-path distances between nodes,
+    // starting from PLACEMENT_BFS. Already close to a finished layout, so the
+    // simulation only has to settle the details. Graphs too big for it keep
+    // the PLACEMENT_BFS positions.
+    PLACEMENT_STRESS,
+};
+
+/* Enumeration describing the ways of laying out a graph. */
+enum layout_engine
+{
+    // The force simulation, starting from the initial placement
+    LAYOUT_FORCE,
+    // A layered left-to-right layout from the start states, computed in one
+    // go whenever the graph is loaded. Nothing is simulated afterwards, so
+    // the nodes can't be dragged around, and the settings other than Engine
+    // don't apply.
+    LAYOUT_LAYERED,
+};
+
+/* Enumeration describing the orders the nodes of a graph can be numbered in
+ * (see reorder.h). Only affects how fast the layout is simulated and drawn,
+ * not how good it is, though renumbering the nodes changes the order forces
+ * are added up in, and so the exact layout that comes out. */
+enum node_order
+{
+    // The order the NFA files declare the states in
+    NODE_ORDER_DECLARATION,
+    // Reverse Cuthill-McKee: breadth first through the transitions, so that
+    // the two ends of most transitions get nearby numbers. Only depends on
+    // the transitions, so it's applied once when the graph is loaded.
+    NODE_ORDER_RCM,
+    // Along a Hilbert curve through the current positions of the nodes, so
+    // that nodes near each other get nearby numbers. Applied when the graph
+    // is loaded and then every ReorderInterval steps as the layout moves.
+    NODE_ORDER_HILBERT,
+};
+
+/* Structure holding the platform-selectable parameters of the layout
+ * algorithms. A platform layer should start from DefaultLayoutSettings() and
+ * override what it needs, since zero is not a sensible value for every field. */
+struct layout_settings
+{
+    // How graphs are laid out in the first place
+    layout_engine Engine;
+    // Algorithm used for the node-node repulsion pass
+    repulsion_mode RepulsionMode;
+    // Opening angle for the Barnes-Hut approximation. A quadtree cell of width
+    // s whose center of mass lies at distance d from a node is approximated
+    // as a single body when s/d < BarnesHutTheta. Smaller is more accurate and
+    // slower; 0 opens every cell and so degenerates to the exact sum.
+    f32 BarnesHutTheta;
+    // Instruction set used by the exact repulsion kernel. SIMD_AUTO picks the
+    // widest one the CPU supports.
+    simd_level SIMDLevel;
+    // Integrator used to advance the simulation each step
+    integrator_type Integrator;
+    // Placement of the nodes of freshly loaded graphs. Everything but
+    // PLACEMENT_RANDOM is deterministic, so a graph always lays out the same.
+    // Resetting the graph always places it randomly.
+    initial_placement Placement;
+    // Seed for everything random about the layout: the random placement, and
+    // the jitter that pulls apart nodes placed on top of each other. The same
+    // graph, settings and seed always give the same layout, bit for bit,
+    // however many threads the platform uses (as long as the repulsion kernel,
+    // see SIMDLevel, is the same too). Resetting the graph carries on to new
+    // random numbers, so it still rerolls the layout.
+    u32 Seed;
+    // Whether nodes that have come to rest may fall asleep. Sleeping nodes
+    // still repel the others, but are neither moved nor have the forces on
+    // them computed until something nearby moves or the mouse pushes them.
+    bool Sleeping;
+    // Whether to lay out each connected component of a freshly loaded graph
+    // (such as several NFAs loaded together) on its own, in parallel, and
+    // then pack the results side by side, instead of laying out everything
+    // at once.
+    bool SeparateComponents;
+    // Whether to start freshly loaded graphs off with a multilevel layout:
+    // the graph is repeatedly coarsened, and the coarsened graphs are laid
+    // out from the smallest up, each starting from the one before.
+    bool Multilevel;
+    // Order to number the nodes of the graph in, and for NODE_ORDER_HILBERT
+    // how many steps to simulate between renumberings (0 for only when the
+    // graph is loaded)
+    node_order NodeOrder;
+    s32 ReorderInterval;
+    // Whether to run the simulation continuously on one of the platform's
+    // worker threads, while UpdateAndRender only draws the most recently
+    // finished step, so that drawing and simulating overlap and the
+    // simulation can take as many steps per frame as it gets through. Each
+    // step then runs on that one thread. Once every node is asleep it goes
+    // back to one step per call until something wakes up, and pauses for a
+    // call whenever NODE_ORDER_HILBERT renumbering comes due. Only applies
+    // with LAYOUT_FORCE and a WorkQueue; otherwise every call to
+    // UpdateAndRender simulates one step.
+    bool Pipelined;
+};
+
+/* Returns the layout_settings that reproduce the standard behaviour of the
+ * simulation. */
+inline layout_settings
+DefaultLayoutSettings()
+{
+    layout_settings Result = {};
+    Result.Engine = LAYOUT_FORCE;
+    Result.RepulsionMode = REPULSION_EXACT;
+    Result.BarnesHutTheta = 0.8f;
+    Result.SIMDLevel = SIMD_AUTO;
+    Result.Integrator = INTEGRATOR_EULER;
+    Result.Placement = PLACEMENT_BFS;
+    Result.Seed = 0;
+    Result.Sleeping = true;
+    Result.SeparateComponents = true;
+    Result.Multilevel = false;
+    Result.NodeOrder = NODE_ORDER_DECLARATION;
+    Result.ReorderInterval = 100;
+    Result.Pipelined = false;
+    return Result;
+}
+
+/* Summary of one simulation step, reported back to the platform layer so it
+ * can tell when the layout has settled. */
+struct simulation_stats
+{
+    // Number of nodes in the simulated graph
+    s32 NodeCount;
+    // Total kinetic energy of the nodes after the step, counting every node as
+    // unit mass
+    f32 KineticEnergy;
+    // Largest distance any single node moved during the step, including any
+    // correction from collisions and the screen edges
+    f32 MaxDisplacement;
+    // Timestep the step was actually taken with, which the adaptive
+    // integrator may have chosen to be different from the requested dt
+    f32 Timestep;
+    // Number of nodes still awake after the step. With LAYOUT_LAYERED (or
+    // app_input::SkipSimulation) there is no simulation, and every step
+    // reports a layout at rest.
+    s32 AwakeCount;
+};
+
+/* Objective measures of how readable a layout is as drawn, for comparing
+ * layouts without looking at them. See metrics.h for how they are computed. */
+struct layout_metrics
+{
+    // Number of pairs of transition arrows that cross each other
+    s32 EdgeCrossings;
+    // Number of pairs of states whose circles overlap
+    s32 NodeOverlaps;
+    // Number of pairs of transition labels that overlap each other, plus the
+    // number of labels overlapping a state
+    s32 LabelOverlaps;
+    // Mean and variance of the lengths of the transitions between different
+    // states, from center to center
+    f32 EdgeLengthMean;
+    f32 EdgeLengthVariance;
+    // Smallest angle between two transitions at the same state, in radians
+    // (2 pi if no state has more than one)
+    f32 MinAngle;
+    // Average over the states with more than one transition of the smallest
+    // angle between them, as a fraction of the most it could be (2 pi over
+    // the number of transitions). 1 when every state spreads its transitions
+    // evenly.
+    f32 AngularResolution;
+};
+
+/* The tests a noninteractive platform layer applies to the simulation_stats
+ * of each step to decide when a layout is finished. */
+struct settle_criteria
+{
+    // Most steps to simulate
+    s32 MaxIterations;
+    // Kinetic energy per node below which the layout counts as settled (as
+    // long as no node moved faster than MaxSpeed), or 0 to never settle
+    f32 EnergyPerNode;
+    f32 MaxSpeed;
+    // Number of steps the energy may go without improving by at least
+    // StallImprovement (a fraction of its best value so far) before the layout
+    // counts as stalled, or 0 to never stall. Some graphs jitter forever.
+    s32 StallWindow;
+    f32 StallImprovement;
+};
+
+/* Progress of one layout towards its settle_criteria. Start from zero. */
+struct settle_state
+{
+    s32 Steps;
+    f32 PeakEnergy;
+    f32 BestEnergy;
+    s32 BestStep;
+    // Set by the platform layer once the layout is done with and drawn, so
+    // that a snapshot of it (see app_memory::Snapshot) can be drawn again
+    // later without simulating any further
+    bool Finished;
+};
+
+/* Records one more step of a layout, and returns whether the layout has now
+ * either settled or stalled. Doesn't look at MaxIterations. */
+inline bool
+LayoutSettled(settle_state* Settle, settle_criteria* Criteria, simulation_stats Stats)
+{
+    s32 Step = Settle->Steps++;
+    f32 EnergyPerNode = Stats.KineticEnergy / (f32)Max(Stats.NodeCount, 1);
+    if (EnergyPerNode < Criteria->EnergyPerNode &&
+        Stats.MaxDisplacement < Criteria->MaxSpeed*Stats.Timestep)
+    {
+        return true;
+    }
+
+    // Nodes start at rest, so the energy climbs before it falls; only start
+    // looking for a stall once it has peaked.
+    if (EnergyPerNode > Settle->PeakEnergy)
+    {
+        Settle->PeakEnergy = Settle->BestEnergy = EnergyPerNode;
+        Settle->BestStep = Step;
+    }
+    else if (EnergyPerNode < (1.0f - Criteria->StallImprovement)*Settle->BestEnergy)
+    {
+        Settle->BestEnergy = EnergyPerNode;
+        Settle->BestStep = Step;
+    }
+    else if (Criteria->StallWindow > 0 && Step - Settle->BestStep >= Criteria->StallWindow)
+    {
+        return true;
+    }
+    return false;
+}
+
+/* Queue of jobs that the platform layer runs on a pool of worker threads.
+ * Opaque to the application, which only uses it through the functions the
+ * platform layer places in app_memory. */
+struct platform_work_queue;
+
+/* Signature of a job on a platform_work_queue. Data is the pointer that was
+ * given when the job was added. Jobs that are in the queue at the same time
+ * may run concurrently and in any order. */
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(void* Data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+/* Adds a job to the queue. Only ever called from the thread that calls
+ * UpdateAndRender. */
+#define PLATFORM_ADD_WORK_ENTRY(name) void name(platform_work_queue* Queue, platform_work_queue_callback* Callback, void* Data)
+typedef PLATFORM_ADD_WORK_ENTRY(platform_add_work_entry);
+
+/* Returns once every job added to the queue so far has finished. The calling
+ * thread helps out with the jobs while it waits. */
+#define PLATFORM_COMPLETE_ALL_WORK(name) void name(platform_work_queue* Queue)
+typedef PLATFORM_COMPLETE_ALL_WORK(platform_complete_all_work);
+
+struct graph;
+
+/* Where one node of a finished layout goes. A platform layer can save a
+ * layout as a list of these (from app_memory::Graph) and hand it back in a
+ * later run (as app_memory::Preset) to skip laying the graph out again. */
+struct preset_node
+{
+    // Position of the node in the order the NFA files declare the nodes (see
+    // graph_node::DeclarationIndex)
+    u32 DeclarationIndex;
+    f32 X;
+    f32 Y;
+};
+
 /* Structure that provides the application with usable blocks of memory and
  * larger pieces of data from the platform layer */
 struct app_memory
@@ -50,6 +357,63 @@ struct app_memory
     // Memory block holding the contents of the .ttf file used to render text,
     // loaded by the platform layer.
     u8* TTFFile;
+
+    // Parameters for the layout algorithms, which may be changed by the
+    // platform layer between calls.
+    layout_settings Settings;
+
+    // A finished layout for the graph, or NULL. If set when the graph is
+    // first loaded, and it has an entry for every node, the nodes are put
+    // where it says (numbered in the order it lists them) instead of being
+    // laid out. Otherwise it is ignored.
+    preset_node* Preset;
+    s32 PresetCount;
+    // Set by the application when it first loads the graph: whether the nodes
+    // were put where Preset says
+    bool PresetApplied;
+    // A snapshot (see snapshot.h) to load the graph from instead of the NFA
+    // files when first initialized, or NULL. The graph's strings point into
+    // it, so it has to stay put from then on. Ignored if it can't be read.
+    void* ResumeSnapshot;
+    size_t ResumeSnapshotSize;
+    // Kept by a noninteractive platform layer: its progress towards its
+    // settle_criteria, which is saved in snapshots along with the graph, and
+    // restored from ResumeSnapshot.
+    settle_state Settle;
+
+    // Worker threads the simulation may spread its work across, and the
+    // functions to use them with. The platform layer may leave WorkQueue NULL,
+    // in which case all work is done on the calling thread.
+    platform_work_queue* WorkQueue;
+    platform_add_work_entry* AddWorkEntry;
+    platform_complete_all_work* CompleteAllWork;
+    // Set by the platform layer to have the application's work on the queue
+    // finish as soon as it can, before it waits for the queue to empty from
+    // outside UpdateAndRender (to unload the application code, say). The
+    // pipelined simulation (see layout_settings::Pipelined) otherwise keeps
+    // running between calls. The platform layer clears it again afterwards.
+    bool volatile StopSimulation;
+
+    // Written by the application: the graph, as of the end of the most
+    // recent call to UpdateAndRender.
+    graph* Graph;
+    // Written by the application: the snapshot asked for by
+    // app_input::SaveSnapshot, in the temporary block, or NULL. Stays valid
+    // until the next call to UpdateAndRender.
+    void* Snapshot;
+    size_t SnapshotSize;
+    // Written by the application: statistics on the step simulated by the
+    // most recent call to UpdateAndRender (with a pipelined simulation, the
+    // most recent step finished by then).
+    simulation_stats Stats;
+    // Written by the application: the metrics of the layout after the most
+    // recent call to UpdateAndRender that asked for them (see
+    // app_input::MeasureLayout).
+    layout_metrics Metrics;
+    // Written by the application when built with GRAPHGEN_PROFILE: the time
+    // spent in each profile_zone so far, for the platform layer to report.
+    // The platform layer may add its own zones here too.
+    profile_counter Profile[PROFILE_ZONE_COUNT];
 };
 
 /* Structure describing the state of an input button. */
@@ -76,6 +440,15 @@ struct app_input
     // Whether to perform only simulation activities this tick (and not draw to
     // the buffer).
     bool SimulateOnly;
+    // Whether to measure the layout after this tick's step and write the
+    // result to app_memory::Metrics. Cheap, but not free.
+    bool MeasureLayout;
+    // Whether to leave the nodes where they are this tick instead of
+    // simulating a step, to draw a layout that is already finished.
+    bool SkipSimulation;
+    // Whether to write a snapshot of the graph to app_memory::Snapshot at the
+    // end of this tick.
+    bool SaveSnapshot;
 
     // Anonymous structure describing the state of the mouse input this frame.
     struct {
@@ -97,8 +470,36 @@ struct app_input
     // The NFA files in the memory block will also be re-parsed, allowing for
     // hot-swapping of graphs if desired.
     button_state ResetButton;
+    // A platform-designated button which re-parses the NFA files like
+    // ResetButton, but keeps the current positions of every node that is
+    // still there afterwards (matched up by JavaID or name), so that only the
+    // new parts of the graph need laying out.
+    // The platform may replace the NFA files in the memory block on the frame
+    // this is pressed, in order to pick up changes on disk, but the old
+    // contents must stay valid until UpdateAndRender returns.
+    button_state ReloadButton;
 };
 
+/* Folds the Size bytes at Data into Hash (64-bit FNV-1a). Start from
+ * HASH_INITIAL. */
+#define HASH_INITIAL 14695981039346656037ull
+inline u64
+HashBytes(u64 Hash, void* Data, size_t Size)
+{
+    for (size_t Index = 0; Index < Size; ++Index)
+    {
+        Hash = (Hash ^ ((u8*)Data)[Index])*1099511628211ull;
+    }
+    return Hash;
+}
+
+/* Returns a hash of the constants the simulation is built with (see the top
+ * of graphgen.cpp). Together with the NFA files, the layout_settings and how
+ * long it is simulated for, they determine the layout of a graph, so a
+ * platform layer that saves layouts can tell those made by a build with
+ * different constants apart. */
+u64 SimulationConstantsHash();
+
 /* Exported function definition for the main entry point to the dynamic library.
  *   Memory: A pointer to an initialized app_memory structure
  *   Buffer: A generic bitmap buffer to draw into
@@ -107,6 +508,37 @@ struct app_input
 typedef UPDATE_AND_RENDER(update_and_render);
 extern "C" { update_and_render UpdateAndRender; }
 
+/* One NFA file to be laid out by LayoutBatch, and the result. */
+struct batch_layout
+{
+    // Null-terminated contents of the NFA file. Node names in the result
+    // point into it.
+    char* NFAFile;
+    // Written by LayoutBatch: the laid out graph, which stays valid until the
+    // next call, and the number of steps it took to settle.
+    graph* Graph;
+    s32 StepCount;
+};
+
+/* Exported function definition for the batch entry point, which lays out each
+ * of many NFA files on its own, simulating many graphs side by side at once.
+ * Meant for laying out large numbers of small NFAs without drawing them; large
+ * graphs are better off going through UpdateAndRender.
+ *   Memory: A pointer to an initialized app_memory structure. The batch takes
+ *           over all of the temporary block, so it can't be shared with
+ *           UpdateAndRender, and the block needs room for LayoutCount graphs.
+ *           Memory->Settings only contributes Engine, Placement and Seed;
+ *           the batch always uses the Euler integrator and exact repulsion,
+ *           and with LAYOUT_LAYERED doesn't simulate at all.
+ *   Layouts: The files to lay out, and where the results go
+ *   Dim: Size in pixels of the space to lay the graphs out in, at the
+ *        default zoom
+ *   Criteria: When to stop simulating each graph
+ *   dt: Length of each step */
+#define LAYOUT_BATCH(name) void name(app_memory* Memory, batch_layout* Layouts, s32 LayoutCount, ivec2 Dim, settle_criteria Criteria, f32 dt)
+typedef LAYOUT_BATCH(layout_batch);
+extern "C" { layout_batch LayoutBatch; }
+
 // =====================
 //   Graph structures
 // =====================
@@ -143,24 +575,23 @@ enum node_type
     NODE_PRESTART,
     // Invisible node that defines the control point for a curve.
     NODE_CONTROL,
+
+    NODE_TYPE_COUNT,
 };
 
 /* A unique identifier for a node.
  * Current usage is as an index into the Nodes array on the graph structure,
  * but this may change in the future and should not be relied upon. */
-typedef s16 node_id;
+typedef s32 node_id;
 
-/* A single node in the graph, along with all of its simulation parameters. */
+// node_id of no node at all, which AddNode returns when the graph is full
+#define NO_NODE ((node_id)-1)
+
+/* The cold, descriptive data for a single node in the graph. The simulation
+ * state and type of the node live in the structure-of-arrays on the graph
+ * itself (see graph::PX and friends), indexed by the node's ID. */
 struct graph_node
 {
-    // The position of the node
-    vec2 P;
-    // The velocity vector of the node
-    vec2 dP;
-    // The acceleration vector of the node
-    vec2 ddP;
-    // The type of node as described above
-    node_type Type;
     // The node's identification number. See definition of node_id for more
     // details.
     node_id ID;
@@ -168,6 +599,9 @@ struct graph_node
     string Name;
     // String representing the java hash-code of the node
     string JavaID;
+    // The ID the node was given when it was added to the graph, which
+    // renumbering the nodes (see node_order) leaves alone
+    node_id DeclarationIndex;
 };
 
 /* An edge in the nodegraph, connecting at most two nodes. */
@@ -193,6 +627,31 @@ struct graph_edge
     bool HalfBidirectional;
 };
 
+/* Open-addressing hash table, with linear probing, from one of the strings of
+ * each node of a graph (its name, say) to the node's ID. Every node whose
+ * string isn't empty has a slot of its own, so all the nodes sharing a string
+ * turn up along the probe sequence starting from its hash. */
+struct node_index
+{
+    // SlotCount slots, a power of two and at least twice FilledCount, each
+    // holding the ID of a node or NO_NODE. SlotCount is 0 if there is no index
+    // (the graph's nodes weren't added with AddNode, or it ran out of room
+    // for it), in which case the nodes have to be searched one by one.
+    node_id* Slots;
+    s32 SlotCount;
+    s32 FilledCount;
+};
+
+/* Open-addressing hash table, with linear probing, from the Source and Dest
+ * of each edge of a graph to the edge's position in the graph's Edges array,
+ * laid out in the same way as node_index. Slots that hold no edge are -1. */
+struct edge_index
+{
+    s32* Slots;
+    s32 SlotCount;
+    s32 FilledCount;
+};
+
 /* Structure describing an entire nodegraph.
  * For the purposes of simulation, a graph is treated as a self-contained
  * network of nodes.
@@ -201,23 +660,62 @@ struct graph_edge
  * to the first. */
 struct graph
 {
-    // NOTE: The numbers here are chosen arbitrarily; most node graphs coming
-    // out of CSE311 NFAs should not have nearly this many nodes, and the
-    // standard simulation and rendering would choke if this number were
-    // actually reached.
-    // The numbers are meant to be a fairly rediculous upper limit, to give
-    // a bound on the memory usage of this part of the application.
-
-    // The number of valid nodes in the Nodes array
-    s16 NodeCount;
-    // Up to 512 nodes to use in the simulation. Flexible, usage code should
-    // not need to be updated if this is changed to a dynamic quantity.
-    graph_node Nodes[512];
-    // The number of valid edges in the Edges array
-    s16 EdgeCount;
-    // Up to 1024 edges to use in the simulation. Flexible, usage code should
-    // not need to be updated if this is changed to a dynamic quantity.
-    graph_edge Edges[1024];
+    // The arrays below are allocated out of Arena, which they move to bigger
+    // blocks of whenever AddNode or AddEdge runs out of room in them (see
+    // ReserveGraph). Growing leaves the old blocks behind until the arena is
+    // cleared, so nothing may hold a pointer into the arrays across adding to
+    // the graph. A graph with no Arena (one that is all zeroes, say) has no
+    // room at all.
+    memory_arena* Arena;
+
+    // The number of valid nodes in the node arrays, and the number they have
+    // room for
+    s32 NodeCount;
+    s32 NodeCapacity;
+
+    // Simulation state of the nodes, stored as a structure of arrays so that
+    // the simulation kernels only pull what they use through the cache.
+    // Entry i of each array belongs to the node whose ID is i.
+
+    // The position of each node
+    f32* PX;
+    f32* PY;
+    // The velocity of each node
+    f32* dPX;
+    f32* dPY;
+    // The acceleration of each node, accumulated over a simulation step
+    f32* ddPX;
+    f32* ddPY;
+    // The node_type of each node, packed into a byte
+    u8* Types;
+    // Whether each node is asleep (see layout_settings::Sleeping). Sleeping
+    // nodes have no velocity.
+    u8* Asleep;
+    // Number of steps in a row each awake node has been close to rest
+    u16* StillSteps;
+    // Number of steps simulated so far, which staggers the periodic checks on
+    // sleeping nodes across steps
+    u32 StepCount;
+    // Source of the random positions given by AddNode, and of any other
+    // randomness used while laying out this graph. Graphs derived from this
+    // one (components, coarsened levels) are seeded from it with RandomSplit.
+    random_series Random;
+
+    // Descriptive data for each node, which the simulation never touches.
+    graph_node* Nodes;
+    // The nodes by Name and by JavaID, for FindNodeByName and
+    // FindNodeByJavaID, kept up to date by AddNode and RenumberNodes
+    node_index NameIndex;
+    node_index JavaIDIndex;
+    // The number of valid edges in the Edges array, and the number it has
+    // room for
+    s32 EdgeCount;
+    s32 EdgeCapacity;
+    // The edges to use in the simulation
+    graph_edge* Edges;
+    // The edges by Source and Dest, for FindEdgeByNodes, kept up to date by
+    // AddEdge and RenumberNodes
+    edge_index EndpointIndex;
 
     // [Optional] (Currently unused) Name of the node graph, for display
     // purposes.
@@ -226,6 +724,22 @@ struct graph
     string JavaID;
 };
 
+/* State carried between steps by INTEGRATOR_ADAPTIVE_VERLET. Should be reset
+ * with ResetIntegrator whenever the graph is regenerated. */
+struct integrator_state
+{
+    // Multiplier on the platform's dt, adjusted by the energy controller
+    f32 TimestepScale;
+    // Timestep of the previous step, whose second half-kick is applied at the
+    // start of the next step (once the forces there are known)
+    f32 PreviousTimestep;
+    // Number of steps in a row the layout has been releasing energy
+    s32 Progress;
+};
+
+// Defined in graphgen.cpp
+struct simulation_pipeline;
+
 /* Structure used to store the current state of the application. */
 struct app_state
 {
@@ -233,9 +747,11 @@ struct app_state
     bool IsInitialized;
 
     // Memory arena used to store more permanent graph structures
-    // such as the graph itself and (speculatively) dynamically
-    // allocated nodes.
+    // such as the graph itself and its node and edge arrays.
     memory_arena GraphArena;
+    // The part of GraphArena holding the arrays of Graph (and anything else
+    // sized to it), which is released whenever the graph is generated again
+    temporary_memory GraphMemory;
     // Memory arena for transient calculations, should be used
     // with temporary_memory to avoid accumulating old data
     // from frame to frame.
@@ -244,6 +760,31 @@ struct app_state
     // A pointer to the current node graph being simulated.
     graph* Graph;
 
+    // The layout parameters in effect for this frame, copied from app_memory
+    // at the start of each UpdateAndRender.
+    layout_settings Settings;
+
+    // The platform work queue and its functions, also copied from app_memory
+    // each frame. WorkQueue may be NULL.
+    platform_work_queue* WorkQueue;
+    platform_add_work_entry* AddWorkEntry;
+    platform_complete_all_work* CompleteAllWork;
+
+    // Timestep control for the adaptive integrator
+    integrator_state Integrator;
+
+    // The simulation running on a worker thread when layout_settings::Pipelined
+    // is set. While it runs it owns the simulation state of Graph.
+    simulation_pipeline* Pipeline;
+
+    // The memory app_memory::Snapshot was written to, which is released at
+    // the start of the next call (Arena is NULL when there is none)
+    temporary_memory SnapshotMemory;
+
+    // Seeded from layout_settings::Seed on initialization; every graph loaded
+    // (or reset, or reloaded) gets its own series split off from this one.
+    random_series Random;
+
     // Scalable value determining the translation from "world" units to screen
     // units
     f32 PixelsPerUnit;
@@ -252,19 +793,73 @@ struct app_state
     stbtt_fontinfo FontInfo;
 };
 
-/* Procedure that adds a node with the same properties as Node to the graph,
- * returning the id of the added node. 
+/* Accessors for the simulation state of a single node, for code that would
+ * rather work in vectors than on the individual arrays. */
+inline vec2
+GetNodeP(graph* Graph, node_id ID)
+{
+    return V2(Graph->PX[ID], Graph->PY[ID]);
+}
+
+inline void
+SetNodeP(graph* Graph, node_id ID, vec2 P)
+{
+    Graph->PX[ID] = P.x;
+    Graph->PY[ID] = P.y;
+}
+
+inline vec2
+GetNodedP(graph* Graph, node_id ID)
+{
+    return V2(Graph->dPX[ID], Graph->dPY[ID]);
+}
+
+inline void
+SetNodedP(graph* Graph, node_id ID, vec2 dP)
+{
+    Graph->dPX[ID] = dP.x;
+    Graph->dPY[ID] = dP.y;
+}
+
+inline void
+AddNodeddP(graph* Graph, node_id ID, vec2 ddP)
+{
+    Graph->ddPX[ID] += ddP.x;
+    Graph->ddPY[ID] += ddP.y;
+}
+
+inline node_type
+GetNodeType(graph* Graph, node_id ID)
+{
+    return (node_type)Graph->Types[ID];
+}
+
+/* Procedure that empties Graph, and sets it up to allocate its arrays out of
+ * Arena, with room for NodeCapacity nodes and EdgeCapacity edges to begin
+ * with. Returns false, leaving the graph with no room at all, if Arena doesn't
+ * have that much room. */
+bool InitializeGraph(graph* Graph, memory_arena* Arena, s32 NodeCapacity = 0, s32 EdgeCapacity = 0);
+
+/* Procedure that makes sure Graph has room for at least NodeCapacity nodes and
+ * EdgeCapacity edges, moving its arrays to bigger blocks of its Arena if they
+ * don't. Returns false, leaving the graph as it was, if it can't grow that
+ * far. */
+bool ReserveGraph(graph* Graph, s32 NodeCapacity, s32 EdgeCapacity);
+
+/* Procedure that adds a node of the given type with the same properties as
+ * Node to the graph, returning the id of the added node, or NO_NODE if the
+ * graph is full and can't grow. 
  * Properties guaranteed retained:
- *  - Type
  *  - Name
  *  - JavaID */
-node_id AddNode(graph* NodeGraph, graph_node Node);
+node_id AddNode(graph* NodeGraph, graph_node Node, node_type Type = NODE_REGULAR);
 
 /* Procedure that adds a new node of the given type to the graph, returning
- * the id of the added node. */
+ * the id of the added node, or NO_NODE if the graph is full and can't grow. */
 node_id AddNode(graph* NodeGraph, node_type Type = NODE_REGULAR);
 
 /* Procedure that adds an edge with the same properties as Edge to the graph.
+ * Returns false if the graph is full and can't grow.
  * Properties guaranteed retained:
  *  - Source
  *  - Dest
@@ -272,17 +867,34 @@ node_id AddNode(graph* NodeGraph, node_type Type = NODE_REGULAR);
  *  - Transition
  *  - OtherTransitions
  *  - HalfBidirectional */
-void AddEdge(graph* NodeGraph, graph_edge Edge);
+bool AddEdge(graph* NodeGraph, graph_edge Edge);
+
+/* Procedure that adds a new edge between the two given nodes to the graph.
+ * Returns false if the graph is full and can't grow. */
+bool AddEdge(graph* NodeGraph, node_id Node1, node_id Node2);
 
-/* Procedure that adds a new edge between the two given nodes to the graph. */
-void AddEdge(graph* NodeGraph, node_id Node1, node_id Node2);
+/* Procedure that (re)builds the NameIndex and JavaIDIndex of Graph from its
+ * nodes as they are, allocating them out of the graph's Arena if they don't
+ * have room already. Returns false, leaving the graph without them, if the
+ * arena doesn't have room either. */
+bool IndexNodes(graph* Graph);
+
+/* Procedure that (re)builds the EndpointIndex of Graph from its edges as they
+ * are, in the same way as IndexNodes. */
+bool IndexEdges(graph* Graph);
 
 /* Procedure that finds a node in the graph by name. IndexStart is the position
- * in the graph's Nodes array to begin searching. */
-graph_node* FindNodeByName(graph* Graph, char* NameStart, size_t NameLength, s16 IndexStart = 0);
+ * in the graph's Nodes array to begin searching; of the nodes from there on
+ * with that name, the first is returned. */
+graph_node* FindNodeByName(graph* Graph, char* NameStart, size_t NameLength, node_id IndexStart = 0);
+
+/* Procedure that finds a node in the graph by its java hash-code, in the same
+ * way as FindNodeByName. */
+graph_node* FindNodeByJavaID(graph* Graph, char* JavaIDStart, size_t JavaIDLength, node_id IndexStart = 0);
 
 /* Procedure that finds an edge in the graph by its source and dest node IDs.
- * IndexStart is the position in the graph's Edges array to begin searching. */
-graph_edge* FindEdgeByNodes(graph* Graph, node_id StartNode, node_id EndNode, s16 IndexStart = 0);
+ * IndexStart is the position in the graph's Edges array to begin searching; of
+ * the edges from there on between those nodes, the first is returned. */
+graph_edge* FindEdgeByNodes(graph* Graph, node_id StartNode, node_id EndNode, s32 IndexStart = 0);
 
 
@@ -5,12 +5,47 @@
 #include <sys/types.h>
 #include <time.h>
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "graphgen.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+// Default cap on the number of simulation steps
 #define SIMULATION_ITERATIONS 1000
+// Default kinetic energy per node below which the layout counts as settled
+#define SETTLED_ENERGY_PER_NODE 0.01f
+// No node may be moving faster than this (in world units per second) for the
+// layout to count as settled
+#define SETTLED_MAX_SPEED 0.3f
+// Default number of steps the energy may go without improving before the
+// layout counts as stalled
+#define STALL_WINDOW 200
+// Fraction by which the energy has to drop below its best value so far to
+// count as an improvement
+#define STALL_IMPROVEMENT 0.05f
+
+// Upper limit on --threads, including the main thread
+#define MAX_THREAD_COUNT 256
+
+// Size of the image drawn, which is also the space the graphs are laid out in
+#define OUTPUT_WIDTH 1600
+#define OUTPUT_HEIGHT 900
+
+// Most files handed to LayoutBatch at once in --batch mode
+#define BATCH_FILE_COUNT 1024
+// Generous estimate of the bytes of graph a byte of NFA file turns into,
+// counting what growing the graph's arrays leaves behind
+#define BATCH_GRAPH_BYTES_PER_FILE_BYTE 32
+
+// How many steps apart --checkpoint saves snapshots unless told otherwise
+#define CHECKPOINT_INTERVAL 100
+
+// Where --cache keeps layouts unless told otherwise
+#define LAYOUT_CACHE_DIRECTORY "fsm/cache"
 
 internal char* 
 ReadFileIntoCString(char* Filename)
@@ -64,58 +99,888 @@ FixBitmap(bitmap Src, bitmap Dest)
     }
 }
 
+/* Checks whether Arg is the command line option Name, optionally followed by
+ * "=value". If so, returns true and points Value at the value (or NULL if
+ * there was none). */
+internal bool
+MatchOption(char* Arg, char* Name, char** Value)
+{
+    size_t NameLength = strlen(Name);
+    if (strncmp(Arg, Name, NameLength) != 0) { return false; }
+
+    if (Arg[NameLength] == '\0') 
+    { 
+        *Value = NULL;
+        return true; 
+    }
+    if (Arg[NameLength] == '=')
+    {
+        *Value = Arg + NameLength + 1;
+        return true;
+    }
+    return false;
+}
+
+internal void
+PrintUsage(char* ProgramName)
+{
+    fprintf(stderr, "Usage: %s [options] <NFAConstructorTester output file>...\n", ProgramName);
+    fprintf(stderr, "       %s --batch [options] <NFAConstructorTester output file>...\n", ProgramName);
+    fprintf(stderr, "       %s --resume=<snapshot file> [options]\n", ProgramName);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --engine=<type>       Layout engine: force (default) to simulate, or\n"
+                    "                        layered for a left-to-right layout in layers\n");
+    fprintf(stderr, "  --barnes-hut[=theta]  Approximate repulsion with a Barnes-Hut quadtree,\n"
+                    "                        optionally with the given opening angle\n");
+    fprintf(stderr, "  --simd=<level>        Instruction set for the exact repulsion kernel:\n"
+                    "                        auto (default), scalar, sse2 or avx2\n");
+    fprintf(stderr, "  --integrator=<type>   Integrator to simulate with: euler (default), or\n"
+                    "                        verlet for adaptive-timestep velocity Verlet\n");
+    fprintf(stderr, "  --placement=<type>    Initial node positions: bfs (default) for columns\n"
+                    "                        by distance from the start, stress for stress\n"
+                    "                        majorization from there, spectral or random\n");
+    fprintf(stderr, "  --seed=<n>            Seed the layout, making it reproducible bit for bit\n");
+    fprintf(stderr, "  --no-sleep            Keep simulating nodes that have come to rest\n");
+    fprintf(stderr, "  --no-components       Lay out disconnected parts of the graph together\n");
+    fprintf(stderr, "  --multilevel          Start from a multilevel layout of coarsened graphs\n");
+    fprintf(stderr, "  --node-order=<order>  Order to number the nodes in, for speed: declaration\n"
+                    "                        (default), rcm or hilbert\n");
+    fprintf(stderr, "  --reorder-interval=<n>\n"
+                    "                        Renumber hilbert-ordered nodes every n steps\n"
+                    "                        (default 100, 0 for only at the start)\n");
+    fprintf(stderr, "  --max-iterations=<n>  Never simulate more than n steps (default %d)\n",
+            SIMULATION_ITERATIONS);
+    fprintf(stderr, "  --energy-threshold=<e>\n"
+                    "                        Stop once the kinetic energy per node is below e\n"
+                    "                        (default %g, 0 to disable)\n", SETTLED_ENERGY_PER_NODE);
+    fprintf(stderr, "  --stall-window=<n>    Stop once the energy hasn't improved for n steps\n"
+                    "                        (default %d, 0 to disable)\n", STALL_WINDOW);
+    fprintf(stderr, "  --metrics[=n]         Print measures of the layout's quality once it's\n"
+                    "                        done, and every n steps if n is given\n");
+    fprintf(stderr, "  --cache[=dir]         Reuse the layout from an earlier run with the same\n"
+                    "                        files and options, kept in dir (default %s);\n"
+                    "                        only with --seed\n", LAYOUT_CACHE_DIRECTORY);
+    fprintf(stderr, "  --checkpoint=<file>   Save a snapshot of the layout to file as it goes,\n"
+                    "                        and once it's done\n");
+    fprintf(stderr, "  --checkpoint-interval=<n>\n"
+                    "                        Save the snapshot every n steps (default %d)\n",
+            CHECKPOINT_INTERVAL);
+    fprintf(stderr, "  --resume=<file>       Carry on from a snapshot saved by --checkpoint,\n"
+                    "                        instead of from NFA files, with the same options;\n"
+                    "                        one that's done is only drawn\n");
+    fprintf(stderr, "  --no-image            Lay the files out without drawing them\n");
+    fprintf(stderr, "  --threads=<count>     Number of threads to simulate with (default: one\n"
+                    "                        per online processor)\n");
+    fprintf(stderr, "  --batch               Lay out each file on its own, many at once, and\n"
+                    "                        print the positions of their states instead of\n"
+                    "                        drawing them. Only the engine, placement, seed,\n"
+                    "                        threads and stopping options apply.\n");
+}
+
+struct platform_work_queue_entry
+{
+    platform_work_queue_callback* Callback;
+    void* Data;
+};
+
+/* Single-producer work queue: only the main thread adds entries, while the
+ * main thread and any number of workers take them. */
+struct platform_work_queue
+{
+    u32 volatile CompletionGoal;
+    u32 volatile CompletionCount;
+
+    u32 volatile NextEntryToWrite;
+    u32 volatile NextEntryToRead;
+    sem_t Semaphore;
+
+    platform_work_queue_entry Entries[256];
+};
+
+internal
+PLATFORM_ADD_WORK_ENTRY(PosixAddWorkEntry)
+{
+    u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+    assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+
+    platform_work_queue_entry* Entry = Queue->Entries + Queue->NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    ++Queue->CompletionGoal;
+
+    // Make sure the entry is visible before the workers can see it's there
+    __sync_synchronize();
+    Queue->NextEntryToWrite = NewNextEntryToWrite;
+    sem_post(&Queue->Semaphore);
+}
+
+/* Runs the next job in the queue, if any. Returns false if there was
+ * nothing to do. */
+internal bool
+PosixDoNextWorkEntry(platform_work_queue* Queue)
+{
+    u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
+    if (OriginalNextEntryToRead == Queue->NextEntryToWrite) { return false; }
+
+    u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+    if (__sync_bool_compare_and_swap(&Queue->NextEntryToRead, OriginalNextEntryToRead, NewNextEntryToRead))
+    {
+        platform_work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+        Entry.Callback(Entry.Data);
+        __sync_fetch_and_add(&Queue->CompletionCount, 1);
+    }
+    return true;
+}
+
+internal
+PLATFORM_COMPLETE_ALL_WORK(PosixCompleteAllWork)
+{
+    while (Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        PosixDoNextWorkEntry(Queue);
+    }
+
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
+
+internal void*
+WorkerThreadProc(void* Parameter)
+{
+    platform_work_queue* Queue = (platform_work_queue*)Parameter;
+    for (;;)
+    {
+        if (!PosixDoNextWorkEntry(Queue))
+        {
+            sem_wait(&Queue->Semaphore);
+        }
+    }
+    return NULL;
+}
+
+/* Starts WorkerCount threads servicing Queue. */
+internal void
+InitializeWorkQueue(platform_work_queue* Queue, int WorkerCount)
+{
+    *Queue = {};
+    sem_init(&Queue->Semaphore, 0, 0);
+
+    for (int WorkerIndex = 0; WorkerIndex < WorkerCount; ++WorkerIndex)
+    {
+        pthread_t Thread;
+        pthread_create(&Thread, NULL, WorkerThreadProc, Queue);
+        pthread_detach(Thread);
+    }
+}
+
+/* Lays out each of the given files on its own with LayoutBatch, and writes
+ * the positions of their states to stdout: the name of the file on a line of
+ * its own, then a "<state> <x> <y>" line for every state (in world units, from
+ * the center of the image, y up), then an empty line. Files that can't be read
+ * are reported and left out. */
+internal int
+RunBatch(app_memory* AppMemory, char** NFAFileNames, int NFAFileCount,
+         settle_criteria Criteria, f32 dt)
+{
+    int Result = EXIT_SUCCESS;
+
+    // Leave half the temporary block for everything besides the graphs
+    size_t ChunkFileBytes = AppMemory->TemporarySize / (2*BATCH_GRAPH_BYTES_PER_FILE_BYTE);
+    batch_layout* Layouts = (batch_layout*)malloc(BATCH_FILE_COUNT*sizeof(batch_layout));
+    char** LayoutFileNames = (char**)malloc(BATCH_FILE_COUNT*sizeof(char*));
+
+    for (int FileIndex = 0; FileIndex < NFAFileCount; )
+    {
+        // Always at least one file, however big
+        int LayoutCount = 0;
+        size_t FileBytes = 0;
+        while (FileIndex < NFAFileCount && LayoutCount < BATCH_FILE_COUNT &&
+               (LayoutCount == 0 || FileBytes < ChunkFileBytes))
+        {
+            char* NFAFile = ReadFileIntoCString(NFAFileNames[FileIndex]);
+            if (NFAFile == NULL)
+            {
+                fprintf(stderr, "Couldn't read %s\n", NFAFileNames[FileIndex++]);
+                Result = EXIT_FAILURE;
+                continue;
+            }
+            FileBytes += strlen(NFAFile);
+            LayoutFileNames[LayoutCount] = NFAFileNames[FileIndex++];
+            Layouts[LayoutCount++].NFAFile = NFAFile;
+        }
+
+        LayoutBatch(AppMemory, Layouts, LayoutCount, IV2(OUTPUT_WIDTH, OUTPUT_HEIGHT), Criteria, dt);
+
+        for (int LayoutIndex = 0; LayoutIndex < LayoutCount; ++LayoutIndex)
+        {
+            graph* Graph = Layouts[LayoutIndex].Graph;
+            printf("%s\n", LayoutFileNames[LayoutIndex]);
+            for (node_id NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+            {
+                node_type Type = GetNodeType(Graph, NodeIndex);
+                if (Type == NODE_PRESTART || Type == NODE_CONTROL) { continue; }
+
+                string Name = Graph->Nodes[NodeIndex].Name;
+                printf("%.*s %.3f %.3f\n", (int)Name.Length, Name.Start,
+                       Graph->PX[NodeIndex], Graph->PY[NodeIndex]);
+            }
+            printf("\n");
+            free(Layouts[LayoutIndex].NFAFile);
+        }
+    }
+
+    free(LayoutFileNames);
+    free(Layouts);
+    return Result;
+}
+
+// Layout cache files (see --cache): a layout_cache_header followed by the
+// header's NodeCount preset_nodes, named after the key in hex
+#define LAYOUT_CACHE_MAGIC 0x434c4747
+#define LAYOUT_CACHE_VERSION 1
+
+struct layout_cache_header
+{
+    u32 Magic;
+    u32 Version;
+    u64 Key;
+    s32 NodeCount;
+    // Number of steps it took to lay the graph out, for --metrics to report
+    s32 StepCount;
+};
+
+/* Returns the key the layout of the given files is cached under: a hash of
+ * their contents and of everything else the layout depends on. */
+internal u64
+LayoutCacheKey(char** NFAFiles, int NFAFileCount, layout_settings* Settings,
+               settle_criteria* Criteria, f32 dt)
+{
+    u64 Key = HASH_INITIAL;
+    u32 Version = LAYOUT_CACHE_VERSION;
+    Key = HashBytes(Key, &Version, sizeof(Version));
+    u64 ConstantsHash = SimulationConstantsHash();
+    Key = HashBytes(Key, &ConstantsHash, sizeof(ConstantsHash));
+
+    for (int FileIndex = 0; FileIndex < NFAFileCount; ++FileIndex)
+    {
+        char* NFAFile = NFAFiles[FileIndex];
+        u64 Length = NFAFile ? strlen(NFAFile) : 0;
+        Key = HashBytes(Key, &Length, sizeof(Length));
+        Key = HashBytes(Key, NFAFile, Length);
+    }
+
+    // Field by field, to stay clear of any padding
+    s32 Integers[] = {
+        Settings->Engine, Settings->RepulsionMode, Settings->SIMDLevel, Settings->Integrator,
+        Settings->Placement, (s32)Settings->Seed, Settings->Sleeping, Settings->SeparateComponents,
+        Settings->Multilevel, Settings->NodeOrder, Settings->ReorderInterval,
+        Criteria->MaxIterations, Criteria->StallWindow, OUTPUT_WIDTH, OUTPUT_HEIGHT,
+    };
+    f32 Reals[] = {
+        Settings->BarnesHutTheta, Criteria->EnergyPerNode, Criteria->MaxSpeed,
+        Criteria->StallImprovement, dt,
+    };
+    Key = HashBytes(Key, Integers, sizeof(Integers));
+    Key = HashBytes(Key, Reals, sizeof(Reals));
+    return Key;
+}
+
+/* Returns the name of the file the layout with the given Key is cached in,
+ * allocated with malloc. */
+internal char*
+LayoutCachePath(char* Directory, u64 Key)
+{
+    char* Path;
+    asprintf(&Path, "%s/%016llx.layout", Directory, (unsigned long long)Key);
+    return Path;
+}
+
+/* Reads the layout cached under Key into a new array (to be freed by the
+ * caller), and the number of nodes and steps it had. Returns NULL if there
+ * is no such layout, or the file is damaged. */
+internal preset_node*
+ReadLayoutCache(char* Directory, u64 Key, s32* NodeCount, s32* StepCount)
+{
+    char* Path = LayoutCachePath(Directory, Key);
+    FILE* File = fopen(Path, "rb");
+    free(Path);
+    if (File == NULL) { return NULL; }
+
+    preset_node* Nodes = NULL;
+    layout_cache_header Header;
+    if (fread(&Header, sizeof(Header), 1, File) == 1 &&
+        Header.Magic == LAYOUT_CACHE_MAGIC && Header.Version == LAYOUT_CACHE_VERSION &&
+        Header.Key == Key && Header.NodeCount > 0)
+    {
+        Nodes = (preset_node*)malloc(Header.NodeCount*sizeof(preset_node));
+        if (fread(Nodes, sizeof(preset_node), Header.NodeCount, File) == (size_t)Header.NodeCount)
+        {
+            *NodeCount = Header.NodeCount;
+            *StepCount = Header.StepCount;
+        }
+        else
+        {
+            free(Nodes);
+            Nodes = NULL;
+        }
+    }
+    fclose(File);
+    return Nodes;
+}
+
+/* Makes the directory Path, and any of its parents that don't exist yet.
+ * Returns false if that fails. */
+internal bool
+MakeDirectories(char* Path)
+{
+    char* Partial = strdup(Path);
+    bool Result = true;
+    for (char* Scan = Partial + 1; Result; ++Scan)
+    {
+        if (*Scan != '/' && *Scan != '\0') { continue; }
+
+        char Separator = *Scan;
+        *Scan = '\0';
+        int DirResult = mkdir(Partial, 0755);
+        Result = (DirResult == 0 || errno == EEXIST);
+        *Scan = Separator;
+        if (Separator == '\0') { break; }
+    }
+    free(Partial);
+    return Result;
+}
+
+/* Writes the Size bytes at Data to the file Path. They go to a temporary file
+ * first, which is then moved into place, so that the file never holds half
+ * of them, even if the program is killed part way through, and anything that
+ * still has the old file open (or mapped) keeps the old contents. Returns
+ * false, with errno set, if that fails. */
+internal bool
+WriteFileAtomically(char* Path, void* Data, size_t Size)
+{
+    char* TempPath;
+    asprintf(&TempPath, "%s.%d", Path, (int)getpid());
+
+    bool Result = false;
+    FILE* File = fopen(TempPath, "wb");
+    if (File != NULL)
+    {
+        Result = (fwrite(Data, 1, Size, File) == Size);
+        Result = (fclose(File) == 0) && Result;
+        Result = Result && (rename(TempPath, Path) == 0);
+        if (!Result)
+        {
+            int Error = errno;
+            unlink(TempPath);
+            errno = Error;
+        }
+    }
+
+    free(TempPath);
+    return Result;
+}
+
+/* Saves the layout of Graph, which took StepCount steps, under Key. Failing
+ * is harmless, so only prints a warning. */
+internal void
+WriteLayoutCache(char* Directory, u64 Key, graph* Graph, s32 StepCount)
+{
+    size_t Size = sizeof(layout_cache_header) + Graph->NodeCount*sizeof(preset_node);
+    u8* Data = (u8*)malloc(Size);
+
+    layout_cache_header* Header = (layout_cache_header*)Data;
+    *Header = {};
+    Header->Magic = LAYOUT_CACHE_MAGIC;
+    Header->Version = LAYOUT_CACHE_VERSION;
+    Header->Key = Key;
+    Header->NodeCount = Graph->NodeCount;
+    Header->StepCount = StepCount;
+
+    preset_node* Nodes = (preset_node*)(Header + 1);
+    for (node_id NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+    {
+        Nodes[NodeIndex].DeclarationIndex = Graph->Nodes[NodeIndex].DeclarationIndex;
+        Nodes[NodeIndex].X = Graph->PX[NodeIndex];
+        Nodes[NodeIndex].Y = Graph->PY[NodeIndex];
+    }
+
+    char* Path = LayoutCachePath(Directory, Key);
+    if (!MakeDirectories(Directory) || !WriteFileAtomically(Path, Data, Size))
+    {
+        fprintf(stderr, "Couldn't save the layout to %s: %s\n", Path, strerror(errno));
+    }
+
+    free(Path);
+    free(Data);
+}
+
+/* Maps the whole of the file Path into memory, read-only, and returns it,
+ * with its size in *Size. Returns NULL if that can't be done. */
+internal void*
+MapFile(char* Path, size_t* Size)
+{
+    int File = open(Path, O_RDONLY);
+    if (File == -1) { return NULL; }
+
+    void* Result = NULL;
+    struct stat Stat;
+    if (fstat(File, &Stat) == 0 && Stat.st_size > 0)
+    {
+        Result = mmap(0, Stat.st_size, PROT_READ, MAP_PRIVATE, File, 0);
+        if (Result == MAP_FAILED) { Result = NULL; }
+        else { *Size = Stat.st_size; }
+    }
+    close(File);
+    return Result;
+}
+
+/* Writes a snapshot of the layout so far (see snapshot.h) to Path, asking
+ * UpdateAndRender for it on a tick that neither simulates nor draws. Failing
+ * only costs the checkpoint, so only prints a warning. */
+internal void
+WriteCheckpoint(app_memory* AppMemory, bitmap* Buffer, app_input* Input, char* Path)
+{
+    app_input SaveInput = *Input;
+    SaveInput.SimulateOnly = true;
+    SaveInput.SkipSimulation = true;
+    SaveInput.MeasureLayout = false;
+    SaveInput.SaveSnapshot = true;
+    UpdateAndRender(AppMemory, Buffer, &SaveInput);
+
+    if (!WriteFileAtomically(Path, AppMemory->Snapshot, AppMemory->SnapshotSize))
+    {
+        fprintf(stderr, "Couldn't write the checkpoint %s: %s\n", Path, strerror(errno));
+    }
+}
+
+#if GRAPHGEN_PROFILE
+/* Prints the time spent in each profile zone to stderr, as a table. The rate
+ * of the ticks is worked out from how many passed since StartTicks was read,
+ * at StartTime. */
+internal void
+PrintProfile(profile_counter* Profile, u64 StartTicks, struct timespec StartTime)
+{
+    struct timespec EndTime;
+    clock_gettime(CLOCK_MONOTONIC, &EndTime);
+    f64 Seconds = (f64)(EndTime.tv_sec - StartTime.tv_sec) + 1e-9*(f64)(EndTime.tv_nsec - StartTime.tv_nsec);
+    f64 TicksPerMillisecond = (f64)(ProfileTicks() - StartTicks) / (1000.0*Seconds);
+    f64 MainTicks = (f64)Max(Profile[PROFILE_MAIN].Ticks, (u64)1);
+
+    fprintf(stderr, "%-22s %10s %12s %14s %8s\n", "zone", "hits", "total ms", "ticks/hit", "% main");
+    for (int Zone = 0; Zone < PROFILE_ZONE_COUNT; ++Zone)
+    {
+        profile_counter* Counter = Profile + Zone;
+        if (Counter->Hits == 0) { continue; }
+        fprintf(stderr, "%-22s %10llu %12.3f %14.0f %8.1f\n", ProfileZoneName((profile_zone)Zone),
+                (unsigned long long)Counter->Hits, (f64)Counter->Ticks / TicksPerMillisecond,
+                (f64)Counter->Ticks / (f64)Counter->Hits, 100.0*(f64)Counter->Ticks / MainTicks);
+    }
+}
+#endif
+
+/* Prints the metrics of the layout after Step steps to stdout, on one line. */
+internal void
+PrintMetrics(int Step, layout_metrics* Metrics)
+{
+    printf("step %d: crossings %d, node overlaps %d, label overlaps %d, "
+           "edge length mean %.3f variance %.3f, angular resolution %.3f (min %.1f deg)\n",
+           Step, Metrics->EdgeCrossings, Metrics->NodeOverlaps, Metrics->LabelOverlaps,
+           Metrics->EdgeLengthMean, Metrics->EdgeLengthVariance,
+           Metrics->AngularResolution, Metrics->MinAngle*180.0f/PI32);
+}
+
 int main (int ArgCount, char* ArgValues[])
 {
-    if (ArgCount < 2)
+    layout_settings Settings = DefaultLayoutSettings();
+    // Normally as many files as app_memory::NFAFiles has room for, which are
+    // merged into one graph, and the image is named after the first.
+    char** NFAFileNames = (char**)malloc(ArgCount*sizeof(char*));
+    int NFAFileCount = 0;
+    int ThreadCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    bool SeedGiven = false;
+    bool Batch = false;
+    bool ReportMetrics = false;
+    int MetricsInterval = 0;
+    char* CacheDirectory = NULL;
+    char* CheckpointFileName = NULL;
+    int CheckpointInterval = CHECKPOINT_INTERVAL;
+    char* ResumeFileName = NULL;
+    bool DrawImage = true;
+
+    settle_criteria Criteria = {};
+    Criteria.MaxIterations = SIMULATION_ITERATIONS;
+    Criteria.EnergyPerNode = SETTLED_ENERGY_PER_NODE;
+    Criteria.MaxSpeed = SETTLED_MAX_SPEED;
+    Criteria.StallWindow = STALL_WINDOW;
+    Criteria.StallImprovement = STALL_IMPROVEMENT;
+
+    for (int ArgIndex = 1; ArgIndex < ArgCount; ++ArgIndex)
     {
-        fprintf(stderr, "Usage: %s <NFAConstructorTester output file>\n", ArgValues[0]);
+        char* Arg = ArgValues[ArgIndex];
+        char* Value = NULL;
+        if (MatchOption(Arg, "--barnes-hut", &Value))
+        {
+            Settings.RepulsionMode = REPULSION_BARNES_HUT;
+            if (Value) { Settings.BarnesHutTheta = strtof(Value, NULL); }
+        }
+        else if (MatchOption(Arg, "--simd", &Value) && Value)
+        {
+            if (strcmp(Value, "auto") == 0) { Settings.SIMDLevel = SIMD_AUTO; }
+            else if (strcmp(Value, "scalar") == 0) { Settings.SIMDLevel = SIMD_SCALAR; }
+            else if (strcmp(Value, "sse2") == 0) { Settings.SIMDLevel = SIMD_SSE2; }
+            else if (strcmp(Value, "avx2") == 0) { Settings.SIMDLevel = SIMD_AVX2; }
+            else
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--engine", &Value) && Value)
+        {
+            if (strcmp(Value, "force") == 0) { Settings.Engine = LAYOUT_FORCE; }
+            else if (strcmp(Value, "layered") == 0) { Settings.Engine = LAYOUT_LAYERED; }
+            else
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--integrator", &Value) && Value)
+        {
+            if (strcmp(Value, "euler") == 0) { Settings.Integrator = INTEGRATOR_EULER; }
+            else if (strcmp(Value, "verlet") == 0) { Settings.Integrator = INTEGRATOR_ADAPTIVE_VERLET; }
+            else
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--placement", &Value) && Value)
+        {
+            if (strcmp(Value, "random") == 0) { Settings.Placement = PLACEMENT_RANDOM; }
+            else if (strcmp(Value, "bfs") == 0) { Settings.Placement = PLACEMENT_BFS; }
+            else if (strcmp(Value, "spectral") == 0) { Settings.Placement = PLACEMENT_SPECTRAL; }
+            else if (strcmp(Value, "stress") == 0) { Settings.Placement = PLACEMENT_STRESS; }
+            else
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--seed", &Value) && Value)
+        {
+            Settings.Seed = (u32)strtoul(Value, NULL, 10);
+            SeedGiven = true;
+        }
+        else if (MatchOption(Arg, "--no-sleep", &Value) && !Value)
+        {
+            Settings.Sleeping = false;
+        }
+        else if (MatchOption(Arg, "--no-components", &Value) && !Value)
+        {
+            Settings.SeparateComponents = false;
+        }
+        else if (MatchOption(Arg, "--multilevel", &Value) && !Value)
+        {
+            Settings.Multilevel = true;
+        }
+        else if (MatchOption(Arg, "--node-order", &Value) && Value)
+        {
+            if (strcmp(Value, "declaration") == 0) { Settings.NodeOrder = NODE_ORDER_DECLARATION; }
+            else if (strcmp(Value, "rcm") == 0) { Settings.NodeOrder = NODE_ORDER_RCM; }
+            else if (strcmp(Value, "hilbert") == 0) { Settings.NodeOrder = NODE_ORDER_HILBERT; }
+            else
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--reorder-interval", &Value) && Value)
+        {
+            Settings.ReorderInterval = atoi(Value);
+            if (Settings.ReorderInterval < 0)
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--max-iterations", &Value) && Value)
+        {
+            Criteria.MaxIterations = atoi(Value);
+            if (Criteria.MaxIterations < 1)
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--energy-threshold", &Value) && Value)
+        {
+            Criteria.EnergyPerNode = strtof(Value, NULL);
+        }
+        else if (MatchOption(Arg, "--stall-window", &Value) && Value)
+        {
+            Criteria.StallWindow = atoi(Value);
+        }
+        else if (MatchOption(Arg, "--threads", &Value) && Value)
+        {
+            ThreadCount = atoi(Value);
+            if (ThreadCount < 1)
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--metrics", &Value))
+        {
+            ReportMetrics = true;
+            if (Value)
+            {
+                MetricsInterval = atoi(Value);
+                if (MetricsInterval < 1)
+                {
+                    PrintUsage(ArgValues[0]);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else if (MatchOption(Arg, "--cache", &Value))
+        {
+            CacheDirectory = Value ? Value : (char*)LAYOUT_CACHE_DIRECTORY;
+        }
+        else if (MatchOption(Arg, "--checkpoint", &Value) && Value)
+        {
+            CheckpointFileName = Value;
+        }
+        else if (MatchOption(Arg, "--checkpoint-interval", &Value) && Value)
+        {
+            CheckpointInterval = atoi(Value);
+            if (CheckpointInterval < 1)
+            {
+                PrintUsage(ArgValues[0]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (MatchOption(Arg, "--resume", &Value) && Value)
+        {
+            ResumeFileName = Value;
+        }
+        else if (MatchOption(Arg, "--no-image", &Value) && !Value)
+        {
+            DrawImage = false;
+        }
+        else if (MatchOption(Arg, "--batch", &Value) && !Value)
+        {
+            Batch = true;
+        }
+        else if (Arg[0] == '-')
+        {
+            PrintUsage(ArgValues[0]);
+            return EXIT_FAILURE;
+        }
+        else
+        {
+            NFAFileNames[NFAFileCount++] = Arg;
+        }
+    }
+
+    app_memory AppMemory = {};
+    // A snapshot to resume from takes the place of the files
+    if ((NFAFileCount == 0) != (ResumeFileName != NULL) || (Batch && ResumeFileName) ||
+        (!Batch && NFAFileCount > (int)ArrayCount(AppMemory.NFAFiles)))
+    {
+        PrintUsage(ArgValues[0]);
         return EXIT_FAILURE;
     }
-    char* NFAFile = ArgValues[1];
     
-    // Seed the randomness so that you can run multiple times if the
-    // initial positions didn't work out well
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    srand(ts.tv_nsec);
+    if (!SeedGiven)
+    {
+        // Seed the randomness so that you can run multiple times if the
+        // initial positions didn't work out well
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        Settings.Seed = (u32)ts.tv_nsec;
+    }
+    else if (Settings.SIMDLevel == SIMD_AUTO)
+    {
+        // The repulsion kernels add up their lanes in different orders, so
+        // an explicit seed also pins down the kernel to get the same layout on
+        // any machine. Every x86-64 CPU has SSE2.
+        Settings.SIMDLevel = SIMD_SSE2;
+    }
 
     app_input Input = {};
     Input.SimulateOnly = true;
     Input.Mouse.P = IV2(-5000,-5000);
     Input.dt = 1.0f / 30.0f; 
 
-    app_memory AppMemory = {};
-    AppMemory.PermanentSize = Megabytes(10);
-    AppMemory.TemporarySize = Megabytes(100);
-    AppMemory.PermanentBlock = mmap(0, AppMemory.PermanentSize + AppMemory.TemporarySize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    // Graphs grow as big as their files need, so reserve plenty of room and
+    // let the kernel only back the pages that actually get used
+    AppMemory.PermanentSize = Gigabytes(2);
+    AppMemory.TemporarySize = Gigabytes(8);
+    AppMemory.PermanentBlock = mmap(0, AppMemory.PermanentSize + AppMemory.TemporarySize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if (AppMemory.PermanentBlock == MAP_FAILED)
+    {
+        fprintf(stderr, "Couldn't reserve memory: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
     AppMemory.TemporaryBlock = (u8*)AppMemory.PermanentBlock + AppMemory.PermanentSize;
 
-    AppMemory.NFAFileCount = 1;
-    AppMemory.NFAFiles[0] = ReadFileIntoCString(ArgValues[1]);
+    AppMemory.Settings = Settings;
+
+    // The main thread also works on the queue while it waits for it to empty,
+    // so it counts as one of the threads.
+    ThreadCount = Min(Max(ThreadCount, 1), MAX_THREAD_COUNT);
+    platform_work_queue WorkQueue;
+    if (ThreadCount > 1)
+    {
+        InitializeWorkQueue(&WorkQueue, ThreadCount - 1);
+        AppMemory.WorkQueue = &WorkQueue;
+        AppMemory.AddWorkEntry = PosixAddWorkEntry;
+        AppMemory.CompleteAllWork = PosixCompleteAllWork;
+    }
+
+    AppMemory.IsInitialized = true;
+
+#if GRAPHGEN_PROFILE
+    GlobalProfile = AppMemory.Profile;
+    struct timespec ProfileStartTime;
+    clock_gettime(CLOCK_MONOTONIC, &ProfileStartTime);
+    u64 ProfileStartTicks = ProfileTicks();
+#endif
+    BEGIN_PROFILE(MAIN);
+
+    if (Batch)
+    {
+        int BatchResult = RunBatch(&AppMemory, NFAFileNames, NFAFileCount, Criteria, Input.dt);
+        END_PROFILE(MAIN);
+#if GRAPHGEN_PROFILE
+        PrintProfile(AppMemory.Profile, ProfileStartTicks, ProfileStartTime);
+#endif
+        return BatchResult;
+    }
+
+    // The graph is used straight out of the mapped snapshot, strings and all
+    if (ResumeFileName)
+    {
+        AppMemory.ResumeSnapshot = MapFile(ResumeFileName, &AppMemory.ResumeSnapshotSize);
+        if (!AppMemory.ResumeSnapshot)
+        {
+            fprintf(stderr, "Couldn't read %s: %s\n", ResumeFileName, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    AppMemory.NFAFileCount = NFAFileCount;
+    for (int FileIndex = 0; FileIndex < NFAFileCount; ++FileIndex)
+    {
+        AppMemory.NFAFiles[FileIndex] = ReadFileIntoCString(NFAFileNames[FileIndex]);
+    }
 
     //TODO(chronister): Paramaterize or bake into exe
     AppMemory.TTFFile = (u8*)ReadFileIntoCString("data/font.ttf");
 
-    AppMemory.IsInitialized = true;
+    // Without a seed no two runs lay the files out the same, so there is
+    // nothing to reuse. The metrics along the way need the simulation. A
+    // resumed layout has no files to key the cache on.
+    bool UseCache = (CacheDirectory != NULL && SeedGiven && !ResumeFileName);
+    u64 CacheKey = 0;
+    s32 CachedSteps = 0;
+    if (UseCache)
+    {
+        CacheKey = LayoutCacheKey(AppMemory.NFAFiles, NFAFileCount, &Settings, &Criteria, Input.dt);
+        if (MetricsInterval == 0)
+        {
+            AppMemory.Preset = ReadLayoutCache(CacheDirectory, CacheKey, &AppMemory.PresetCount, &CachedSteps);
+        }
+    }
     
     bitmap Buffer, Buffer2;
-    Buffer.Width = 1600;
-    Buffer.Height = 900;
+    Buffer.Width = OUTPUT_WIDTH;
+    Buffer.Height = OUTPUT_HEIGHT;
     Buffer.BytesPerPixel = 4;
     Buffer.Stride = Buffer.Width * 4;
     Buffer2 = Buffer;
     Buffer.Memory = mmap(0, Buffer.Stride*Buffer.Height, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
     Buffer2.Memory = mmap(0, Buffer.Stride*Buffer.Height, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
 
-    for (int i = 0; i < SIMULATION_ITERATIONS; ++i)
+    // Simulate until the layout either settles down or stops getting any
+    // calmer (some graphs jitter forever), then draw it with one final step.
+    // The settle_state lives in app_memory so that snapshots carry it along.
+    settle_state* Settle = &AppMemory.Settle;
+    if (AppMemory.Preset)
     {
-        if (i == SIMULATION_ITERATIONS - 1)
+        // Load the graph, without a step, to find out whether the cached
+        // layout fits it. The cached layout is the one drawn at the end, final
+        // step and all; one that doesn't fit counts as a miss.
+        Input.SkipSimulation = true;
+        UpdateAndRender(&AppMemory, &Buffer, &Input);
+        Input.SkipSimulation = false;
+        if (AppMemory.PresetApplied)
+        {
+            Settle->Steps = CachedSteps;
+            Settle->Finished = true;
+        }
+        else
         {
-            Input.SimulateOnly = false;
+            free(AppMemory.Preset);
+            AppMemory.Preset = NULL;
         }
+    }
+    else if (ResumeFileName)
+    {
+        // Load the snapshot, without a step, to find out how far along it is
+        Input.SkipSimulation = true;
         UpdateAndRender(&AppMemory, &Buffer, &Input);
+        Input.SkipSimulation = false;
+        if (AppMemory.Graph->NodeCount == 0)
+        {
+            fprintf(stderr, "%s isn't a snapshot of a layout\n", ResumeFileName);
+            return EXIT_FAILURE;
+        }
     }
 
+    BEGIN_PROFILE(LAYOUT_STEPS);
+    for (int i = Settle->Steps; i < Criteria.MaxIterations - 1 && !Settle->Finished; ++i)
+    {
+        Input.MeasureLayout = (MetricsInterval > 0 && (i + 1) % MetricsInterval == 0);
+        UpdateAndRender(&AppMemory, &Buffer, &Input);
+        if (Input.MeasureLayout) { PrintMetrics(i + 1, &AppMemory.Metrics); }
+        if (LayoutSettled(Settle, &Criteria, AppMemory.Stats)) { break; }
+        if (CheckpointFileName && (i + 1) % CheckpointInterval == 0)
+        {
+            WriteCheckpoint(&AppMemory, &Buffer, &Input, CheckpointFileName);
+        }
+    }
+    END_PROFILE(LAYOUT_STEPS);
+
+    BEGIN_PROFILE(FINAL_FRAME);
+    Input.SkipSimulation = Settle->Finished;
+    Input.SimulateOnly = !DrawImage;
+    Input.MeasureLayout = ReportMetrics;
+    UpdateAndRender(&AppMemory, &Buffer, &Input);
+    if (ReportMetrics) { PrintMetrics(Settle->Steps + 1, &AppMemory.Metrics); }
+    Settle->Finished = true;
+    END_PROFILE(FINAL_FRAME);
+
+    if (CheckpointFileName)
+    {
+        WriteCheckpoint(&AppMemory, &Buffer, &Input, CheckpointFileName);
+    }
+    if (UseCache && !AppMemory.Preset)
+    {
+        WriteLayoutCache(CacheDirectory, CacheKey, AppMemory.Graph, Settle->Steps);
+    }
+
+    if (!DrawImage)
+    {
+        END_PROFILE(MAIN);
+#if GRAPHGEN_PROFILE
+        PrintProfile(AppMemory.Profile, ProfileStartTicks, ProfileStartTime);
+#endif
+        return EXIT_SUCCESS;
+    }
+
+    BEGIN_PROFILE(PNG_ENCODE);
     FixBitmap(Buffer, Buffer2);
 
     int DirResult = mkdir("fsm", 0755);
@@ -125,14 +990,33 @@ int main (int ArgCount, char* ArgValues[])
         return EXIT_FAILURE;
     }
 
-    char* NFAFileName = NFAFile;
-    if ((NFAFileName = index(NFAFile, '/')) != NULL)
+    // The image is named after the file without its directories, and a
+    // snapshot's name without its extension as well
+    char* OutputName = ResumeFileName ? ResumeFileName : NFAFileNames[0];
+    char* LastSlash = strrchr(OutputName, '/');
+    if (LastSlash != NULL)
+    {
+        OutputName = LastSlash + 1;
+    }
+    int OutputNameLength = (int)strlen(OutputName);
+    char* Extension = strrchr(OutputName, '.');
+    if (ResumeFileName && Extension != NULL && Extension != OutputName)
     {
-        NFAFile = NFAFileName + 1;
+        OutputNameLength = (int)(Extension - OutputName);
     }
 
     char* Filename;
-    asprintf(&Filename, "fsm/%s.png", NFAFile);
+    asprintf(&Filename, "fsm/%.*s.png", OutputNameLength, OutputName);
     int ImageResult = stbi_write_png(Filename, Buffer.Width, Buffer.Height, 4, Buffer2.Memory, Buffer.Stride);
+    if (!ImageResult)
+    {
+        fprintf(stderr, "Couldn't write %s\n", Filename);
+        return EXIT_FAILURE;
+    }
+    END_PROFILE(PNG_ENCODE);
+    END_PROFILE(MAIN);
+#if GRAPHGEN_PROFILE
+    PrintProfile(AppMemory.Profile, ProfileStartTicks, ProfileStartTime);
+#endif
     return EXIT_SUCCESS;
 }
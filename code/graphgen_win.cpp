@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <assert.h>
+#include <intrin.h>
 #include "graphgen.h"
 #include "windows.h"
 #include "windowsx.h"
@@ -27,6 +29,102 @@ global_variable ivec2 GlobalMouseP;
 global_variable win32_offscreen_buffer GlobalBackbuffer;
 global_variable s64 GlobalPerfCountFrequency;
 
+struct platform_work_queue_entry
+{
+    platform_work_queue_callback* Callback;
+    void* Data;
+};
+
+/* Single-producer work queue: only the main thread adds entries, while the
+ * main thread and any number of workers take them. */
+struct platform_work_queue
+{
+    u32 volatile CompletionGoal;
+    u32 volatile CompletionCount;
+
+    u32 volatile NextEntryToWrite;
+    u32 volatile NextEntryToRead;
+    HANDLE SemaphoreHandle;
+
+    platform_work_queue_entry Entries[256];
+};
+
+internal
+PLATFORM_ADD_WORK_ENTRY(Win32AddWorkEntry)
+{
+    u32 NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % ArrayCount(Queue->Entries);
+    assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+
+    platform_work_queue_entry* Entry = Queue->Entries + Queue->NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    ++Queue->CompletionGoal;
+
+    // Make sure the entry is visible before the workers can see it's there
+    _WriteBarrier();
+    Queue->NextEntryToWrite = NewNextEntryToWrite;
+    ReleaseSemaphore(Queue->SemaphoreHandle, 1, 0);
+}
+
+/* Runs the next job in the queue, if any. Returns false if there was
+ * nothing to do. */
+internal bool
+Win32DoNextWorkEntry(platform_work_queue* Queue)
+{
+    u32 OriginalNextEntryToRead = Queue->NextEntryToRead;
+    if (OriginalNextEntryToRead == Queue->NextEntryToWrite) { return false; }
+
+    u32 NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ArrayCount(Queue->Entries);
+    u32 Index = (u32)InterlockedCompareExchange((LONG volatile*)&Queue->NextEntryToRead,
+                                                (LONG)NewNextEntryToRead, (LONG)OriginalNextEntryToRead);
+    if (Index == OriginalNextEntryToRead)
+    {
+        platform_work_queue_entry Entry = Queue->Entries[Index];
+        Entry.Callback(Entry.Data);
+        InterlockedIncrement((LONG volatile*)&Queue->CompletionCount);
+    }
+    return true;
+}
+
+internal
+PLATFORM_COMPLETE_ALL_WORK(Win32CompleteAllWork)
+{
+    while (Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        Win32DoNextWorkEntry(Queue);
+    }
+
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
+
+DWORD WINAPI
+WorkerThreadProc(LPVOID Parameter)
+{
+    platform_work_queue* Queue = (platform_work_queue*)Parameter;
+    for (;;)
+    {
+        if (!Win32DoNextWorkEntry(Queue))
+        {
+            WaitForSingleObjectEx(Queue->SemaphoreHandle, INFINITE, FALSE);
+        }
+    }
+}
+
+/* Starts WorkerCount threads servicing Queue. */
+internal void
+Win32InitializeWorkQueue(platform_work_queue* Queue, int WorkerCount)
+{
+    *Queue = {};
+    Queue->SemaphoreHandle = CreateSemaphoreEx(0, 0, WorkerCount, 0, 0, SEMAPHORE_ALL_ACCESS);
+
+    for (int WorkerIndex = 0; WorkerIndex < WorkerCount; ++WorkerIndex)
+    {
+        HANDLE Thread = CreateThread(0, 0, WorkerThreadProc, Queue, 0, 0);
+        CloseHandle(Thread);
+    }
+}
+
 internal void
 Win32GetEXEFileName(size_t EXEFileNameCapacity, char* EXEFileName, char** OnePastLastSlash)
 {
@@ -370,6 +468,9 @@ Win32ProcessPendingMessages(app_input* Input)
                     Message.wParam == VK_LEFT) {
                     Win32UpdateButtonState(&Input->ResetButton, true);
                 }
+                if (Message.wParam == 'R') {
+                    Win32UpdateButtonState(&Input->ReloadButton, true);
+                }
             } break;
 
             case WM_KEYUP:
@@ -379,6 +480,9 @@ Win32ProcessPendingMessages(app_input* Input)
                     Message.wParam == VK_LEFT) {
                     Win32UpdateButtonState(&Input->ResetButton, false);
                 }
+                if (Message.wParam == 'R') {
+                    Win32UpdateButtonState(&Input->ReloadButton, false);
+                }
             }
 
             default:
@@ -501,6 +605,21 @@ WinMain(HINSTANCE Instance,
             AppMemory.TemporarySize = Megabytes(100);
             AppMemory.PermanentBlock = VirtualAlloc((LPVOID)Terabytes(2), AppMemory.PermanentSize + AppMemory.TemporarySize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
             AppMemory.TemporaryBlock = (u8*)AppMemory.PermanentBlock + AppMemory.PermanentSize;
+            AppMemory.Settings = DefaultLayoutSettings();
+            AppMemory.Settings.Pipelined = true;
+
+            // One worker per other processor, if there are any
+            SYSTEM_INFO SystemInfo;
+            GetSystemInfo(&SystemInfo);
+            int WorkerCount = (int)SystemInfo.dwNumberOfProcessors - 1;
+            platform_work_queue WorkQueue;
+            if (WorkerCount > 0)
+            {
+                Win32InitializeWorkQueue(&WorkQueue, WorkerCount);
+                AppMemory.WorkQueue = &WorkQueue;
+                AppMemory.AddWorkEntry = Win32AddWorkEntry;
+                AppMemory.CompleteAllWork = Win32CompleteAllWork;
+            }
 
             if (AppMemory.PermanentBlock && AppMemory.TemporaryBlock) 
             {
@@ -537,10 +656,19 @@ WinMain(HINSTANCE Instance,
                         NewInput.Mouse.Buttons[MouseButton] = Win32PropagateButton(OldInput.Mouse.Buttons[MouseButton]);
                     }
                     NewInput.ResetButton = Win32PropagateButton(OldInput.ResetButton);
+                    NewInput.ReloadButton = Win32PropagateButton(OldInput.ReloadButton);
 
                     FILETIME NewDLLWriteTime = Win32GetFileModifiedTime(SourceDynamicCodeDLL);
                     if(CompareFileTime(&NewDLLWriteTime, &App.DLLLastWriteTime) != 0)
                     {
+                        // The pipelined simulation may still be running the
+                        // old code
+                        if (AppMemory.WorkQueue)
+                        {
+                            AppMemory.StopSimulation = true;
+                            Win32CompleteAllWork(AppMemory.WorkQueue);
+                            AppMemory.StopSimulation = false;
+                        }
                         Win32UnloadDynamicCode(&App);
                         App = Win32LoadDynamicCode(SourceDynamicCodeDLL,
                                                  TempDynamicCodeDLL,
@@ -557,6 +685,27 @@ WinMain(HINSTANCE Instance,
                         GlobalResized = false;
                     }
 
+                    // Pick up changes to the NFA files on disk. The old
+                    // contents are still referenced by the graph until the
+                    // app has matched the new one against it.
+                    char* OldNFAFiles[5] = {};
+                    int OldNFAFileCount = 0;
+                    if (NewInput.ReloadButton.IsPressed && !NewInput.ReloadButton.WasPressed)
+                    {
+                        OldNFAFileCount = AppMemory.NFAFileCount;
+                        for (int i = 0; i < OldNFAFileCount; ++i)
+                        {
+                            OldNFAFiles[i] = AppMemory.NFAFiles[i];
+                            free(Filenames[i]);
+                        }
+
+                        Win32DirectoryWildcardLimit5("data/*.nfa", &AppMemory.NFAFileCount, Filenames);
+                        for (int i = 0; i < AppMemory.NFAFileCount; ++i)
+                        {
+                            AppMemory.NFAFiles[i] = ReadFileIntoCString(Filenames[i]);
+                        }
+                    }
+
                     //TODO(chronister): Actual timing!
                     NewInput.dt = TargetSecondsPerFrame;
 
@@ -568,6 +717,11 @@ WinMain(HINSTANCE Instance,
                     Buffer.BytesPerPixel = GlobalBackbuffer.Pitch / GlobalBackbuffer.Width; 
                     App.UpdateAndRender(&AppMemory, &Buffer, &NewInput);
 
+                    for (int i = 0; i < OldNFAFileCount; ++i)
+                    {
+                        if (OldNFAFiles[i]) { VirtualFree(OldNFAFiles[i], 0, MEM_RELEASE); }
+                    }
+
                     LARGE_INTEGER WorkCounter = Win32GetWallClock();
                     f32 WorkSecondsElapsed = Win32GetSecondsElapsed(LastCounter, WorkCounter);
 
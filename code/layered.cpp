@@ -0,0 +1,518 @@
+#include <cstring>
+#include "layered.h"
+
+// Horizontal distance between layers, and vertical room taken by a state and
+// by a transition passing through a layer, in world units. Squeezed if the
+// graph wouldn't otherwise fit.
+#define LAYERED_LAYER_SPACING 5.0f
+#define LAYERED_ROW_SPACING 3.0f
+#define LAYERED_DUMMY_SPACING 1.0f
+// Number of sweeps over the layers (alternately left to right and back) for
+// the crossing reduction, and for the vertical positions
+#define LAYERED_ORDER_SWEEPS 24
+#define LAYERED_PLACE_SWEEPS 8
+
+/* The graph as laid out in layers. Its vertices are the states (with the same
+ * indices as in the graph) followed by a dummy vertex wherever a transition
+ * passes through a layer without stopping, so that every segment joins two
+ * adjacent layers. The vertices next to vertex i in the previous layer are
+ * Prev[PrevStart[i]] .. Prev[PrevStart[i+1]-1], and likewise for Next. */
+struct layered_graph
+{
+    s32 VertexCount;
+    s32 LayerCount;
+    // Layer of each vertex, or -1 for the nodes of the graph that aren't
+    // states (prestart and control nodes)
+    s32* Layer;
+    s32* PrevStart;
+    s32* Prev;
+    s32* NextStart;
+    s32* Next;
+    // The vertices of layer k, in order, are Order[LayerStart[k]] ..
+    // Order[LayerStart[k+1]-1]; Position is the inverse, counting from the
+    // start of each layer.
+    s32* LayerStart;
+    s32* Order;
+    s32* Position;
+};
+
+/* Fills in compressed lists of the Count items by Key: the items with key k
+ * are List[Start[k]] .. List[Start[k+1]-1], in increasing order. */
+internal void
+BuildLists(s32 KeyCount, s32 Count, s32* Key, s32* Start, s32* List)
+{
+    memset(Start, 0, (KeyCount + 1)*sizeof(s32));
+    for (s32 Index = 0; Index < Count; ++Index) { ++Start[Key[Index] + 1]; }
+    for (s32 KeyIndex = 0; KeyIndex < KeyCount; ++KeyIndex) { Start[KeyIndex + 1] += Start[KeyIndex]; }
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        // Start[k] is advanced past each item placed, then restored below
+        List[Start[Key[Index]]++] = Index;
+    }
+    for (s32 KeyIndex = KeyCount; KeyIndex > 0; --KeyIndex) { Start[KeyIndex] = Start[KeyIndex - 1]; }
+    Start[0] = 0;
+}
+
+/* Stable insertion sort of Count vertices by Key. Layers are narrow enough
+ * that this beats anything cleverer. */
+internal void
+SortVertices(s32* Vertices, s32 Count, f32* Key)
+{
+    for (s32 Index = 1; Index < Count; ++Index)
+    {
+        s32 Vertex = Vertices[Index];
+        s32 Position = Index;
+        while (Position > 0 && Key[Vertices[Position - 1]] > Key[Vertex])
+        {
+            Vertices[Position] = Vertices[Position - 1];
+            --Position;
+        }
+        Vertices[Position] = Vertex;
+    }
+}
+
+internal void
+UpdatePositions(layered_graph* Layered)
+{
+    for (s32 LayerIndex = 0; LayerIndex < Layered->LayerCount; ++LayerIndex)
+    {
+        s32 First = Layered->LayerStart[LayerIndex];
+        for (s32 Index = First; Index < Layered->LayerStart[LayerIndex + 1]; ++Index)
+        {
+            Layered->Position[Layered->Order[Index]] = Index - First;
+        }
+    }
+}
+
+/* Counts the pairs of segments that cross each other, layer by layer. The
+ * segments between two layers are visited in order of their left ends, and a
+ * Fenwick tree over the positions of the right ends already visited counts
+ * how many of them each new segment passes over. Tree needs room for one more
+ * entry than the widest layer has vertices. */
+internal s32
+CountCrossings(layered_graph* Layered, s32* Tree)
+{
+    s32 Crossings = 0;
+    for (s32 LayerIndex = 0; LayerIndex + 1 < Layered->LayerCount; ++LayerIndex)
+    {
+        s32 Width = Layered->LayerStart[LayerIndex + 2] - Layered->LayerStart[LayerIndex + 1];
+        memset(Tree, 0, (Width + 1)*sizeof(s32));
+        s32 Visited = 0;
+
+        for (s32 Index = Layered->LayerStart[LayerIndex]; Index < Layered->LayerStart[LayerIndex + 1]; ++Index)
+        {
+            s32 Vertex = Layered->Order[Index];
+            for (s32 Slot = Layered->NextStart[Vertex]; Slot < Layered->NextStart[Vertex + 1]; ++Slot)
+            {
+                s32 NotAfter = 0;
+                for (s32 Entry = Layered->Position[Layered->Next[Slot]] + 1; Entry > 0; Entry -= Entry & -Entry)
+                {
+                    NotAfter += Tree[Entry];
+                }
+                Crossings += Visited - NotAfter;
+            }
+            // Segments from the same vertex don't cross each other, so only
+            // add them once they've all been counted
+            for (s32 Slot = Layered->NextStart[Vertex]; Slot < Layered->NextStart[Vertex + 1]; ++Slot)
+            {
+                for (s32 Entry = Layered->Position[Layered->Next[Slot]] + 1; Entry <= Width; Entry += Entry & -Entry)
+                {
+                    ++Tree[Entry];
+                }
+                ++Visited;
+            }
+        }
+    }
+    return Crossings;
+}
+
+/* Reorders the vertices of every layer but the first of the sweep by the
+ * average position of their neighbours in the layer before it in the sweep
+ * (the barycenter heuristic). Vertices without any keep their position. */
+internal void
+BarycenterSweep(layered_graph* Layered, bool Forward, f32* Key)
+{
+    for (s32 Step = 1; Step < Layered->LayerCount; ++Step)
+    {
+        s32 LayerIndex = Forward ? Step : Layered->LayerCount - 1 - Step;
+        s32* Start = Forward ? Layered->PrevStart : Layered->NextStart;
+        s32* Neighbors = Forward ? Layered->Prev : Layered->Next;
+
+        s32 First = Layered->LayerStart[LayerIndex];
+        s32 Count = Layered->LayerStart[LayerIndex + 1] - First;
+        for (s32 Index = First; Index < First + Count; ++Index)
+        {
+            s32 Vertex = Layered->Order[Index];
+            f32 Sum = 0.0f;
+            for (s32 Slot = Start[Vertex]; Slot < Start[Vertex + 1]; ++Slot)
+            {
+                Sum += (f32)Layered->Position[Neighbors[Slot]];
+            }
+            s32 NeighborCount = Start[Vertex + 1] - Start[Vertex];
+            Key[Vertex] = (NeighborCount > 0) ? Sum / (f32)NeighborCount : (f32)(Index - First);
+        }
+
+        SortVertices(Layered->Order + First, Count, Key);
+        for (s32 Index = First; Index < First + Count; ++Index)
+        {
+            Layered->Position[Layered->Order[Index]] = Index - First;
+        }
+    }
+}
+
+/* Gives the Count vertices of a layer, in order, the positions closest (in
+ * the least-squares sense) to Desired that keep each vertex at least half
+ * the sum of their Sizes below the one before it. Taking the total of the gaps
+ * before each vertex off of its position turns this into isotonic regression,
+ * which pooling adjacent violators solves exactly. BlockSum and BlockCount
+ * need room for Count entries. */
+internal void
+PlaceLayer(s32* Vertices, s32 Count, f32* Desired, f32* Size, f32* Y,
+           f32* BlockSum, s32* BlockCount)
+{
+    s32 Blocks = 0;
+    f32 Offset = 0.0f;
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        if (Index > 0) { Offset += 0.5f*(Size[Vertices[Index - 1]] + Size[Vertices[Index]]); }
+        BlockSum[Blocks] = Desired[Vertices[Index]] - Offset;
+        BlockCount[Blocks] = 1;
+        ++Blocks;
+        while (Blocks > 1 &&
+               BlockSum[Blocks - 2]*(f32)BlockCount[Blocks - 1] > BlockSum[Blocks - 1]*(f32)BlockCount[Blocks - 2])
+        {
+            BlockSum[Blocks - 2] += BlockSum[Blocks - 1];
+            BlockCount[Blocks - 2] += BlockCount[Blocks - 1];
+            --Blocks;
+        }
+    }
+
+    s32 Index = 0;
+    Offset = 0.0f;
+    for (s32 Block = 0; Block < Blocks; ++Block)
+    {
+        f32 Mean = BlockSum[Block] / (f32)BlockCount[Block];
+        for (s32 Member = 0; Member < BlockCount[Block]; ++Member, ++Index)
+        {
+            if (Index > 0) { Offset += 0.5f*(Size[Vertices[Index - 1]] + Size[Vertices[Index]]); }
+            Y[Vertices[Index]] = Mean + Offset;
+        }
+    }
+}
+
+void
+LayeredLayout(memory_arena* Arena, graph* Graph, vec2 MinSide, vec2 MaxSide)
+{
+    s32 NodeCount = Graph->NodeCount;
+    if (NodeCount == 0) { return; }
+
+    temporary_memory LayeredMemory = BeginTemporaryMemory(Arena);
+
+    // The transitions between two different states; self-loops and the
+    // prestart arrows don't take part
+    bool* IsState = PushArray(Arena, NodeCount, bool);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        node_type Type = GetNodeType(Graph, (node_id)NodeIndex);
+        IsState[NodeIndex] = (Type != NODE_PRESTART && Type != NODE_CONTROL);
+    }
+    s32* From = PushArray(Arena, Graph->EdgeCount, s32);
+    s32* To = PushArray(Arena, Graph->EdgeCount, s32);
+    s32 EdgeCount = 0;
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        if (Edge->Source == Edge->Dest || !IsState[Edge->Source] || !IsState[Edge->Dest]) { continue; }
+        From[EdgeCount] = Edge->Source;
+        To[EdgeCount] = Edge->Dest;
+        ++EdgeCount;
+    }
+
+    // Break cycles by reversing every transition that leads back to a state
+    // still on the stack of a depth-first search from the start states (and
+    // then from whatever they don't reach). The order states are discovered
+    // in is also the initial order within the layers.
+    s32* OutStart = PushArray(Arena, NodeCount + 1, s32);
+    s32* OutEdges = PushArray(Arena, Max(EdgeCount, 1), s32);
+    BuildLists(NodeCount, EdgeCount, From, OutStart, OutEdges);
+
+    s32* Discovery = PushArray(Arena, NodeCount, s32);
+    u8* OnStack = PushArray(Arena, NodeCount, u8);
+    s32* StackNode = PushArray(Arena, NodeCount, s32);
+    s32* StackSlot = PushArray(Arena, NodeCount, s32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Discovery[NodeIndex] = -1;
+        OnStack[NodeIndex] = 0;
+    }
+    s32 DiscoveredCount = 0;
+    for (s32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (s32 RootIndex = 0; RootIndex < NodeCount; ++RootIndex)
+        {
+            bool IsStart = (GetNodeType(Graph, (node_id)RootIndex) == NODE_START);
+            if (!IsState[RootIndex] || Discovery[RootIndex] != -1 || (Pass == 0 && !IsStart)) { continue; }
+
+            s32 Depth = 0;
+            Discovery[RootIndex] = DiscoveredCount++;
+            OnStack[RootIndex] = 1;
+            StackNode[Depth] = RootIndex;
+            StackSlot[Depth] = OutStart[RootIndex];
+            ++Depth;
+            while (Depth > 0)
+            {
+                s32 Node = StackNode[Depth - 1];
+                if (StackSlot[Depth - 1] == OutStart[Node + 1])
+                {
+                    OnStack[Node] = 0;
+                    --Depth;
+                    continue;
+                }
+
+                s32 Edge = OutEdges[StackSlot[Depth - 1]++];
+                s32 Target = To[Edge];
+                if (OnStack[Target])
+                {
+                    To[Edge] = From[Edge];
+                    From[Edge] = Target;
+                }
+                else if (Discovery[Target] == -1)
+                {
+                    Discovery[Target] = DiscoveredCount++;
+                    OnStack[Target] = 1;
+                    StackNode[Depth] = Target;
+                    StackSlot[Depth] = OutStart[Target];
+                    ++Depth;
+                }
+            }
+        }
+    }
+
+    // Longest-path layering: every state goes one layer to the right of the
+    // furthest of its predecessors, visited in topological order. States with
+    // no predecessors other than the start states are then pulled right up to
+    // their nearest successor, rather than being left over in the first layer.
+    BuildLists(NodeCount, EdgeCount, From, OutStart, OutEdges);
+    s32* Layer = PushArray(Arena, NodeCount, s32);
+    s32* InCount = PushArray(Arena, NodeCount, s32);
+    s32* Queue = PushArray(Arena, NodeCount, s32);
+    memset(InCount, 0, NodeCount*sizeof(s32));
+    for (s32 Edge = 0; Edge < EdgeCount; ++Edge) { ++InCount[To[Edge]]; }
+    s32 QueueRead = 0;
+    s32 QueueWrite = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Layer[NodeIndex] = IsState[NodeIndex] ? 0 : -1;
+        if (IsState[NodeIndex] && InCount[NodeIndex] == 0) { Queue[QueueWrite++] = NodeIndex; }
+    }
+    s32 SourceCount = QueueWrite;
+    while (QueueRead < QueueWrite)
+    {
+        s32 Node = Queue[QueueRead++];
+        for (s32 Slot = OutStart[Node]; Slot < OutStart[Node + 1]; ++Slot)
+        {
+            s32 Target = To[OutEdges[Slot]];
+            Layer[Target] = Max(Layer[Target], Layer[Node] + 1);
+            if (--InCount[Target] == 0) { Queue[QueueWrite++] = Target; }
+        }
+    }
+    for (s32 SourceIndex = 0; SourceIndex < SourceCount; ++SourceIndex)
+    {
+        s32 Node = Queue[SourceIndex];
+        if (GetNodeType(Graph, (node_id)Node) == NODE_START || OutStart[Node] == OutStart[Node + 1]) { continue; }
+        s32 Nearest = Layer[To[OutEdges[OutStart[Node]]]];
+        for (s32 Slot = OutStart[Node]; Slot < OutStart[Node + 1]; ++Slot)
+        {
+            Nearest = Min(Nearest, Layer[To[OutEdges[Slot]]]);
+        }
+        Layer[Node] = Nearest - 1;
+    }
+
+    // Split transitions spanning several layers into one segment per layer
+    layered_graph Layered = {};
+    s32 DummyCount = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Layered.LayerCount = Max(Layered.LayerCount, Layer[NodeIndex] + 1);
+    }
+    for (s32 Edge = 0; Edge < EdgeCount; ++Edge) { DummyCount += Layer[To[Edge]] - Layer[From[Edge]] - 1; }
+    s32 VertexCount = NodeCount + DummyCount;
+    s32 SegmentCount = EdgeCount + DummyCount;
+    Layered.VertexCount = VertexCount;
+    Layered.Layer = PushArray(Arena, VertexCount, s32);
+    f32* Key = PushArray(Arena, VertexCount, f32);
+    f32* Size = PushArray(Arena, VertexCount, f32);
+    s32* SegmentFrom = PushArray(Arena, Max(SegmentCount, 1), s32);
+    s32* SegmentTo = PushArray(Arena, Max(SegmentCount, 1), s32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Layered.Layer[NodeIndex] = Layer[NodeIndex];
+        Key[NodeIndex] = (f32)Discovery[NodeIndex];
+        Size[NodeIndex] = LAYERED_ROW_SPACING;
+    }
+    s32 NextVertex = NodeCount;
+    s32 NextSegment = 0;
+    for (s32 Edge = 0; Edge < EdgeCount; ++Edge)
+    {
+        s32 Previous = From[Edge];
+        for (s32 LayerIndex = Layer[From[Edge]] + 1; LayerIndex < Layer[To[Edge]]; ++LayerIndex)
+        {
+            s32 Dummy = NextVertex++;
+            Layered.Layer[Dummy] = LayerIndex;
+            Key[Dummy] = (f32)Discovery[From[Edge]] + 0.5f;
+            Size[Dummy] = LAYERED_DUMMY_SPACING;
+            SegmentFrom[NextSegment] = Previous;
+            SegmentTo[NextSegment] = Dummy;
+            ++NextSegment;
+            Previous = Dummy;
+        }
+        SegmentFrom[NextSegment] = Previous;
+        SegmentTo[NextSegment] = To[Edge];
+        ++NextSegment;
+    }
+
+    s32* SegmentList = PushArray(Arena, Max(SegmentCount, 1), s32);
+    Layered.PrevStart = PushArray(Arena, VertexCount + 1, s32);
+    Layered.Prev = PushArray(Arena, Max(SegmentCount, 1), s32);
+    BuildLists(VertexCount, SegmentCount, SegmentTo, Layered.PrevStart, SegmentList);
+    for (s32 Slot = 0; Slot < SegmentCount; ++Slot) { Layered.Prev[Slot] = SegmentFrom[SegmentList[Slot]]; }
+    Layered.NextStart = PushArray(Arena, VertexCount + 1, s32);
+    Layered.Next = PushArray(Arena, Max(SegmentCount, 1), s32);
+    BuildLists(VertexCount, SegmentCount, SegmentFrom, Layered.NextStart, SegmentList);
+    for (s32 Slot = 0; Slot < SegmentCount; ++Slot) { Layered.Next[Slot] = SegmentTo[SegmentList[Slot]]; }
+
+    // Sort the vertices into their layers, in order of discovery
+    s32 LayeredCount = 0;
+    s32* LayerOf = PushArray(Arena, VertexCount, s32);
+    for (s32 Vertex = 0; Vertex < VertexCount; ++Vertex)
+    {
+        if (Layered.Layer[Vertex] >= 0) { LayerOf[LayeredCount++] = Vertex; }
+    }
+    s32* LayerList = PushArray(Arena, LayeredCount, s32);
+    for (s32 Index = 0; Index < LayeredCount; ++Index) { LayerList[Index] = Layered.Layer[LayerOf[Index]]; }
+    Layered.LayerStart = PushArray(Arena, Layered.LayerCount + 1, s32);
+    Layered.Order = PushArray(Arena, LayeredCount, s32);
+    BuildLists(Layered.LayerCount, LayeredCount, LayerList, Layered.LayerStart, Layered.Order);
+    s32 MaxWidth = 0;
+    for (s32 LayerIndex = 0; LayerIndex < Layered.LayerCount; ++LayerIndex)
+    {
+        s32 First = Layered.LayerStart[LayerIndex];
+        s32 Count = Layered.LayerStart[LayerIndex + 1] - First;
+        for (s32 Index = First; Index < First + Count; ++Index)
+        {
+            Layered.Order[Index] = LayerOf[Layered.Order[Index]];
+        }
+        SortVertices(Layered.Order + First, Count, Key);
+        MaxWidth = Max(MaxWidth, Count);
+    }
+    Layered.Position = PushArray(Arena, VertexCount, s32);
+    UpdatePositions(&Layered);
+
+    // Crossing reduction, keeping whichever order had the fewest crossings
+    s32* Tree = PushArray(Arena, MaxWidth + 1, s32);
+    s32* BestOrder = PushArray(Arena, LayeredCount, s32);
+    memcpy(BestOrder, Layered.Order, LayeredCount*sizeof(s32));
+    s32 BestCrossings = CountCrossings(&Layered, Tree);
+    for (s32 Sweep = 0; Sweep < LAYERED_ORDER_SWEEPS && BestCrossings > 0; ++Sweep)
+    {
+        BarycenterSweep(&Layered, (Sweep % 2) == 0, Key);
+        s32 Crossings = CountCrossings(&Layered, Tree);
+        if (Crossings < BestCrossings)
+        {
+            BestCrossings = Crossings;
+            memcpy(BestOrder, Layered.Order, LayeredCount*sizeof(s32));
+        }
+    }
+    memcpy(Layered.Order, BestOrder, LayeredCount*sizeof(s32));
+    UpdatePositions(&Layered);
+
+    // Vertical positions: starting from each layer stacked up around the
+    // middle, repeatedly move every vertex as close to the average of its
+    // neighbours as the order and spacing of its layer allow
+    f32* Y = PushArray(Arena, VertexCount, f32);
+    f32* Desired = Key;
+    f32* BlockSum = PushArray(Arena, MaxWidth, f32);
+    s32* BlockCount = PushArray(Arena, MaxWidth, s32);
+    for (s32 LayerIndex = 0; LayerIndex < Layered.LayerCount; ++LayerIndex)
+    {
+        s32 First = Layered.LayerStart[LayerIndex];
+        s32 Count = Layered.LayerStart[LayerIndex + 1] - First;
+        for (s32 Index = First; Index < First + Count; ++Index) { Desired[Layered.Order[Index]] = 0.0f; }
+        PlaceLayer(Layered.Order + First, Count, Desired, Size, Y, BlockSum, BlockCount);
+    }
+    for (s32 Sweep = 0; Sweep < LAYERED_PLACE_SWEEPS; ++Sweep)
+    {
+        bool Forward = (Sweep % 2) == 0;
+        for (s32 Step = 0; Step < Layered.LayerCount; ++Step)
+        {
+            s32 LayerIndex = Forward ? Step : Layered.LayerCount - 1 - Step;
+            s32 First = Layered.LayerStart[LayerIndex];
+            s32 Count = Layered.LayerStart[LayerIndex + 1] - First;
+            for (s32 Index = First; Index < First + Count; ++Index)
+            {
+                s32 Vertex = Layered.Order[Index];
+                f32 Sum = 0.0f;
+                for (s32 Slot = Layered.PrevStart[Vertex]; Slot < Layered.PrevStart[Vertex + 1]; ++Slot)
+                {
+                    Sum += Y[Layered.Prev[Slot]];
+                }
+                for (s32 Slot = Layered.NextStart[Vertex]; Slot < Layered.NextStart[Vertex + 1]; ++Slot)
+                {
+                    Sum += Y[Layered.Next[Slot]];
+                }
+                s32 NeighborCount = (Layered.PrevStart[Vertex + 1] - Layered.PrevStart[Vertex] +
+                                     Layered.NextStart[Vertex + 1] - Layered.NextStart[Vertex]);
+                Desired[Vertex] = (NeighborCount > 0) ? Sum / (f32)NeighborCount : Y[Vertex];
+            }
+            PlaceLayer(Layered.Order + First, Count, Desired, Size, Y, BlockSum, BlockCount);
+        }
+    }
+
+    // Fit the layers (plus half a layer on the left for the prestart nodes)
+    // into the space, squeezing whichever direction doesn't fit
+    f32 Top = 0.0f;
+    f32 Bottom = 0.0f;
+    for (s32 Index = 0; Index < LayeredCount; ++Index)
+    {
+        s32 Vertex = Layered.Order[Index];
+        Top = (Index == 0) ? Y[Vertex] : Min(Top, Y[Vertex]);
+        Bottom = (Index == 0) ? Y[Vertex] : Max(Bottom, Y[Vertex]);
+    }
+    vec2 Room = 0.9f*(MaxSide - MinSide);
+    f32 Width = ((f32)(Layered.LayerCount - 1) + 0.5f)*LAYERED_LAYER_SPACING;
+    f32 ScaleX = Min(1.0f, SafeRatioN(Room.x, Width, 1.0f));
+    f32 ScaleY = Min(1.0f, SafeRatioN(Room.y, Bottom - Top, 1.0f));
+    vec2 Center = 0.5f*(MinSide + MaxSide);
+    f32 LeftX = Center.x - 0.5f*ScaleX*Width + 0.5f*ScaleX*LAYERED_LAYER_SPACING;
+    f32 MiddleY = 0.5f*(Top + Bottom);
+
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        SetNodedP(Graph, (node_id)NodeIndex, V2(0.0f, 0.0f));
+        if (!IsState[NodeIndex])
+        {
+            SetNodeP(Graph, (node_id)NodeIndex, Center);
+            continue;
+        }
+        // The first vertex of a layer goes at the top
+        vec2 P = V2(LeftX + ScaleX*LAYERED_LAYER_SPACING*(f32)Layer[NodeIndex],
+                    Center.y - ScaleY*(Y[NodeIndex] - MiddleY));
+        SetNodeP(Graph, (node_id)NodeIndex, P);
+    }
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        if (GetNodeType(Graph, Edge->Source) == NODE_PRESTART)
+        {
+            vec2 StartP = GetNodeP(Graph, Edge->Dest);
+            SetNodeP(Graph, Edge->Source, StartP - V2(0.5f*ScaleX*LAYERED_LAYER_SPACING, 0.0f));
+        }
+        else if (Edge->Source == Edge->Dest && GetNodeType(Graph, Edge->Control) == NODE_CONTROL)
+        {
+            vec2 StateP = GetNodeP(Graph, Edge->Source);
+            SetNodeP(Graph, Edge->Control, StateP + V2(0.0f, 0.5f*ScaleY*LAYERED_ROW_SPACING));
+        }
+    }
+
+    EndTemporaryMemory(LayeredMemory);
+}
@@ -0,0 +1,28 @@
+/* layered.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Layered ("Sugiyama") layout, the left-to-right arrangement automata are
+ * usually drawn in. The graph is made acyclic by reversing the transitions
+ * that lead back towards the start state, every state is assigned a column
+ * (layer) to the right of everything that leads into it, the states within
+ * each column are ordered to reduce the number of crossing transitions, and
+ * finally given vertical positions close to those of their neighbours.
+ *
+ * Unlike the force simulation this is deterministic, takes a single pass
+ * instead of hundreds of steps, and gives DFAs and mostly-acyclic NFAs a
+ * shape that the simulation would only approximate. Dense graphs with many
+ * cycles don't look as good this way.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* Overwrites the positions of every node in Graph with a layered layout,
+ * running left to right from the start states, fitted within the rectangle
+ * from MinSide to MaxSide, and brings them to rest. Prestart nodes are put
+ * just left of their start state, and the control points of self-loops just
+ * above their state. Scratch memory is taken from Arena and released before
+ * returning. */
+extern void
+LayeredLayout(memory_arena* Arena, graph* Graph, vec2 MinSide, vec2 MaxSide);
@@ -157,7 +157,7 @@ Clamp0_255(int A) {
 //
 
 #define PI 3.141592653589793238462643383279502
-#define PI32 (float32)PI
+#define PI32 (f32)PI
 #define SQRT2 1.4142135623730950488016887242097
 #define SQRT3 1.7320508075688772935274463415059
 #define INV_SQRT2 0.70710678118654752440084436210485
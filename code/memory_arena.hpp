@@ -90,6 +90,13 @@ PushSize_(memory_arena *Arena, memory_index Size)
     return(Result);
 }
 
+/* Returns the number of bytes that can still be pushed onto the arena. */
+inline memory_index
+GetArenaSizeRemaining(memory_arena* Arena)
+{
+    return Arena->Size - Arena->Used;
+}
+
 /* Begins a temporary_memory transaction, returning a struct representing the
  * state of the memory at the start of the transaction. */
 inline temporary_memory
@@ -0,0 +1,423 @@
+#include <cmath>
+#include <cstring>
+#include "metrics.h"
+
+// Height of the transition labels, and distance of a self-loop's label from
+// its state, as drawn by DrawGraph
+#define METRICS_LABEL_HEIGHT 0.6f
+#define METRICS_LOOP_LABEL_DISTANCE 1.8f
+
+/* Something that takes up room in the drawing: a state, or a label. */
+struct metrics_item
+{
+    vec2 Center;
+    vec2 HalfSize;
+    bool IsLabel;
+};
+
+/* Uniform grid over a set of items (segments, or boxes), each filed in every
+ * cell it touches, for finding the pairs of items that might meet without
+ * comparing every pair. Cell (X, Y) is number Y*Width + X. */
+struct metrics_grid
+{
+    vec2 Origin;
+    f32 InvCellSize;
+    s32 Width;
+    s32 Height;
+
+    // The cells item i touches are Cells[ItemStart[i]] .. Cells[ItemStart[i+1]-1]
+    s32* ItemStart;
+    s32* Cells;
+    // The items touching cell c are Items[CellStart[c]] .. Items[CellStart[c+1]-1],
+    // in increasing order
+    s32* CellStart;
+    s32* Items;
+};
+
+/* Returns the column (or row) of Grid that the coordinate Value falls in, out
+ * of Count, clamped to the grid. */
+inline s32
+GridCoordinate(metrics_grid* Grid, f32 Value, f32 Origin, s32 Count)
+{
+    f32 Cell = floorf((Value - Origin)*Grid->InvCellSize);
+    return (s32)Clamp(0.0f, Cell, (f32)(Count - 1));
+}
+
+/* Writes the cells of Grid that the item from Ends[0] to Ends[1] touches to
+ * Cells (if it isn't NULL), and returns how many there are. A segment touches
+ * every cell it passes through, corners included; a box (given by its lowest
+ * and highest corners) every cell it covers. */
+internal s32
+ItemCells(metrics_grid* Grid, vec2* Ends, bool IsSegment, s32* Cells)
+{
+    vec2 Lowest = V2(Min(Ends[0].x, Ends[1].x), Min(Ends[0].y, Ends[1].y));
+    vec2 Highest = V2(Max(Ends[0].x, Ends[1].x), Max(Ends[0].y, Ends[1].y));
+    s32 FirstColumn = GridCoordinate(Grid, Lowest.x, Grid->Origin.x, Grid->Width);
+    s32 LastColumn = GridCoordinate(Grid, Highest.x, Grid->Origin.x, Grid->Width);
+
+    s32 Count = 0;
+    for (s32 Column = FirstColumn; Column <= LastColumn; ++Column)
+    {
+        // The rows the item spans within this column: all of them for a box,
+        // and for a segment those between its heights at the column's sides
+        f32 Bottom = Lowest.y;
+        f32 Top = Highest.y;
+        if (IsSegment && Ends[0].x != Ends[1].x)
+        {
+            f32 CellSize = 1.0f / Grid->InvCellSize;
+            f32 Left = Max(Lowest.x, Grid->Origin.x + (f32)Column*CellSize);
+            f32 Right = Min(Highest.x, Grid->Origin.x + (f32)(Column + 1)*CellSize);
+            f32 Slope = (Ends[1].y - Ends[0].y) / (Ends[1].x - Ends[0].x);
+            f32 LeftY = Ends[0].y + Slope*(Left - Ends[0].x);
+            f32 RightY = Ends[0].y + Slope*(Right - Ends[0].x);
+            // Widened a little so that rounding can't lose a cell
+            f32 Slack = 1e-3f*CellSize;
+            Bottom = Max(Lowest.y, Min(LeftY, RightY) - Slack);
+            Top = Min(Highest.y, Max(LeftY, RightY) + Slack);
+        }
+
+        s32 FirstRow = GridCoordinate(Grid, Bottom, Grid->Origin.y, Grid->Height);
+        s32 LastRow = GridCoordinate(Grid, Top, Grid->Origin.y, Grid->Height);
+        for (s32 Row = FirstRow; Row <= LastRow; ++Row)
+        {
+            if (Cells) { Cells[Count] = Row*Grid->Width + Column; }
+            ++Count;
+        }
+    }
+    return Count;
+}
+
+/* Builds a grid over the Count items whose ends are Ends[2*i] and
+ * Ends[2*i + 1], all segments or all boxes, out of Arena. The cells are about
+ * as big as the items are on average, but never so small that there are more
+ * cells than items. */
+internal metrics_grid
+BuildMetricsGrid(memory_arena* Arena, s32 Count, vec2* Ends, bool IsSegments)
+{
+    metrics_grid Grid = {};
+    vec2 Lowest = Ends[0];
+    vec2 Highest = Ends[0];
+    f32 ExtentSum = 0.0f;
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        vec2 A = Ends[2*Index];
+        vec2 B = Ends[2*Index + 1];
+        Lowest = V2(Min(Lowest.x, Min(A.x, B.x)), Min(Lowest.y, Min(A.y, B.y)));
+        Highest = V2(Max(Highest.x, Max(A.x, B.x)), Max(Highest.y, Max(A.y, B.y)));
+        ExtentSum += Max(fabsf(B.x - A.x), fabsf(B.y - A.y));
+    }
+
+    vec2 Size = Highest - Lowest;
+    f32 CellSize = Max(ExtentSum / (f32)Max(Count, 1), Max(Size.x, Size.y) / sqrtf((f32)Max(Count, 1)));
+    if (!(CellSize > 0.0f)) { CellSize = 1.0f; }
+    Grid.Origin = Lowest;
+    Grid.InvCellSize = 1.0f / CellSize;
+    Grid.Width = (s32)(Size.x*Grid.InvCellSize) + 1;
+    Grid.Height = (s32)(Size.y*Grid.InvCellSize) + 1;
+
+    Grid.ItemStart = PushArray(Arena, Count + 1, s32);
+    Grid.ItemStart[0] = 0;
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        Grid.ItemStart[Index + 1] = Grid.ItemStart[Index] + ItemCells(&Grid, Ends + 2*Index, IsSegments, NULL);
+    }
+    s32 EntryCount = Grid.ItemStart[Count];
+    Grid.Cells = PushArray(Arena, Max(EntryCount, 1), s32);
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        ItemCells(&Grid, Ends + 2*Index, IsSegments, Grid.Cells + Grid.ItemStart[Index]);
+    }
+
+    // Counting sort of the entries by cell, which leaves each cell's items in
+    // increasing order
+    s32 CellCount = Grid.Width*Grid.Height;
+    Grid.CellStart = PushArray(Arena, CellCount + 1, s32);
+    memset(Grid.CellStart, 0, (CellCount + 1)*sizeof(s32));
+    for (s32 Entry = 0; Entry < EntryCount; ++Entry) { ++Grid.CellStart[Grid.Cells[Entry] + 1]; }
+    for (s32 Cell = 0; Cell < CellCount; ++Cell) { Grid.CellStart[Cell + 1] += Grid.CellStart[Cell]; }
+    Grid.Items = PushArray(Arena, Max(EntryCount, 1), s32);
+    s32* Cursor = PushArray(Arena, CellCount, s32);
+    memcpy(Cursor, Grid.CellStart, CellCount*sizeof(s32));
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        for (s32 Entry = Grid.ItemStart[Index]; Entry < Grid.ItemStart[Index + 1]; ++Entry)
+        {
+            Grid.Items[Cursor[Grid.Cells[Entry]]++] = Index;
+        }
+    }
+    return Grid;
+}
+
+/* Writes to Others the items of Grid after Item that share a cell with it,
+ * each once, and returns how many there are. LastSeen has an entry per item,
+ * -1 before the first call, and Others room for every item. */
+internal s32
+GridNeighbors(metrics_grid* Grid, s32 Item, s32* LastSeen, s32* Others)
+{
+    s32 Count = 0;
+    for (s32 Entry = Grid->ItemStart[Item]; Entry < Grid->ItemStart[Item + 1]; ++Entry)
+    {
+        s32 Cell = Grid->Cells[Entry];
+        for (s32 Slot = Grid->CellStart[Cell + 1] - 1; Slot >= Grid->CellStart[Cell]; --Slot)
+        {
+            s32 Other = Grid->Items[Slot];
+            if (Other <= Item) { break; }
+            if (LastSeen[Other] == Item) { continue; }
+            LastSeen[Other] = Item;
+            Others[Count++] = Other;
+        }
+    }
+    return Count;
+}
+
+/* Whether Edge is drawn as an arrow between two different states, rather than
+ * as a self-loop or as the arrow into a start state. The two halves of a
+ * bidirectional pair are drawn on top of each other, so only one counts. */
+internal bool
+IsTransitionArrow(graph* Graph, graph_edge* Edge)
+{
+    return (Edge->Source != Edge->Dest && !Edge->HalfBidirectional &&
+            GetNodeType(Graph, Edge->Source) != NODE_PRESTART);
+}
+
+inline f32
+Wedge(vec2 A, vec2 B)
+{
+    return A.x*B.y - A.y*B.x;
+}
+
+/* Whether the segments P1-P2 and Q1-Q2 cross at a single point strictly
+ * inside both of them. */
+internal bool
+SegmentsCross(vec2 P1, vec2 P2, vec2 Q1, vec2 Q2)
+{
+    f32 SideP1 = Wedge(Q2 - Q1, P1 - Q1);
+    f32 SideP2 = Wedge(Q2 - Q1, P2 - Q1);
+    f32 SideQ1 = Wedge(P2 - P1, Q1 - P1);
+    f32 SideQ2 = Wedge(P2 - P1, Q2 - P1);
+    return (SideP1*SideP2 < 0.0f && SideQ1*SideQ2 < 0.0f);
+}
+
+internal s32
+CountEdgeCrossings(memory_arena* Arena, graph* Graph, s32 ArrowCount, s32* Arrows)
+{
+    if (ArrowCount < 2) { return 0; }
+
+    vec2* Ends = PushArray(Arena, 2*ArrowCount, vec2);
+    for (s32 Index = 0; Index < ArrowCount; ++Index)
+    {
+        graph_edge* Edge = Graph->Edges + Arrows[Index];
+        Ends[2*Index] = GetNodeP(Graph, Edge->Source);
+        Ends[2*Index + 1] = GetNodeP(Graph, Edge->Dest);
+    }
+    metrics_grid Grid = BuildMetricsGrid(Arena, ArrowCount, Ends, true);
+    s32* LastSeen = PushArray(Arena, ArrowCount, s32);
+    s32* Others = PushArray(Arena, ArrowCount, s32);
+    for (s32 Index = 0; Index < ArrowCount; ++Index) { LastSeen[Index] = -1; }
+
+    s32 Crossings = 0;
+    for (s32 Index = 0; Index < ArrowCount; ++Index)
+    {
+        graph_edge* Edge = Graph->Edges + Arrows[Index];
+        s32 OtherCount = GridNeighbors(&Grid, Index, LastSeen, Others);
+        for (s32 OtherIndex = 0; OtherIndex < OtherCount; ++OtherIndex)
+        {
+            s32 Other = Others[OtherIndex];
+
+            // Arrows that share a state meet there, which isn't a crossing
+            graph_edge* OtherEdge = Graph->Edges + Arrows[Other];
+            if (OtherEdge->Source == Edge->Source || OtherEdge->Source == Edge->Dest ||
+                OtherEdge->Dest == Edge->Source || OtherEdge->Dest == Edge->Dest)
+            {
+                continue;
+            }
+            if (SegmentsCross(Ends[2*Index], Ends[2*Index + 1], Ends[2*Other], Ends[2*Other + 1]))
+            {
+                ++Crossings;
+            }
+        }
+    }
+    return Crossings;
+}
+
+/* Counts the overlapping pairs of states into NodeOverlaps, and the pairs
+ * involving a label into LabelOverlaps. */
+internal void
+CountOverlaps(memory_arena* Arena, s32 ItemCount, metrics_item* Items, f32 NodeRadius,
+              layout_metrics* Metrics)
+{
+    if (ItemCount < 2) { return; }
+
+    vec2* Ends = PushArray(Arena, 2*ItemCount, vec2);
+    for (s32 Index = 0; Index < ItemCount; ++Index)
+    {
+        Ends[2*Index] = Items[Index].Center - Items[Index].HalfSize;
+        Ends[2*Index + 1] = Items[Index].Center + Items[Index].HalfSize;
+    }
+    metrics_grid Grid = BuildMetricsGrid(Arena, ItemCount, Ends, false);
+    s32* LastSeen = PushArray(Arena, ItemCount, s32);
+    s32* Others = PushArray(Arena, ItemCount, s32);
+    for (s32 Index = 0; Index < ItemCount; ++Index) { LastSeen[Index] = -1; }
+
+    for (s32 Index = 0; Index < ItemCount; ++Index)
+    {
+        metrics_item* Item = Items + Index;
+        s32 OtherCount = GridNeighbors(&Grid, Index, LastSeen, Others);
+        for (s32 OtherIndex = 0; OtherIndex < OtherCount; ++OtherIndex)
+        {
+            metrics_item* Other = Items + Others[OtherIndex];
+            vec2 Diff = Item->Center - Other->Center;
+            if (!Item->IsLabel && !Other->IsLabel)
+            {
+                if (Inner(Diff, Diff) < Square(2.0f*NodeRadius)) { ++Metrics->NodeOverlaps; }
+            }
+            else if (Item->IsLabel && Other->IsLabel)
+            {
+                if (fabsf(Diff.x) < Item->HalfSize.x + Other->HalfSize.x &&
+                    fabsf(Diff.y) < Item->HalfSize.y + Other->HalfSize.y)
+                {
+                    ++Metrics->LabelOverlaps;
+                }
+            }
+            else
+            {
+                // Distance from the state to the nearest point of the label
+                metrics_item* Label = Item->IsLabel ? Item : Other;
+                metrics_item* State = Item->IsLabel ? Other : Item;
+                vec2 Offset = State->Center - Label->Center;
+                vec2 Outside = V2(Max(fabsf(Offset.x) - Label->HalfSize.x, 0.0f),
+                                  Max(fabsf(Offset.y) - Label->HalfSize.y, 0.0f));
+                if (Inner(Outside, Outside) < Square(NodeRadius)) { ++Metrics->LabelOverlaps; }
+            }
+        }
+    }
+}
+
+layout_metrics
+MeasureLayout(memory_arena* Arena, graph* Graph, f32 NodeRadius)
+{
+    layout_metrics Metrics = {};
+    Metrics.MinAngle = 2.0f*PI32;
+    Metrics.AngularResolution = 1.0f;
+    s32 NodeCount = Graph->NodeCount;
+    if (NodeCount == 0) { return Metrics; }
+
+    temporary_memory MetricsMemory = BeginTemporaryMemory(Arena);
+
+    s32* Arrows = PushArray(Arena, Max((s32)Graph->EdgeCount, 1), s32);
+    s32 ArrowCount = 0;
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        if (IsTransitionArrow(Graph, Graph->Edges + EdgeIndex)) { Arrows[ArrowCount++] = EdgeIndex; }
+    }
+
+    Metrics.EdgeCrossings = CountEdgeCrossings(Arena, Graph, ArrowCount, Arrows);
+
+    // States and labels, placed as in DrawGraph
+    metrics_item* Items = PushArray(Arena, NodeCount + Graph->EdgeCount, metrics_item);
+    s32 ItemCount = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        node_type Type = GetNodeType(Graph, (node_id)NodeIndex);
+        if (Type == NODE_PRESTART || Type == NODE_CONTROL) { continue; }
+        metrics_item* Item = Items + ItemCount++;
+        Item->Center = GetNodeP(Graph, (node_id)NodeIndex);
+        Item->HalfSize = V2(NodeRadius, NodeRadius);
+        Item->IsLabel = false;
+    }
+    for (s32 EdgeIndex = 0; EdgeIndex < Graph->EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        if (Edge->Transition.Start == NULL || GetNodeType(Graph, Edge->Source) == NODE_PRESTART) { continue; }
+
+        vec2 StartP = GetNodeP(Graph, Edge->Source);
+        metrics_item* Item = Items + ItemCount++;
+        if (Edge->Source == Edge->Dest)
+        {
+            vec2 LoopDir = Normalize(GetNodeP(Graph, Edge->Control) - StartP);
+            Item->Center = StartP + METRICS_LOOP_LABEL_DISTANCE*LoopDir;
+        }
+        else
+        {
+            vec2 Diff = GetNodeP(Graph, Edge->Dest) - StartP;
+            Item->Center = StartP + 0.5f*Diff + 0.3f*LeftNormal(Diff);
+        }
+        Item->HalfSize = V2(0.25f*METRICS_LABEL_HEIGHT*(f32)Edge->Transition.Length,
+                            0.35f*METRICS_LABEL_HEIGHT);
+        Item->IsLabel = true;
+    }
+    CountOverlaps(Arena, ItemCount, Items, NodeRadius, &Metrics);
+
+    // Edge lengths, and the direction of every arrow at both of its ends
+    s32* IncidentStart = PushArray(Arena, NodeCount + 1, s32);
+    f32* IncidentAngle = PushArray(Arena, 2*ArrowCount + 1, f32);
+    memset(IncidentStart, 0, (NodeCount + 1)*sizeof(s32));
+    f32 LengthSum = 0.0f;
+    for (s32 Index = 0; Index < ArrowCount; ++Index)
+    {
+        graph_edge* Edge = Graph->Edges + Arrows[Index];
+        LengthSum += Length(GetNodeP(Graph, Edge->Dest) - GetNodeP(Graph, Edge->Source));
+        ++IncidentStart[Edge->Source + 1];
+        ++IncidentStart[Edge->Dest + 1];
+    }
+    if (ArrowCount > 0)
+    {
+        Metrics.EdgeLengthMean = LengthSum / (f32)ArrowCount;
+        f32 SquaredDeviationSum = 0.0f;
+        for (s32 Index = 0; Index < ArrowCount; ++Index)
+        {
+            graph_edge* Edge = Graph->Edges + Arrows[Index];
+            f32 EdgeLength = Length(GetNodeP(Graph, Edge->Dest) - GetNodeP(Graph, Edge->Source));
+            SquaredDeviationSum += Square(EdgeLength - Metrics.EdgeLengthMean);
+        }
+        Metrics.EdgeLengthVariance = SquaredDeviationSum / (f32)ArrowCount;
+    }
+
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        IncidentStart[NodeIndex + 1] += IncidentStart[NodeIndex];
+    }
+    s32* Cursor = PushArray(Arena, NodeCount, s32);
+    memcpy(Cursor, IncidentStart, NodeCount*sizeof(s32));
+    for (s32 Index = 0; Index < ArrowCount; ++Index)
+    {
+        graph_edge* Edge = Graph->Edges + Arrows[Index];
+        vec2 Diff = GetNodeP(Graph, Edge->Dest) - GetNodeP(Graph, Edge->Source);
+        IncidentAngle[Cursor[Edge->Source]++] = atan2f(Diff.y, Diff.x);
+        IncidentAngle[Cursor[Edge->Dest]++] = atan2f(-Diff.y, -Diff.x);
+    }
+
+    f32 ResolutionSum = 0.0f;
+    s32 ResolutionCount = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        f32* Angles = IncidentAngle + IncidentStart[NodeIndex];
+        s32 Count = IncidentStart[NodeIndex + 1] - IncidentStart[NodeIndex];
+        if (Count < 2) { continue; }
+
+        for (s32 Index = 1; Index < Count; ++Index)
+        {
+            f32 Angle = Angles[Index];
+            s32 Position = Index;
+            while (Position > 0 && Angles[Position - 1] > Angle)
+            {
+                Angles[Position] = Angles[Position - 1];
+                --Position;
+            }
+            Angles[Position] = Angle;
+        }
+        f32 Smallest = Angles[0] + 2.0f*PI32 - Angles[Count - 1];
+        for (s32 Index = 1; Index < Count; ++Index)
+        {
+            Smallest = Min(Smallest, Angles[Index] - Angles[Index - 1]);
+        }
+
+        Metrics.MinAngle = Min(Metrics.MinAngle, Smallest);
+        ResolutionSum += Smallest / (2.0f*PI32 / (f32)Count);
+        ++ResolutionCount;
+    }
+    if (ResolutionCount > 0) { Metrics.AngularResolution = ResolutionSum / (f32)ResolutionCount; }
+
+    EndTemporaryMemory(MetricsMemory);
+    return Metrics;
+}
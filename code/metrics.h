@@ -0,0 +1,27 @@
+/* metrics.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Measurement of the quality of a layout (see layout_metrics), so that layout
+ * engines, constants and runs can be compared by number rather than by eye.
+ * Everything is measured on the graph as DrawGraph draws it: transitions as
+ * straight lines between the centers of their states, and labels where
+ * DrawGraph puts them. Text isn't actually measured; a label is taken to be
+ * half as wide per character as it is tall.
+ *
+ * The crossing and overlap counts file the segments (or circles and label
+ * boxes) in a uniform grid, with cells about the size of the average item,
+ * and only compare pairs that share a cell, each pair once. That takes time
+ * in proportion to the number of items, the cells they pass through and the
+ * pairs sharing a cell, which is close to linear for a layout that spreads
+ * out, so it's cheap enough to run every few steps of the simulation. It is
+ * still O(n^2) at worst, when most of the items pile up in a few cells.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* Measures the layout of Graph, with states drawn as circles of NodeRadius.
+ * Scratch memory is taken from Arena and released before returning. */
+extern layout_metrics
+MeasureLayout(memory_arena* Arena, graph* Graph, f32 NodeRadius);
@@ -0,0 +1,193 @@
+#include <cstring>
+#include "multilevel.h"
+#include "adjacency.hpp"
+
+
+graph_level
+CoarsenGraph(memory_arena* Arena, graph* Fine)
+{
+    s32 NodeCount = Fine->NodeCount;
+    adjacency Adjacency = BuildAdjacency(Arena, Fine);
+
+    // Visit nodes from the least to the most connected, and match each with
+    // its least connected free neighbour. Hubs are then left to the end
+    // instead of swallowing a leaf that had no other option.
+    s32* Order = PushArray(Arena, NodeCount, s32);
+    s32* DegreeStart = PushArray(Arena, NodeCount + 1, s32);
+    memset(DegreeStart, 0, (NodeCount + 1)*sizeof(s32));
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        s32 Degree = NodeDegree(&Adjacency, NodeIndex);
+        ++DegreeStart[Min(Degree, NodeCount - 1) + 1];
+    }
+    for (s32 Degree = 0; Degree < NodeCount; ++Degree)
+    {
+        DegreeStart[Degree + 1] += DegreeStart[Degree];
+    }
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        s32 Degree = NodeDegree(&Adjacency, NodeIndex);
+        Order[DegreeStart[Min(Degree, NodeCount - 1)]++] = NodeIndex;
+    }
+
+    s32* Match = PushArray(Arena, NodeCount, s32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex) { Match[NodeIndex] = -1; }
+
+    for (s32 OrderIndex = 0; OrderIndex < NodeCount; ++OrderIndex)
+    {
+        s32 Node = Order[OrderIndex];
+        if (Match[Node] != -1) { continue; }
+
+        s32 Best = -1;
+        s32 BestDegree = 0;
+        for (s32 Slot = Adjacency.Start[Node]; Slot < Adjacency.Start[Node + 1]; ++Slot)
+        {
+            s32 Neighbor = Adjacency.Neighbors[Slot];
+            if (Match[Neighbor] != -1) { continue; }
+
+            s32 Degree = NodeDegree(&Adjacency, Neighbor);
+            if (Best == -1 || Degree < BestDegree)
+            {
+                Best = Neighbor;
+                BestDegree = Degree;
+            }
+        }
+
+        if (Best != -1)
+        {
+            Match[Node] = Best;
+            Match[Best] = Node;
+        }
+    }
+
+    graph_level Level = {};
+    // A coarse graph never has more nodes or edges than the one it came from
+    Level.Graph = PushStruct(Arena, graph);
+    if (!InitializeGraph(Level.Graph, Arena, NodeCount, Fine->EdgeCount))
+    {
+        Level.Graph = NULL;
+        return Level;
+    }
+    Level.Graph->Random = RandomSplit(&Fine->Random);
+    Level.CoarseNodeOf = PushArray(Arena, NodeCount, node_id);
+    graph* Coarse = Level.Graph;
+
+    // Matched pairs and isolated or well-connected leftovers get a node each
+    const node_id Unassigned = -1;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex) { Level.CoarseNodeOf[NodeIndex] = Unassigned; }
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        if (Level.CoarseNodeOf[NodeIndex] != Unassigned) { continue; }
+
+        s32 Degree = NodeDegree(&Adjacency, NodeIndex);
+        if (Match[NodeIndex] == -1 && Degree == 1) { continue; }
+
+        node_id CoarseNode = AddNode(Coarse);
+        Level.CoarseNodeOf[NodeIndex] = CoarseNode;
+        if (Match[NodeIndex] != -1) { Level.CoarseNodeOf[Match[NodeIndex]] = CoarseNode; }
+    }
+
+    // A leaf only goes unmatched when its one neighbour was taken, so it can
+    // just ride along with that neighbour's pair
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        if (Level.CoarseNodeOf[NodeIndex] != Unassigned) { continue; }
+        s32 Neighbor = Adjacency.Neighbors[Adjacency.Start[NodeIndex]];
+        Level.CoarseNodeOf[NodeIndex] = Level.CoarseNodeOf[Neighbor];
+    }
+
+    // Every coarse node starts at the centroid of the nodes merged into it,
+    // so that each level keeps the shape of the fine graph's placement. The
+    // area a layout needs goes with its node count, so the coarse one is
+    // drawn in towards the middle to match; otherwise the few coarse nodes
+    // are flung against the walls, and the fine ones are piled up there.
+    f32 MeanX = 0.0f;
+    f32 MeanY = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        MeanX += Fine->PX[NodeIndex];
+        MeanY += Fine->PY[NodeIndex];
+    }
+    MeanX /= (f32)NodeCount;
+    MeanY /= (f32)NodeCount;
+    f32 Shrink = sqrtf((f32)Coarse->NodeCount / (f32)NodeCount);
+
+    s32* MemberCount = PushArray(Arena, Coarse->NodeCount, s32);
+    memset(MemberCount, 0, Coarse->NodeCount*sizeof(s32));
+    memset(Coarse->PX, 0, Coarse->NodeCount*sizeof(f32));
+    memset(Coarse->PY, 0, Coarse->NodeCount*sizeof(f32));
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        node_id CoarseNode = Level.CoarseNodeOf[NodeIndex];
+        Coarse->PX[CoarseNode] += Fine->PX[NodeIndex];
+        Coarse->PY[CoarseNode] += Fine->PY[NodeIndex];
+        ++MemberCount[CoarseNode];
+    }
+    for (s32 CoarseIndex = 0; CoarseIndex < Coarse->NodeCount; ++CoarseIndex)
+    {
+        f32 CentroidX = Coarse->PX[CoarseIndex] / (f32)MemberCount[CoarseIndex];
+        f32 CentroidY = Coarse->PY[CoarseIndex] / (f32)MemberCount[CoarseIndex];
+        Coarse->PX[CoarseIndex] = MeanX + Shrink*(CentroidX - MeanX);
+        Coarse->PY[CoarseIndex] = MeanY + Shrink*(CentroidY - MeanY);
+    }
+
+    // A coarse node is only virtual if everything in it was
+    for (s32 CoarseIndex = 0; CoarseIndex < Coarse->NodeCount; ++CoarseIndex)
+    {
+        Coarse->Types[CoarseIndex] = NODE_CONTROL;
+    }
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        u8* CoarseType = Coarse->Types + Level.CoarseNodeOf[NodeIndex];
+        node_type FineType = GetNodeType(Fine, (node_id)NodeIndex);
+        if (FineType != NODE_CONTROL && FineType != NODE_PRESTART)
+        {
+            *CoarseType = NODE_REGULAR;
+        }
+        else if (FineType == NODE_PRESTART && *CoarseType == NODE_CONTROL)
+        {
+            *CoarseType = NODE_PRESTART;
+        }
+    }
+
+    for (s32 EdgeIndex = 0; EdgeIndex < Fine->EdgeCount; ++EdgeIndex)
+    {
+        node_id A, B;
+        if (!EdgeEndpoints(Fine->Edges + EdgeIndex, &A, &B)) { continue; }
+
+        node_id CoarseA = Level.CoarseNodeOf[A];
+        node_id CoarseB = Level.CoarseNodeOf[B];
+        if (CoarseA == CoarseB) { continue; }
+        if (FindEdgeByNodes(Coarse, CoarseA, CoarseB) ||
+            FindEdgeByNodes(Coarse, CoarseB, CoarseA))
+        {
+            continue;
+        }
+
+        AddEdge(Coarse, CoarseA, CoarseB);
+    }
+
+    return Level;
+}
+
+graph_hierarchy
+BuildGraphHierarchy(memory_arena* Arena, graph* Graph, s32 MinNodeCount)
+{
+    graph_hierarchy Hierarchy = {};
+
+    graph* Fine = Graph;
+    while (Fine->NodeCount > MinNodeCount && Hierarchy.LevelCount < MULTILEVEL_MAX_LEVELS)
+    {
+        graph_level Level = CoarsenGraph(Arena, Fine);
+        if (!Level.Graph) { break; }
+
+        // Graphs made of nothing but disconnected nodes, or huge stars,
+        // barely shrink; another level would cost more than it saves.
+        if (Level.Graph->NodeCount > (Fine->NodeCount * 9) / 10) { break; }
+
+        Hierarchy.Levels[Hierarchy.LevelCount++] = Level;
+        Fine = Level.Graph;
+    }
+
+    return Hierarchy;
+}
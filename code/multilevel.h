@@ -0,0 +1,54 @@
+/* multilevel.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Graph coarsening for the multilevel layout mode. A graph is repeatedly
+ * shrunk by collapsing a maximal matching of its edges, giving a hierarchy of
+ * ever smaller graphs which can be laid out from the coarsest up, each level
+ * starting from the positions of the one above it.
+ *
+ * Only the structure of the graphs is handled here; laying them out is up to
+ * the simulation.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+// Upper limit on the number of coarser graphs built on top of the original.
+#define MULTILEVEL_MAX_LEVELS 16
+
+/* A coarser version of some finer graph. */
+struct graph_level
+{
+    // The coarse graph itself. Its nodes carry no names, and its edges no
+    // transitions or control nodes.
+    graph* Graph;
+    // Entry i is the node of Graph that node i of the finer graph was merged
+    // into. Has as many entries as the finer graph has nodes.
+    node_id* CoarseNodeOf;
+};
+
+/* A complete hierarchy of coarsened graphs. Levels[0] is a coarsening of the
+ * original graph, Levels[1] a coarsening of Levels[0], and so on up to the
+ * coarsest at Levels[LevelCount-1]. */
+struct graph_hierarchy
+{
+    s32 LevelCount;
+    graph_level Levels[MULTILEVEL_MAX_LEVELS];
+};
+
+/* Builds a graph with one node for every pair of nodes matched across an
+ * edge of Fine (plus one for every node left unmatched, except that
+ * unmatched leaves are folded into their neighbour), and an edge wherever
+ * any of their members were connected. Each coarse node is placed at the
+ * centroid of its members. All memory is taken from Arena; if it can't hold
+ * the coarse graph, the level's Graph is NULL. */
+extern graph_level
+CoarsenGraph(memory_arena* Arena, graph* Fine);
+
+/* Coarsens Graph repeatedly until it has no more than MinNodeCount nodes,
+ * coarsening stops making progress, or MULTILEVEL_MAX_LEVELS is reached. The
+ * hierarchy may be empty if Graph is already small enough. All memory is
+ * taken from Arena, and coarsening also stops when it runs out. */
+extern graph_hierarchy
+BuildGraphHierarchy(memory_arena* Arena, graph* Graph, s32 MinNodeCount);
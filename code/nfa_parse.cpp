@@ -274,10 +274,17 @@ PeekTwoTokens(tokenizer* Tokenizer)
 extern graph_error
 GenerateGraph(char* InputText, graph* Graph)
 {
+    BEGIN_PROFILE(PARSE);
     graph_error Result = {};
     token NextToken;
 
-    s16 PrestartID = AddNode(Graph, NODE_PRESTART); // Reserve 0th node for prestart
+    node_id PrestartID = AddNode(Graph, NODE_PRESTART); // Reserve 0th node for prestart
+    if (PrestartID == NO_NODE)
+    {
+        Result.Error = ERR_Graph_Full;
+        END_PROFILE(PARSE);
+        return Result;
+    }
 
     tokenizer TokenizerLocal;
     tokenizer* Tokenizer = &TokenizerLocal;
@@ -304,7 +311,12 @@ GenerateGraph(char* InputText, graph* Graph)
         graph_node Node = {};
         Node.Name = NameToken.Text;
         Node.JavaID = JavaIDToken.Text;
-        AddNode(Graph, Node);
+        if (AddNode(Graph, Node) == NO_NODE)
+        {
+            Result.Error = ERR_Graph_Full;
+            END_PROFILE(PARSE);
+            return Result;
+        }
 
         NextToken = PeekToken(Tokenizer);
     } while (!TokenTextEquals(NextToken, "Start State"));
@@ -317,8 +329,13 @@ GenerateGraph(char* InputText, graph* Graph)
                                            StartName.Text.Start, StartName.Text.Length, 
                                            PrestartID);
     assert(StartNode != NULL);
-    StartNode->Type = NODE_START;
-    AddEdge(Graph, PrestartID, StartNode->ID);
+    Graph->Types[StartNode->ID] = NODE_START;
+    if (!AddEdge(Graph, PrestartID, StartNode->ID))
+    {
+        Result.Error = ERR_Graph_Full;
+        END_PROFILE(PARSE);
+        return Result;
+    }
 
     RequireIdentifier(Tokenizer, "Accept States");
     RequireToken(Tokenizer, TT_Colon);
@@ -334,7 +351,7 @@ GenerateGraph(char* InputText, graph* Graph)
             Result.Error = ERR_Unknown_Node;
         }
 
-        AcceptNode->Type = NODE_FINAL;
+        Graph->Types[AcceptNode->ID] = NODE_FINAL;
 
         NextToken = GetToken(Tokenizer); // Could be comma, could be close brace
     } while (NextToken.Type != TT_CloseBracket);
@@ -359,6 +376,8 @@ GenerateGraph(char* InputText, graph* Graph)
                                            Tokenizer->Line);
                                            */
         }
+        // Adding control nodes can move the nodes, so hold on to the ID
+        node_id SourceID = SourceNode->ID;
 
         do {
             token TransitionChar = RequireToken(Tokenizer, TT_DeliminatedString);
@@ -378,13 +397,14 @@ GenerateGraph(char* InputText, graph* Graph)
                                                */
             }
             
+            node_id DestID = DestNode->ID;
             graph_edge NewEdge = {};
-            NewEdge.Source = SourceNode->ID;
-            NewEdge.Dest = DestNode->ID;
+            NewEdge.Source = SourceID;
+            NewEdge.Dest = DestID;
             NewEdge.Transition = TransitionChar.Text;
 
             graph_edge* ExistingEdge = NULL;
-            if ((ExistingEdge = FindEdgeByNodes(Graph, SourceNode->ID, DestNode->ID, PrestartID)) != NULL) 
+            if ((ExistingEdge = FindEdgeByNodes(Graph, SourceID, DestID, PrestartID)) != NULL) 
             {
                 ExistingEdge->OtherTransitions++;
                 ExistingEdge->Transition.Start = ".";
@@ -392,17 +412,22 @@ GenerateGraph(char* InputText, graph* Graph)
             }
             else
             {
-                if ((ExistingEdge = FindEdgeByNodes(Graph, DestNode->ID, SourceNode->ID, PrestartID)) != NULL) 
+                if ((ExistingEdge = FindEdgeByNodes(Graph, DestID, SourceID, PrestartID)) != NULL) 
                 {
                     ExistingEdge->HalfBidirectional = true;
                 }
 
-                if (DestNode->ID == SourceNode->ID)
+                if (DestID == SourceID)
                 {
                     node_id ControlNode = AddNode(Graph, NODE_CONTROL);
                     NewEdge.Control = ControlNode;
                 }
-                AddEdge(Graph, NewEdge);
+                if (NewEdge.Control == NO_NODE || !AddEdge(Graph, NewEdge))
+                {
+                    Result.Error = ERR_Graph_Full;
+                    END_PROFILE(PARSE);
+                    return Result;
+                }
             }
         } while (PeekTwoTokens(Tokenizer).Type != TT_Colon && PeekToken(Tokenizer).Type != TT_EOF);
 
@@ -413,6 +438,7 @@ GenerateGraph(char* InputText, graph* Graph)
         Result.ErrorMessage = Tokenizer->ErrorMessage;
     }
     
+    END_PROFILE(PARSE);
     return Result;
 }
 
@@ -40,6 +40,8 @@ enum graph_generation_error
     ERR_No_Graphgen_error = Parse_Error_Count,
     // NFA specified a name of a node that we didn't have recorded in the graph
     ERR_Unknown_Node,
+    // The graph ran out of room for the NFA's nodes or edges
+    ERR_Graph_Full,
 };
 
 /* Data structure which contains an error number and the corresponding error
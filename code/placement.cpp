@@ -0,0 +1,267 @@
+#include <cmath>
+#include <cstring>
+#include "placement.h"
+#include "adjacency.hpp"
+#include "stress.h"
+
+// Preferred distance between neighbouring nodes of a placement, in world
+// units. Squeezed if the graph wouldn't otherwise fit.
+#define PLACEMENT_SPACING 3.0f
+// Number of power iterations for each eigenvector of the spectral placement
+#define SPECTRAL_ITERATIONS 200
+// Ideal length of an edge in the stress placement: about the length edges
+// settle at in the simulation, so that it has little left to change
+#define STRESS_EDGE_LENGTH 5.0f
+
+/* Cheap integer hash mapped to [-1, 1], used to nudge nodes off exactly
+ * symmetric positions without making the placement depend on rand(). */
+inline f32
+HashJitter(u32 Value)
+{
+    Value ^= Value >> 16;
+    Value *= 0x7feb352du;
+    Value ^= Value >> 15;
+    Value *= 0x846ca68bu;
+    Value ^= Value >> 16;
+    return (f32)(Value & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+/* Lays the nodes out in columns by their breadth-first distance from the
+ * start states, left to right. Within a column nodes keep the order they were
+ * discovered in, which keeps siblings together. Anything the start states
+ * can't reach is searched from in turn as if it were a start state. */
+internal void
+PlaceNodesBFS(memory_arena* Arena, graph* Graph, adjacency* Adjacency,
+              vec2 MinSide, vec2 MaxSide)
+{
+    s32 NodeCount = Graph->NodeCount;
+    s32* Depth = PushArray(Arena, NodeCount, s32);
+    s32* Queue = PushArray(Arena, NodeCount, s32);
+    s32 QueueRead = 0;
+    s32 QueueWrite = 0;
+
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        node_type Type = GetNodeType(Graph, (node_id)NodeIndex);
+        Depth[NodeIndex] = -1;
+        // The prestart nodes sit in a column of their own to the left of the
+        // start states, and control nodes are placed next to their owners
+        // afterwards, so neither gets searched.
+        if (Type == NODE_PRESTART) { Depth[NodeIndex] = 0; }
+        if (Type == NODE_CONTROL) { Depth[NodeIndex] = -2; }
+    }
+
+    for (s32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (s32 RootIndex = 0; RootIndex < NodeCount; ++RootIndex)
+        {
+            // Search from every start state first, then from whatever is left
+            bool IsStart = (GetNodeType(Graph, (node_id)RootIndex) == NODE_START);
+            if (Depth[RootIndex] != -1 || (Pass == 0 && !IsStart)) { continue; }
+
+            Depth[RootIndex] = 1;
+            Queue[QueueWrite++] = RootIndex;
+            while (QueueRead < QueueWrite)
+            {
+                s32 Node = Queue[QueueRead++];
+                for (s32 Slot = Adjacency->Start[Node]; Slot < Adjacency->Start[Node + 1]; ++Slot)
+                {
+                    s32 Neighbor = Adjacency->Neighbors[Slot];
+                    if (Depth[Neighbor] != -1) { continue; }
+                    Depth[Neighbor] = Depth[Node] + 1;
+                    Queue[QueueWrite++] = Neighbor;
+                }
+            }
+        }
+    }
+
+    s32 MaxDepth = 0;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        MaxDepth = Max(MaxDepth, Depth[NodeIndex]);
+    }
+
+    s32* ColumnCount = PushArray(Arena, MaxDepth + 1, s32);
+    s32* ColumnUsed = PushArray(Arena, MaxDepth + 1, s32);
+    memset(ColumnCount, 0, (MaxDepth + 1)*sizeof(s32));
+    memset(ColumnUsed, 0, (MaxDepth + 1)*sizeof(s32));
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        if (Depth[NodeIndex] >= 0) { ++ColumnCount[Depth[NodeIndex]]; }
+    }
+
+    vec2 Size = MaxSide - MinSide;
+    vec2 Center = 0.5f*(MinSide + MaxSide);
+    f32 ColumnSpacing = Min(PLACEMENT_SPACING, 0.9f*Size.x / (f32)Max(MaxDepth, 1));
+
+    // Visit columns in discovery order (prestart nodes first), so every
+    // column is filled top to bottom in the order the search found it
+    for (s32 Pass = 0; Pass < 2; ++Pass)
+    {
+        for (s32 OrderIndex = 0; OrderIndex < (Pass == 0 ? NodeCount : QueueWrite); ++OrderIndex)
+        {
+            s32 NodeIndex = (Pass == 0) ? OrderIndex : Queue[OrderIndex];
+            if ((Pass == 0) != (Depth[NodeIndex] == 0)) { continue; }
+
+            s32 Column = Depth[NodeIndex];
+            f32 RowSpacing = Min(PLACEMENT_SPACING, 0.9f*Size.y / (f32)ColumnCount[Column]);
+            f32 Row = (f32)ColumnUsed[Column]++ - 0.5f*(f32)(ColumnCount[Column] - 1);
+
+            vec2 P = V2(Center.x + ColumnSpacing*((f32)Column - 0.5f*(f32)MaxDepth),
+                        Center.y - RowSpacing*Row);
+            // Keep nodes off perfectly straight lines, which the simulation
+            // would have no force to pull them out of
+            P += 0.1f*V2(HashJitter(2*NodeIndex), HashJitter(2*NodeIndex + 1));
+            SetNodeP(Graph, (node_id)NodeIndex, P);
+        }
+    }
+
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        if (Depth[NodeIndex] != -2) { continue; }
+
+        vec2 P = Center;
+        if (NodeDegree(Adjacency, NodeIndex) > 0)
+        {
+            node_id Owner = Adjacency->Neighbors[Adjacency->Start[NodeIndex]];
+            P = GetNodeP(Graph, Owner) + V2(0.0f, 0.5f*PLACEMENT_SPACING);
+        }
+        P += 0.1f*V2(HashJitter(2*NodeIndex), HashJitter(2*NodeIndex + 1));
+        SetNodeP(Graph, (node_id)NodeIndex, P);
+    }
+}
+
+/* Lays the nodes out by the two leading nontrivial eigenvectors of the
+ * degree-normalized adjacency matrix (Koren, "Drawing graphs by
+ * eigenvectors"), found by power iteration on (I + D^-1 A)/2, which pulls
+ * every node towards the average of its neighbours. The trivial constant
+ * eigenvector is projected out on every iteration, as is the first axis while
+ * finding the second. */
+internal void
+PlaceNodesSpectral(memory_arena* Arena, graph* Graph, adjacency* Adjacency,
+                   vec2 MinSide, vec2 MaxSide)
+{
+    s32 NodeCount = Graph->NodeCount;
+    f32* Axes[2];
+    Axes[0] = PushArray(Arena, NodeCount, f32);
+    Axes[1] = PushArray(Arena, NodeCount, f32);
+    f32* Next = PushArray(Arena, NodeCount, f32);
+    f32* Weight = PushArray(Arena, NodeCount, f32);
+
+    f32 TotalWeight = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Weight[NodeIndex] = (f32)Max(NodeDegree(Adjacency, NodeIndex), 1);
+        TotalWeight += Weight[NodeIndex];
+    }
+
+    for (s32 AxisIndex = 0; AxisIndex < 2; ++AxisIndex)
+    {
+        f32* Axis = Axes[AxisIndex];
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            Axis[NodeIndex] = HashJitter(7*NodeIndex + AxisIndex);
+        }
+
+        for (s32 Iteration = 0; Iteration < SPECTRAL_ITERATIONS; ++Iteration)
+        {
+            // D-orthogonalize against the constant vector and earlier axes
+            f32 Mean = 0.0f;
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                Mean += Weight[NodeIndex]*Axis[NodeIndex];
+            }
+            Mean /= TotalWeight;
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                Axis[NodeIndex] -= Mean;
+            }
+            for (s32 PreviousIndex = 0; PreviousIndex < AxisIndex; ++PreviousIndex)
+            {
+                f32* Previous = Axes[PreviousIndex];
+                f32 Dot = 0.0f;
+                f32 PreviousLengthSq = 0.0f;
+                for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+                {
+                    Dot += Weight[NodeIndex]*Axis[NodeIndex]*Previous[NodeIndex];
+                    PreviousLengthSq += Weight[NodeIndex]*Previous[NodeIndex]*Previous[NodeIndex];
+                }
+                f32 Scale = SafeRatio0(Dot, PreviousLengthSq);
+                for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+                {
+                    Axis[NodeIndex] -= Scale*Previous[NodeIndex];
+                }
+            }
+
+            f32 LengthSq = 0.0f;
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                f32 NeighborSum = 0.0f;
+                for (s32 Slot = Adjacency->Start[NodeIndex]; Slot < Adjacency->Start[NodeIndex + 1]; ++Slot)
+                {
+                    NeighborSum += Axis[Adjacency->Neighbors[Slot]];
+                }
+                Next[NodeIndex] = 0.5f*(Axis[NodeIndex] + NeighborSum / Weight[NodeIndex]);
+                LengthSq += Next[NodeIndex]*Next[NodeIndex];
+            }
+
+            f32 InvLength = SafeRatio0(1.0f, sqrtf(LengthSq));
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                Axis[NodeIndex] = Next[NodeIndex]*InvLength;
+            }
+        }
+    }
+
+    // Stretch each axis to about the area the nodes will need, or most of
+    // the available space if that's smaller
+    f32 NeededHalfSize = 0.5f*PLACEMENT_SPACING*sqrtf((f32)NodeCount);
+    vec2 HalfSize = 0.45f*(MaxSide - MinSide);
+    HalfSize = V2(Min(HalfSize.x, NeededHalfSize), Min(HalfSize.y, NeededHalfSize));
+    vec2 Center = 0.5f*(MinSide + MaxSide);
+    f32 Extent[2] = {};
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Extent[0] = Max(Extent[0], fabsf(Axes[0][NodeIndex]));
+        Extent[1] = Max(Extent[1], fabsf(Axes[1][NodeIndex]));
+    }
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        vec2 P = Center + V2(HalfSize.x*SafeRatio0(Axes[0][NodeIndex], Extent[0]),
+                             HalfSize.y*SafeRatio0(Axes[1][NodeIndex], Extent[1]));
+        // Nodes with identical neighbourhoods land on the same spot
+        P += 0.1f*V2(HashJitter(2*NodeIndex), HashJitter(2*NodeIndex + 1));
+        SetNodeP(Graph, (node_id)NodeIndex, P);
+    }
+}
+
+void
+PlaceNodes(memory_arena* Arena, graph* Graph, initial_placement Placement,
+           vec2 MinSide, vec2 MaxSide)
+{
+    if (Placement == PLACEMENT_RANDOM || Graph->NodeCount == 0) { return; }
+
+    temporary_memory PlacementMemory = BeginTemporaryMemory(Arena);
+
+    adjacency Adjacency = BuildAdjacency(Arena, Graph);
+    if (Placement == PLACEMENT_BFS || Placement == PLACEMENT_STRESS)
+    {
+        PlaceNodesBFS(Arena, Graph, &Adjacency, MinSide, MaxSide);
+    }
+    else if (Placement == PLACEMENT_SPECTRAL)
+    {
+        PlaceNodesSpectral(Arena, Graph, &Adjacency, MinSide, MaxSide);
+    }
+    // Graphs too big for stress majorization keep the BFS placement
+    if (Placement == PLACEMENT_STRESS)
+    {
+        StressLayout(Arena, Graph, &Adjacency, STRESS_EDGE_LENGTH, MinSide, MaxSide);
+    }
+
+    for (s32 NodeIndex = 0; NodeIndex < Graph->NodeCount; ++NodeIndex)
+    {
+        SetNodedP(Graph, (node_id)NodeIndex, V2(0.0f, 0.0f));
+    }
+
+    EndTemporaryMemory(PlacementMemory);
+}
@@ -0,0 +1,21 @@
+/* placement.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Initial placement of freshly loaded graphs. Nodes are given a starting
+ * position derived from the structure of the graph instead of a random one,
+ * so that the simulation has less untangling to do and the same graph always
+ * starts (and so ends up) the same way.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* Overwrites the positions of every node in Graph according to Placement,
+ * fitting them within the rectangle from MinSide to MaxSide, and brings them
+ * to rest. Does nothing for PLACEMENT_RANDOM, since AddNode already placed the
+ * nodes randomly. Scratch memory is taken from Arena and released before
+ * returning. */
+extern void
+PlaceNodes(memory_arena* Arena, graph* Graph, initial_placement Placement,
+           vec2 MinSide, vec2 MaxSide);
@@ -0,0 +1,130 @@
+/* profile.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Lightweight timing of the phases of the program (the profile_zone values),
+ * for finding out where the time goes without an external profiler. Each
+ * BEGIN_PROFILE/END_PROFILE pair adds the ticks between them and one hit to
+ * the zone's profile_counter, which the platform layer can print at exit.
+ *
+ * Everything here compiles away to nothing unless GRAPHGEN_PROFILE is defined
+ * to be nonzero (for example with make PROFILE=1). Ticks are CPU cycles from
+ * rdtsc on x86, and nanoseconds elsewhere.
+ *
+ * Zones nest, and each counts the time of the zones inside it too. Phases
+ * that run on several threads at once (such as SimulateGraph for separate
+ * components) add up the time spent on every thread, so they can come to
+ * more than the zones around them.
+ */
+#pragma once
+
+// Purpose: Convenience typedefs and macro definitions
+#include "types.h"
+
+#ifndef GRAPHGEN_PROFILE
+#define GRAPHGEN_PROFILE 0
+#endif
+
+/* Enumeration of the phases that are timed. */
+enum profile_zone
+{
+    // The posix platform layer: the whole run, the simulation steps until the
+    // layout settles, the final step and drawing, and writing out the PNG
+    PROFILE_MAIN,
+    PROFILE_LAYOUT_STEPS,
+    PROFILE_FINAL_FRAME,
+    PROFILE_PNG_ENCODE,
+    // nfa_parse::GenerateGraph
+    PROFILE_PARSE,
+    // SimulateGraph, and its phases in order
+    PROFILE_SIMULATE,
+    PROFILE_ATTRACTION,
+    PROFILE_REPULSION,
+    PROFILE_SIDE_FORCES,
+    PROFILE_INTEGRATION,
+    PROFILE_COLLISION,
+    PROFILE_SLEEP,
+    // DrawGraph, and the rasterization of glyphs within it
+    PROFILE_DRAW_GRAPH,
+    PROFILE_GLYPHS,
+
+    PROFILE_ZONE_COUNT,
+};
+
+/* Totals for one profile_zone. */
+struct profile_counter
+{
+    u64 Ticks;
+    u64 Hits;
+};
+
+/* Returns the name of Zone, indented by how deeply it nests, for printing. */
+inline const char*
+ProfileZoneName(profile_zone Zone)
+{
+    switch (Zone)
+    {
+        case PROFILE_MAIN: return "main";
+        case PROFILE_LAYOUT_STEPS: return "  layout steps";
+        case PROFILE_FINAL_FRAME: return "  final frame";
+        case PROFILE_PNG_ENCODE: return "  png encode";
+        case PROFILE_PARSE: return "    parse";
+        case PROFILE_SIMULATE: return "    simulate";
+        case PROFILE_ATTRACTION: return "      attraction";
+        case PROFILE_REPULSION: return "      repulsion";
+        case PROFILE_SIDE_FORCES: return "      sides and mouse";
+        case PROFILE_INTEGRATION: return "      integration";
+        case PROFILE_COLLISION: return "      collision";
+        case PROFILE_SLEEP: return "      sleep";
+        case PROFILE_DRAW_GRAPH: return "    draw graph";
+        case PROFILE_GLYPHS: return "      glyphs";
+        default: return "?";
+    }
+}
+
+#if GRAPHGEN_PROFILE
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+inline u64 ProfileTicks() { return __rdtsc(); }
+#else
+#include <chrono>
+inline u64
+ProfileTicks()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+/* The counters the zones add to, one per profile_zone. The application points
+ * this at app_memory::Profile whenever it is called. */
+extern profile_counter* GlobalProfile;
+
+/* Adds one hit of Ticks ticks to Zone. Safe to call from several threads. */
+inline void
+ProfileRecord(profile_zone Zone, u64 Ticks)
+{
+    if (!GlobalProfile) { return; }
+    profile_counter* Counter = GlobalProfile + Zone;
+#if defined(_MSC_VER)
+    _InterlockedExchangeAdd64((volatile long long*)&Counter->Ticks, (long long)Ticks);
+    _InterlockedExchangeAdd64((volatile long long*)&Counter->Hits, 1);
+#else
+    __sync_fetch_and_add(&Counter->Ticks, Ticks);
+    __sync_fetch_and_add(&Counter->Hits, (u64)1);
+#endif
+}
+
+#define BEGIN_PROFILE(Zone) u64 ProfileStart_##Zone = ProfileTicks()
+#define END_PROFILE(Zone) ProfileRecord(PROFILE_##Zone, ProfileTicks() - ProfileStart_##Zone)
+
+#else
+
+#define BEGIN_PROFILE(Zone)
+#define END_PROFILE(Zone)
+
+#endif
@@ -0,0 +1,235 @@
+/* quadtree.hpp
+ * by Andrew Chronister, (c) 2016
+ *
+ * Point-region quadtree over a set of 2D points, used to accelerate the
+ * Barnes-Hut approximation of node-node repulsion in the simulation.
+ *
+ * The tree is meant to be thrown away and rebuilt every simulation step, so it
+ * is allocated entirely out of a memory_arena (typically inside a
+ * temporary_memory block) and never modified after it is built.
+ *
+ * Every point carries a small integer "class", and each cell keeps a separate
+ * count and center of mass per class. This lets callers apply different
+ * interaction strengths between different kinds of points while still treating
+ * a distant cell as a handful of bodies.
+ */
+#pragma once
+
+// Purpose: memset/memcpy
+#include <cstring>
+
+// Purpose: Convenience typedefs and macro definitions
+#include "types.h"
+
+// Purpose: Vector types
+#include "math.hpp"
+
+// Purpose: memory management structures
+#include "memory_arena.hpp"
+
+// Number of distinct point classes tracked by each cell.
+#define QUADTREE_CLASS_COUNT 3
+// Cells at this depth are never subdivided, which bounds the size of the tree
+// when many points share (nearly) the same position.
+#define QUADTREE_MAX_DEPTH 24
+// Cells holding at most this many points are left as leaves.
+#define QUADTREE_LEAF_SIZE 4
+
+/* A single square region of the tree. */
+struct quadtree_cell
+{
+    // Geometric center of the square covered by the cell
+    vec2 Center;
+    // Half of the side length of the square covered by the cell
+    f32 HalfSize;
+
+    // Index of the first of the four consecutive child cells, ordered
+    // (-x,-y), (+x,-y), (-x,+y), (+x,+y). Zero for leaves, since the root
+    // can never be anyone's child.
+    s32 FirstChild;
+
+    // The points beneath this cell are Indices[First] .. Indices[First+Count-1]
+    // on the owning quadtree.
+    s32 First;
+    s32 Count;
+
+    // Center of mass of all points beneath the cell, regardless of class
+    vec2 CenterOfMass;
+    // Number of points of each class beneath the cell
+    f32 Mass[QUADTREE_CLASS_COUNT];
+    // Center of mass of the points of each class beneath the cell. Only
+    // meaningful where the corresponding Mass is non-zero.
+    vec2 ClassCenterOfMass[QUADTREE_CLASS_COUNT];
+};
+
+/* A complete quadtree. Cells[0] is the root. */
+struct quadtree
+{
+    s32 CellCount;
+    quadtree_cell* Cells;
+
+    // Permutation of the point indices such that the points beneath any cell
+    // are contiguous.
+    s32* Indices;
+};
+
+/* Scratch state threaded through the recursive build. */
+struct quadtree_builder
+{
+    memory_arena* Arena;
+    quadtree* Tree;
+    f32* X;
+    f32* Y;
+    u8* Classes;
+    s32* Scratch;
+};
+
+internal void
+QuadtreeComputeMass(quadtree_builder* Builder, quadtree_cell* Cell)
+{
+    vec2 ClassSum[QUADTREE_CLASS_COUNT] = {};
+    vec2 TotalSum = V2(0.0f, 0.0f);
+
+    if (Cell->FirstChild)
+    {
+        for (s32 ChildIndex = 0; ChildIndex < 4; ++ChildIndex)
+        {
+            quadtree_cell* Child = Builder->Tree->Cells + Cell->FirstChild + ChildIndex;
+            for (int Class = 0; Class < QUADTREE_CLASS_COUNT; ++Class)
+            {
+                Cell->Mass[Class] += Child->Mass[Class];
+                ClassSum[Class] += Child->Mass[Class] * Child->ClassCenterOfMass[Class];
+            }
+            TotalSum += (f32)Child->Count * Child->CenterOfMass;
+        }
+    }
+    else
+    {
+        for (s32 Slot = Cell->First; Slot < Cell->First + Cell->Count; ++Slot)
+        {
+            s32 PointIndex = Builder->Tree->Indices[Slot];
+            vec2 P = V2(Builder->X[PointIndex], Builder->Y[PointIndex]);
+            u8 Class = Builder->Classes[PointIndex];
+
+            Cell->Mass[Class] += 1.0f;
+            ClassSum[Class] += P;
+            TotalSum += P;
+        }
+    }
+
+    for (int Class = 0; Class < QUADTREE_CLASS_COUNT; ++Class)
+    {
+        Cell->ClassCenterOfMass[Class] = ClassSum[Class] * SafeRatio0(1.0f, Cell->Mass[Class]);
+    }
+    Cell->CenterOfMass = TotalSum * SafeRatio0(1.0f, (f32)Cell->Count);
+}
+
+internal void
+QuadtreeSubdivide(quadtree_builder* Builder, s32 CellIndex, int Depth)
+{
+    quadtree* Tree = Builder->Tree;
+
+    if (Tree->Cells[CellIndex].Count > QUADTREE_LEAF_SIZE && Depth < QUADTREE_MAX_DEPTH)
+    {
+        // NOTE(chronister): Children are pushed straight onto the arena, which
+        // keeps Cells contiguous as long as nothing else is pushed until the
+        // build is finished.
+        quadtree_cell* Children = PushArray(Builder->Arena, 4, quadtree_cell);
+        assert(Children == Tree->Cells + Tree->CellCount);
+        memset(Children, 0, 4*sizeof(quadtree_cell));
+
+        quadtree_cell* Cell = Tree->Cells + CellIndex;
+        Cell->FirstChild = Tree->CellCount;
+        Tree->CellCount += 4;
+
+        // Counting sort of the cell's points by quadrant
+        s32 QuadrantCounts[4] = {};
+        for (s32 Slot = Cell->First; Slot < Cell->First + Cell->Count; ++Slot)
+        {
+            s32 PointIndex = Tree->Indices[Slot];
+            int Quadrant = ((Builder->X[PointIndex] >= Cell->Center.x) ? 1 : 0) |
+                           ((Builder->Y[PointIndex] >= Cell->Center.y) ? 2 : 0);
+            ++QuadrantCounts[Quadrant];
+        }
+
+        s32 QuadrantStart[4];
+        s32 RunningStart = Cell->First;
+        for (int Quadrant = 0; Quadrant < 4; ++Quadrant)
+        {
+            f32 QuarterSize = 0.5f * Cell->HalfSize;
+            quadtree_cell* Child = Children + Quadrant;
+            Child->Center = Cell->Center + V2((Quadrant & 1) ? QuarterSize : -QuarterSize,
+                                              (Quadrant & 2) ? QuarterSize : -QuarterSize);
+            Child->HalfSize = QuarterSize;
+            Child->First = RunningStart;
+            Child->Count = QuadrantCounts[Quadrant];
+
+            QuadrantStart[Quadrant] = RunningStart;
+            RunningStart += QuadrantCounts[Quadrant];
+        }
+
+        for (s32 Slot = Cell->First; Slot < Cell->First + Cell->Count; ++Slot)
+        {
+            s32 PointIndex = Tree->Indices[Slot];
+            int Quadrant = ((Builder->X[PointIndex] >= Cell->Center.x) ? 1 : 0) |
+                           ((Builder->Y[PointIndex] >= Cell->Center.y) ? 2 : 0);
+            Builder->Scratch[QuadrantStart[Quadrant]++] = PointIndex;
+        }
+        memcpy(Tree->Indices + Cell->First, Builder->Scratch + Cell->First,
+               Cell->Count * sizeof(s32));
+
+        for (int Quadrant = 0; Quadrant < 4; ++Quadrant)
+        {
+            QuadtreeSubdivide(Builder, Cell->FirstChild + Quadrant, Depth + 1);
+        }
+    }
+
+    QuadtreeComputeMass(Builder, Tree->Cells + CellIndex);
+}
+
+/* Builds a quadtree over the PointCount points whose coordinates are given by
+ * the X and Y arrays, where Classes[i] (< QUADTREE_CLASS_COUNT) is the class
+ * of point i. All memory for the tree is taken from Arena, which must not be
+ * pushed onto by anything else until the function returns. */
+internal quadtree
+BuildQuadtree(memory_arena* Arena, s32 PointCount, f32* X, f32* Y, u8* Classes)
+{
+    quadtree Tree = {};
+    Tree.Indices = PushArray(Arena, PointCount, s32);
+
+    quadtree_builder Builder = {};
+    Builder.Arena = Arena;
+    Builder.Tree = &Tree;
+    Builder.X = X;
+    Builder.Y = Y;
+    Builder.Classes = Classes;
+    Builder.Scratch = PushArray(Arena, PointCount, s32);
+
+    vec2 MinP = V2(0.0f, 0.0f);
+    vec2 MaxP = V2(0.0f, 0.0f);
+    for (s32 PointIndex = 0; PointIndex < PointCount; ++PointIndex)
+    {
+        Tree.Indices[PointIndex] = PointIndex;
+        if (PointIndex == 0)
+        {
+            MinP = MaxP = V2(X[0], Y[0]);
+        }
+        MinP = V2(Min(MinP.x, X[PointIndex]), Min(MinP.y, Y[PointIndex]));
+        MaxP = V2(Max(MaxP.x, X[PointIndex]), Max(MaxP.y, Y[PointIndex]));
+    }
+
+    Tree.Cells = PushStruct(Arena, quadtree_cell);
+    memset(Tree.Cells, 0, sizeof(quadtree_cell));
+    Tree.CellCount = 1;
+
+    quadtree_cell* Root = Tree.Cells;
+    Root->Center = 0.5f*(MinP + MaxP);
+    // Pad slightly so that points on the max edge still fall inside the root
+    Root->HalfSize = 0.5f*Max(MaxP.x - MinP.x, MaxP.y - MinP.y) + 0.001f;
+    Root->First = 0;
+    Root->Count = PointCount;
+
+    QuadtreeSubdivide(&Builder, 0, 0);
+
+    return Tree;
+}
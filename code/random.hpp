@@ -0,0 +1,72 @@
+/* random.hpp
+ * by Andrew Chronister, (c) 2016
+ *
+ * Small self-contained pseudorandom number generator. The layout draws all of
+ * its randomness from here rather than from the C library's rand(), so that
+ * it depends only on a seed: not on the platform's rand(), on other users of
+ * it, or on the order in which threads happen to run.
+ *
+ * This file is defined as an .hpp file instead of a .h/.cpp pair so that the
+ * functions may be inlined at the compiler's discretion.
+ */
+#pragma once
+
+// Purpose: Convenience typedefs and macro definitions
+#include "types.h"
+
+/* A stream of pseudorandom numbers: a Weyl sequence (a counter stepped by an
+ * odd constant) run through an integer hash. Any seed, including zero, gives a
+ * good stream. Copying a series copies its position, so two copies produce
+ * the same numbers. */
+struct random_series
+{
+    u32 State;
+};
+
+inline random_series
+RandomSeries(u32 Seed)
+{
+    random_series Result;
+    Result.State = Seed;
+    return Result;
+}
+
+/* Returns the next number of the series, uniform over all 32-bit values. */
+inline u32
+RandomNextU32(random_series* Series)
+{
+    Series->State += 0x9e3779b9u;
+    u32 Value = Series->State;
+    Value ^= Value >> 16;
+    Value *= 0x7feb352du;
+    Value ^= Value >> 15;
+    Value *= 0x846ca68bu;
+    Value ^= Value >> 16;
+    return Value;
+}
+
+/* Returns the next number of the series, uniform in [0, 1]. */
+inline f32
+RandomUnilateral(random_series* Series)
+{
+    // Only keep as many bits as an f32 can represent exactly
+    f32 Result = (f32)(RandomNextU32(Series) >> 8) / (f32)0xFFFFFF;
+    return Result;
+}
+
+/* Returns the next number of the series, uniform in [-1, 1]. */
+inline f32
+RandomBilateral(random_series* Series)
+{
+    f32 Result = 2.0f*RandomUnilateral(Series) - 1.0f;
+    return Result;
+}
+
+/* Returns a new series seeded from the next number of Series, for handing to
+ * something that should get numbers of its own without disturbing Series
+ * any further. */
+inline random_series
+RandomSplit(random_series* Series)
+{
+    return RandomSeries(RandomNextU32(Series));
+}
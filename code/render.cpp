@@ -386,10 +386,12 @@ int DrawCharacterGlyph(app_state* State,
     u8* MonoBitmap = (u8*)PushSize(&State->TempArena, WidthAndApron*HeightAndApron);
     memset(MonoBitmap, 0, WidthAndApron*HeightAndApron);
 
+    BEGIN_PROFILE(GLYPHS);
     stbtt_MakeCodepointBitmap(&State->FontInfo, (MonoBitmap + WidthAndApron + 1), // Go down 1 row and col
                              WidthAndApron - 2, HeightAndApron - 2, WidthAndApron,
                              Scale, Scale,
                              Character);
+    END_PROFILE(GLYPHS);
 
     int MonoBytesPerPixel = 1;
 
@@ -466,7 +468,7 @@ CalculateStringWidth(app_state* State,
                                    &Advance, &LeftSideBearing);
         if (CharIndex < Length - 1)
         {
-            KernAdvance = stbtt_GetCodepointKernAdvance(&State->FontInfo, String[CharIndex - 1], String[CharIndex]);
+            KernAdvance = stbtt_GetCodepointKernAdvance(&State->FontInfo, String[CharIndex], String[CharIndex + 1]);
         }
 
         TotalWidth += (Advance + KernAdvance) * Scale;
@@ -0,0 +1,250 @@
+#include "reorder.h"
+#include "adjacency.hpp"
+
+// Resolution of the grid the Hilbert curve is drawn through, as a power of two
+#define HILBERT_ORDER 16
+
+/* Moves each entry of Array of Count elements of Size bytes to the place
+ * given by OldNodeOf. */
+internal void
+PermuteArray(memory_arena* Arena, void* Array, size_t Size, s32 Count, node_id* OldNodeOf)
+{
+    temporary_memory PermuteMemory = BeginTemporaryMemory(Arena);
+    u8* Old = (u8*)PushSize(Arena, Count*Size);
+    memcpy(Old, Array, Count*Size);
+    for (s32 Index = 0; Index < Count; ++Index)
+    {
+        memcpy((u8*)Array + Index*Size, Old + OldNodeOf[Index]*Size, Size);
+    }
+    EndTemporaryMemory(PermuteMemory);
+}
+
+void
+RenumberNodes(memory_arena* Arena, graph* Graph, node_id* OldNodeOf)
+{
+    temporary_memory RenumberMemory = BeginTemporaryMemory(Arena);
+    s32 NodeCount = Graph->NodeCount;
+
+    PermuteArray(Arena, Graph->PX, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->PY, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->dPX, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->dPY, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->ddPX, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->ddPY, sizeof(f32), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->Types, sizeof(u8), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->Asleep, sizeof(u8), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->StillSteps, sizeof(u16), NodeCount, OldNodeOf);
+    PermuteArray(Arena, Graph->Nodes, sizeof(graph_node), NodeCount, OldNodeOf);
+
+    node_id* NewNodeOf = PushArray(Arena, NodeCount, node_id);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        NewNodeOf[OldNodeOf[NodeIndex]] = (node_id)NodeIndex;
+        Graph->Nodes[NodeIndex].ID = (node_id)NodeIndex;
+    }
+
+    // Remap the edges, and sort them by source (a counting sort, so edges
+    // leaving the same node keep their order)
+    s32 EdgeCount = Graph->EdgeCount;
+    graph_edge* OldEdges = PushArray(Arena, EdgeCount, graph_edge);
+    memcpy(OldEdges, Graph->Edges, EdgeCount*sizeof(graph_edge));
+    s32* Start = PushArray(Arena, NodeCount + 1, s32);
+    memset(Start, 0, (NodeCount + 1)*sizeof(s32));
+    for (s32 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = OldEdges + EdgeIndex;
+        if (Edge->Source == Edge->Dest) { Edge->Control = NewNodeOf[Edge->Control]; }
+        Edge->Source = NewNodeOf[Edge->Source];
+        Edge->Dest = NewNodeOf[Edge->Dest];
+        ++Start[Edge->Source + 1];
+    }
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Start[NodeIndex + 1] += Start[NodeIndex];
+    }
+    for (s32 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        Graph->Edges[Start[OldEdges[EdgeIndex].Source]++] = OldEdges[EdgeIndex];
+    }
+
+    // The indexes already have room for every node, so refiling them doesn't
+    // allocate anything
+    if (Graph->NameIndex.SlotCount || Graph->JavaIDIndex.SlotCount) { IndexNodes(Graph); }
+    if (Graph->EndpointIndex.SlotCount) { IndexEdges(Graph); }
+
+    EndTemporaryMemory(RenumberMemory);
+}
+
+/* Fills Order with the nodes of Graph in reverse Cuthill-McKee order: each
+ * connected component breadth first from one of its nodes of lowest degree,
+ * visiting the neighbours of each node from lowest degree to highest, and the
+ * whole thing reversed. */
+internal void
+ReverseCuthillMcKeeOrder(memory_arena* Arena, graph* Graph, node_id* Order)
+{
+    s32 NodeCount = Graph->NodeCount;
+    adjacency Adjacency = BuildAdjacency(Arena, Graph);
+    bool* Visited = PushArray(Arena, NodeCount, bool);
+    memset(Visited, 0, NodeCount*sizeof(bool));
+
+    s32 OrderCount = 0;
+    while (OrderCount < NodeCount)
+    {
+        s32 Root = -1;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            if (Visited[NodeIndex]) { continue; }
+            if (Root == -1 || NodeDegree(&Adjacency, NodeIndex) < NodeDegree(&Adjacency, Root))
+            {
+                Root = NodeIndex;
+            }
+        }
+
+        // Order doubles as the queue
+        s32 QueueRead = OrderCount;
+        Visited[Root] = true;
+        Order[OrderCount++] = (node_id)Root;
+        while (QueueRead < OrderCount)
+        {
+            s32 Node = Order[QueueRead++];
+            s32 FirstNew = OrderCount;
+            for (s32 Slot = Adjacency.Start[Node]; Slot < Adjacency.Start[Node + 1]; ++Slot)
+            {
+                node_id Neighbor = Adjacency.Neighbors[Slot];
+                if (Visited[Neighbor]) { continue; }
+                Visited[Neighbor] = true;
+
+                // Insertion sort by degree; nodes have few neighbours
+                s32 Position = OrderCount++;
+                while (Position > FirstNew &&
+                       NodeDegree(&Adjacency, Order[Position - 1]) > NodeDegree(&Adjacency, Neighbor))
+                {
+                    Order[Position] = Order[Position - 1];
+                    --Position;
+                }
+                Order[Position] = Neighbor;
+            }
+        }
+    }
+
+    for (s32 Low = 0, High = NodeCount - 1; Low < High; ++Low, --High)
+    {
+        node_id Swap = Order[Low];
+        Order[Low] = Order[High];
+        Order[High] = Swap;
+    }
+}
+
+/* Returns the distance along the Hilbert curve filling a square grid of side
+ * 2^HILBERT_ORDER to the cell (X, Y). */
+internal u32
+HilbertDistance(u32 X, u32 Y)
+{
+    u32 Distance = 0;
+    for (u32 Side = 1u << (HILBERT_ORDER - 1); Side > 0; Side /= 2)
+    {
+        u32 RX = (X & Side) ? 1 : 0;
+        u32 RY = (Y & Side) ? 1 : 0;
+        Distance += Side*Side*((3*RX) ^ RY);
+
+        // Rotate the quadrant so that the curve within it runs the right way
+        if (RY == 0)
+        {
+            if (RX == 1)
+            {
+                X = Side - 1 - (X & (Side - 1));
+                Y = Side - 1 - (Y & (Side - 1));
+            }
+            u32 Swap = X;
+            X = Y;
+            Y = Swap;
+        }
+    }
+    return Distance;
+}
+
+/* Sorts the Count values 0..Count-1 into Order by Keys, keeping ties in
+ * order (a radix sort, a byte at a time). */
+internal void
+SortByKey(memory_arena* Arena, s32 Count, u32* Keys, node_id* Order)
+{
+    node_id* Scratch = PushArray(Arena, Count, node_id);
+    for (s32 Index = 0; Index < Count; ++Index) { Scratch[Index] = (node_id)Index; }
+
+    node_id* From = Scratch;
+    node_id* To = Order;
+    for (u32 Shift = 0; Shift < 32; Shift += 8)
+    {
+        s32 Start[257] = {};
+        for (s32 Index = 0; Index < Count; ++Index) { ++Start[((Keys[Index] >> Shift) & 0xFF) + 1]; }
+        for (s32 Digit = 0; Digit < 256; ++Digit) { Start[Digit + 1] += Start[Digit]; }
+        for (s32 Index = 0; Index < Count; ++Index)
+        {
+            node_id Node = From[Index];
+            To[Start[(Keys[Node] >> Shift) & 0xFF]++] = Node;
+        }
+        node_id* Swap = From;
+        From = To;
+        To = Swap;
+    }
+    // An even number of passes leaves the result back in Scratch
+    memcpy(Order, From, Count*sizeof(node_id));
+}
+
+void
+ReorderNodes(memory_arena* Arena, graph* Graph, node_order Order)
+{
+    s32 NodeCount = Graph->NodeCount;
+    if (NodeCount < 2) { return; }
+
+    temporary_memory ReorderMemory = BeginTemporaryMemory(Arena);
+    node_id* OldNodeOf = PushArray(Arena, NodeCount, node_id);
+
+    switch (Order)
+    {
+        case NODE_ORDER_DECLARATION:
+        {
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                OldNodeOf[Graph->Nodes[NodeIndex].DeclarationIndex] = (node_id)NodeIndex;
+            }
+        } break;
+
+        case NODE_ORDER_RCM:
+        {
+            ReverseCuthillMcKeeOrder(Arena, Graph, OldNodeOf);
+        } break;
+
+        case NODE_ORDER_HILBERT:
+        {
+            f32 MinX = Graph->PX[0], MaxX = Graph->PX[0];
+            f32 MinY = Graph->PY[0], MaxY = Graph->PY[0];
+            for (s32 NodeIndex = 1; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                MinX = Min(MinX, Graph->PX[NodeIndex]);
+                MaxX = Max(MaxX, Graph->PX[NodeIndex]);
+                MinY = Min(MinY, Graph->PY[NodeIndex]);
+                MaxY = Max(MaxY, Graph->PY[NodeIndex]);
+            }
+
+            f32 CellsPerUnit = SafeRatio0((f32)((1 << HILBERT_ORDER) - 1), Max(MaxX - MinX, MaxY - MinY));
+            u32* Keys = PushArray(Arena, NodeCount, u32);
+            for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+            {
+                u32 X = (u32)((Graph->PX[NodeIndex] - MinX)*CellsPerUnit);
+                u32 Y = (u32)((Graph->PY[NodeIndex] - MinY)*CellsPerUnit);
+                Keys[NodeIndex] = HilbertDistance(X, Y);
+            }
+            SortByKey(Arena, NodeCount, Keys, OldNodeOf);
+        } break;
+    }
+
+    bool Unchanged = true;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Unchanged = Unchanged && (OldNodeOf[NodeIndex] == NodeIndex);
+    }
+    if (!Unchanged) { RenumberNodes(Arena, Graph, OldNodeOf); }
+
+    EndTemporaryMemory(ReorderMemory);
+}
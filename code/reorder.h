@@ -0,0 +1,31 @@
+/* reorder.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Renumbering of the nodes of a graph (see node_order), so that nodes which
+ * the simulation and drawing visit together sit close together in the node
+ * arrays. Nodes are numbered in the order the NFA files declare them, which
+ * has nothing to do with which are connected or near each other, so the
+ * attraction pass and the collision and repulsion passes otherwise jump all
+ * over the arrays.
+ *
+ * Renumbering moves every per-node array on the graph along with the node and
+ * rewrites the edges to match, then puts the edges in order of the nodes they
+ * leave from, so that the attraction pass walks through the nodes in order as
+ * well, and refiles the nodes and edges in the graph's indexes. Nothing
+ * outside the graph may be holding on to a node_id across it.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+/* Renumbers the nodes of Graph so that node i becomes the node that was
+ * numbered OldNodeOf[i], which must be a permutation of the node indices. */
+extern void
+RenumberNodes(memory_arena* Arena, graph* Graph, node_id* OldNodeOf);
+
+/* Renumbers the nodes of Graph into Order (which does nothing for
+ * NODE_ORDER_DECLARATION if they already are). Scratch memory is taken from
+ * Arena and released before returning. */
+extern void
+ReorderNodes(memory_arena* Arena, graph* Graph, node_order Order);
@@ -0,0 +1,295 @@
+#include <cmath>
+#include "types.h"
+#include "repulsion.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define REPULSION_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define REPULSION_X86 0
+#endif
+
+// GCC and clang only allow intrinsics for instruction sets that are enabled
+// for the function using them, so the wide kernels are tagged individually and
+// the rest of the program is still built for the baseline target. MSVC allows
+// them anywhere.
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Coloumbesque repulsion: Fr = k(q1*q2)/r^2
+// Except things don't have "charge", so the numerator term is entirely arbitrary
+// And there's not really mass, so it's only loosely treated as a force.
+//
+// The strength between two nodes is
+//   RepulsionK * (Either light ? LightScale : 1) * (Both control ? 0 : 1)
+// which all the kernels compute from the 0/1 masks without branching.
+
+/* Evaluates the pairs (Node1Index, j) for ColumnStart <= j < Count one at a
+ * time. Used for whole rows by the scalar kernel and for the columns left
+ * over after the last full register by the wide ones. */
+inline void
+RepulsionRowScalar(repulsion_input* Input, s32 Node1Index, s32 ColumnStart,
+                   f32* ForceX, f32* ForceY)
+{
+    f32* PX = Input->PX;
+    f32* PY = Input->PY;
+    f32* LightMask = Input->LightMask;
+    f32* ControlMask = Input->ControlMask;
+    f32 LightReduction = 1.0f - Input->LightScale;
+
+    f32 X1 = PX[Node1Index];
+    f32 Y1 = PY[Node1Index];
+    f32 Light1 = LightMask[Node1Index];
+    f32 Control1 = ControlMask[Node1Index];
+    f32 Force1X = 0.0f;
+    f32 Force1Y = 0.0f;
+
+    for (s32 Node2Index = ColumnStart; Node2Index < Input->Count; ++Node2Index)
+    {
+        f32 DeltaX = PX[Node2Index] - X1;
+        f32 DeltaY = PY[Node2Index] - Y1;
+        f32 RadiusSq = DeltaX*DeltaX + DeltaY*DeltaY;
+        if (RadiusSq == 0.0f) { continue; }
+
+        f32 Scale = ((1.0f - LightReduction*Max(Light1, LightMask[Node2Index])) *
+                     (1.0f - Control1*ControlMask[Node2Index]));
+        f32 InvRadius = 1.0f / sqrtf(RadiusSq);
+        // K/r^2 along the unit direction, i.e. K*Delta/r^3
+        f32 Magnitude = Input->RepulsionK * Scale * InvRadius*InvRadius*InvRadius;
+
+        Force1X -= DeltaX * Magnitude;
+        Force1Y -= DeltaY * Magnitude;
+        ForceX[Node2Index] += DeltaX * Magnitude;
+        ForceY[Node2Index] += DeltaY * Magnitude;
+    }
+
+    ForceX[Node1Index] += Force1X;
+    ForceY[Node1Index] += Force1Y;
+}
+
+internal
+REPULSION_KERNEL(RepulsionKernelScalar)
+{
+    for (s32 Node1Index = RowStart; Node1Index < RowEnd; ++Node1Index)
+    {
+        RepulsionRowScalar(Input, Node1Index, Node1Index + 1, ForceX, ForceY);
+    }
+}
+
+#if REPULSION_X86
+
+internal TARGET_SSE2 f32
+HorizontalSum(__m128 Value)
+{
+    __m128 Shuffled = _mm_shuffle_ps(Value, Value, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 Sums = _mm_add_ps(Value, Shuffled);
+    Shuffled = _mm_movehl_ps(Shuffled, Sums);
+    Sums = _mm_add_ss(Sums, Shuffled);
+    return _mm_cvtss_f32(Sums);
+}
+
+internal TARGET_SSE2
+REPULSION_KERNEL(RepulsionKernelSSE2)
+{
+    f32* PX = Input->PX;
+    f32* PY = Input->PY;
+    f32* LightMask = Input->LightMask;
+    f32* ControlMask = Input->ControlMask;
+
+    __m128 Zero = _mm_setzero_ps();
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 Half = _mm_set1_ps(0.5f);
+    __m128 ThreeHalves = _mm_set1_ps(1.5f);
+    __m128 LightReduction = _mm_set1_ps(1.0f - Input->LightScale);
+    __m128 RepulsionK = _mm_set1_ps(Input->RepulsionK);
+
+    for (s32 Node1Index = RowStart; Node1Index < RowEnd; ++Node1Index)
+    {
+        __m128 X1 = _mm_set1_ps(PX[Node1Index]);
+        __m128 Y1 = _mm_set1_ps(PY[Node1Index]);
+        __m128 Light1 = _mm_set1_ps(LightMask[Node1Index]);
+        __m128 Control1 = _mm_set1_ps(ControlMask[Node1Index]);
+        __m128 Force1X = Zero;
+        __m128 Force1Y = Zero;
+
+        s32 Node2Index = Node1Index + 1;
+        for (; Node2Index + 4 <= Input->Count; Node2Index += 4)
+        {
+            __m128 DeltaX = _mm_sub_ps(_mm_loadu_ps(PX + Node2Index), X1);
+            __m128 DeltaY = _mm_sub_ps(_mm_loadu_ps(PY + Node2Index), Y1);
+            __m128 RadiusSq = _mm_add_ps(_mm_mul_ps(DeltaX, DeltaX), _mm_mul_ps(DeltaY, DeltaY));
+            // Coincident nodes exert no force on each other
+            __m128 Valid = _mm_cmpgt_ps(RadiusSq, Zero);
+
+            // Approximate 1/r, refined with one Newton-Raphson step
+            __m128 InvRadius = _mm_rsqrt_ps(RadiusSq);
+            InvRadius = _mm_mul_ps(InvRadius,
+                                   _mm_sub_ps(ThreeHalves,
+                                              _mm_mul_ps(_mm_mul_ps(Half, RadiusSq),
+                                                         _mm_mul_ps(InvRadius, InvRadius))));
+
+            __m128 Light2 = _mm_loadu_ps(LightMask + Node2Index);
+            __m128 Control2 = _mm_loadu_ps(ControlMask + Node2Index);
+            __m128 Scale = _mm_mul_ps(_mm_sub_ps(One, _mm_mul_ps(LightReduction, _mm_max_ps(Light1, Light2))),
+                                      _mm_sub_ps(One, _mm_mul_ps(Control1, Control2)));
+
+            __m128 InvRadiusCubed = _mm_mul_ps(InvRadius, _mm_mul_ps(InvRadius, InvRadius));
+            __m128 Magnitude = _mm_and_ps(Valid, _mm_mul_ps(_mm_mul_ps(RepulsionK, Scale), InvRadiusCubed));
+
+            __m128 PairForceX = _mm_mul_ps(DeltaX, Magnitude);
+            __m128 PairForceY = _mm_mul_ps(DeltaY, Magnitude);
+
+            Force1X = _mm_sub_ps(Force1X, PairForceX);
+            Force1Y = _mm_sub_ps(Force1Y, PairForceY);
+            _mm_storeu_ps(ForceX + Node2Index, _mm_add_ps(_mm_loadu_ps(ForceX + Node2Index), PairForceX));
+            _mm_storeu_ps(ForceY + Node2Index, _mm_add_ps(_mm_loadu_ps(ForceY + Node2Index), PairForceY));
+        }
+
+        ForceX[Node1Index] += HorizontalSum(Force1X);
+        ForceY[Node1Index] += HorizontalSum(Force1Y);
+
+        RepulsionRowScalar(Input, Node1Index, Node2Index, ForceX, ForceY);
+    }
+}
+
+internal TARGET_AVX2 f32
+HorizontalSum(__m256 Value)
+{
+    __m128 Sum = _mm_add_ps(_mm256_castps256_ps128(Value), _mm256_extractf128_ps(Value, 1));
+    __m128 Shuffled = _mm_shuffle_ps(Sum, Sum, _MM_SHUFFLE(2, 3, 0, 1));
+    Sum = _mm_add_ps(Sum, Shuffled);
+    Shuffled = _mm_movehl_ps(Shuffled, Sum);
+    Sum = _mm_add_ss(Sum, Shuffled);
+    return _mm_cvtss_f32(Sum);
+}
+
+internal TARGET_AVX2
+REPULSION_KERNEL(RepulsionKernelAVX2)
+{
+    f32* PX = Input->PX;
+    f32* PY = Input->PY;
+    f32* LightMask = Input->LightMask;
+    f32* ControlMask = Input->ControlMask;
+
+    __m256 Zero = _mm256_setzero_ps();
+    __m256 One = _mm256_set1_ps(1.0f);
+    __m256 Half = _mm256_set1_ps(0.5f);
+    __m256 ThreeHalves = _mm256_set1_ps(1.5f);
+    __m256 LightReduction = _mm256_set1_ps(1.0f - Input->LightScale);
+    __m256 RepulsionK = _mm256_set1_ps(Input->RepulsionK);
+
+    for (s32 Node1Index = RowStart; Node1Index < RowEnd; ++Node1Index)
+    {
+        __m256 X1 = _mm256_set1_ps(PX[Node1Index]);
+        __m256 Y1 = _mm256_set1_ps(PY[Node1Index]);
+        __m256 Light1 = _mm256_set1_ps(LightMask[Node1Index]);
+        __m256 Control1 = _mm256_set1_ps(ControlMask[Node1Index]);
+        __m256 Force1X = Zero;
+        __m256 Force1Y = Zero;
+
+        s32 Node2Index = Node1Index + 1;
+        for (; Node2Index + 8 <= Input->Count; Node2Index += 8)
+        {
+            __m256 DeltaX = _mm256_sub_ps(_mm256_loadu_ps(PX + Node2Index), X1);
+            __m256 DeltaY = _mm256_sub_ps(_mm256_loadu_ps(PY + Node2Index), Y1);
+            __m256 RadiusSq = _mm256_add_ps(_mm256_mul_ps(DeltaX, DeltaX), _mm256_mul_ps(DeltaY, DeltaY));
+            // Coincident nodes exert no force on each other
+            __m256 Valid = _mm256_cmp_ps(RadiusSq, Zero, _CMP_GT_OQ);
+
+            // Approximate 1/r, refined with one Newton-Raphson step
+            __m256 InvRadius = _mm256_rsqrt_ps(RadiusSq);
+            InvRadius = _mm256_mul_ps(InvRadius,
+                                      _mm256_sub_ps(ThreeHalves,
+                                                    _mm256_mul_ps(_mm256_mul_ps(Half, RadiusSq),
+                                                                  _mm256_mul_ps(InvRadius, InvRadius))));
+
+            __m256 Light2 = _mm256_loadu_ps(LightMask + Node2Index);
+            __m256 Control2 = _mm256_loadu_ps(ControlMask + Node2Index);
+            __m256 Scale = _mm256_mul_ps(_mm256_sub_ps(One, _mm256_mul_ps(LightReduction, _mm256_max_ps(Light1, Light2))),
+                                         _mm256_sub_ps(One, _mm256_mul_ps(Control1, Control2)));
+
+            __m256 InvRadiusCubed = _mm256_mul_ps(InvRadius, _mm256_mul_ps(InvRadius, InvRadius));
+            __m256 Magnitude = _mm256_and_ps(Valid, _mm256_mul_ps(_mm256_mul_ps(RepulsionK, Scale), InvRadiusCubed));
+
+            __m256 PairForceX = _mm256_mul_ps(DeltaX, Magnitude);
+            __m256 PairForceY = _mm256_mul_ps(DeltaY, Magnitude);
+
+            Force1X = _mm256_sub_ps(Force1X, PairForceX);
+            Force1Y = _mm256_sub_ps(Force1Y, PairForceY);
+            _mm256_storeu_ps(ForceX + Node2Index, _mm256_add_ps(_mm256_loadu_ps(ForceX + Node2Index), PairForceX));
+            _mm256_storeu_ps(ForceY + Node2Index, _mm256_add_ps(_mm256_loadu_ps(ForceY + Node2Index), PairForceY));
+        }
+
+        ForceX[Node1Index] += HorizontalSum(Force1X);
+        ForceY[Node1Index] += HorizontalSum(Force1Y);
+
+        RepulsionRowScalar(Input, Node1Index, Node2Index, ForceX, ForceY);
+    }
+}
+
+#endif
+
+simd_level DetectSIMDLevel()
+{
+    local_persist simd_level DetectedLevel = SIMD_AUTO;
+    if (DetectedLevel != SIMD_AUTO) { return DetectedLevel; }
+
+    simd_level Result = SIMD_SCALAR;
+#if REPULSION_X86 && defined(_MSC_VER)
+    int Info[4];
+    __cpuid(Info, 0);
+    int MaxLeaf = Info[0];
+
+    __cpuid(Info, 1);
+    bool HasSSE2 = (Info[3] & (1 << 26)) != 0;
+    bool HasOSXSAVE = (Info[2] & (1 << 27)) != 0;
+    bool HasAVX = (Info[2] & (1 << 28)) != 0;
+    // The OS also has to save the upper halves of the YMM registers for us
+    bool OSSavesYMM = HasOSXSAVE && ((_xgetbv(0) & 6) == 6);
+
+    bool HasAVX2 = false;
+    if (MaxLeaf >= 7)
+    {
+        __cpuidex(Info, 7, 0);
+        HasAVX2 = (Info[1] & (1 << 5)) != 0;
+    }
+
+    if (HasSSE2) { Result = SIMD_SSE2; }
+    if (HasSSE2 && HasAVX && HasAVX2 && OSSavesYMM) { Result = SIMD_AVX2; }
+#elif REPULSION_X86 && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) { Result = SIMD_SSE2; }
+    if (__builtin_cpu_supports("avx2")) { Result = SIMD_AVX2; }
+#endif
+
+    DetectedLevel = Result;
+    return Result;
+}
+
+repulsion_kernel* GetRepulsionKernel(simd_level RequestedLevel, simd_level* ChosenLevel)
+{
+    simd_level Supported = DetectSIMDLevel();
+    simd_level Level = RequestedLevel;
+    if (Level == SIMD_AUTO || Level > Supported) { Level = Supported; }
+
+    repulsion_kernel* Result = RepulsionKernelScalar;
+#if REPULSION_X86
+    switch (Level)
+    {
+        case SIMD_SSE2: { Result = RepulsionKernelSSE2; } break;
+        case SIMD_AVX2: { Result = RepulsionKernelAVX2; } break;
+        default: {} break;
+    }
+#endif
+
+    if (ChosenLevel) { *ChosenLevel = Level; }
+    return Result;
+}
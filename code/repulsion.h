@@ -0,0 +1,64 @@
+/* repulsion.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Kernels that evaluate the exact all-pairs node-node repulsion of the
+ * simulation, with scalar, SSE2 and AVX2 implementations selected at runtime.
+ *
+ * Every kernel evaluates each unordered pair of nodes exactly once (j > i) and
+ * applies the resulting force to both nodes, so rows near the end of the node
+ * list are much cheaper than rows near the start.
+ */
+#pragma once
+
+// Purpose: Convenience typedefs and macro definitions
+#include "types.h"
+
+/* Enumeration describing the instruction sets the repulsion kernels can be
+ * written in. Ordered so that a larger value implies support for every
+ * smaller one. */
+enum simd_level
+{
+    // Pick the best level supported by the CPU we're running on
+    SIMD_AUTO,
+    // Plain C++, one pair at a time
+    SIMD_SCALAR,
+    // 4 pairs at a time with SSE2
+    SIMD_SSE2,
+    // 8 pairs at a time with AVX2
+    SIMD_AVX2,
+};
+
+/* Everything a repulsion kernel needs to know about the nodes. All arrays
+ * have Count entries, indexed by node_id. */
+struct repulsion_input
+{
+    s32 Count;
+    // Node positions
+    f32* PX;
+    f32* PY;
+    // 1.0f for nodes that are repelled less (control points and the prestart
+    // node), 0.0f otherwise
+    f32* LightMask;
+    // 1.0f for control points, which don't repel each other at all, 0.0f
+    // otherwise
+    f32* ControlMask;
+    // Base strength of the repulsion between two regular nodes
+    f32 RepulsionK;
+    // Multiplier on RepulsionK when either node of a pair is light
+    f32 LightScale;
+};
+
+/* Signature shared by all repulsion kernels. Evaluates every pair (i, j) with
+ * RowStart <= i < RowEnd and i < j < Input->Count, and adds the resulting
+ * forces into ForceX/ForceY (Count entries each) for both nodes. */
+#define REPULSION_KERNEL(name) void name(repulsion_input* Input, s32 RowStart, s32 RowEnd, f32* ForceX, f32* ForceY)
+typedef REPULSION_KERNEL(repulsion_kernel);
+
+/* Returns the best simd_level supported by the current CPU (and operating
+ * system, for AVX state). Never returns SIMD_AUTO. */
+simd_level DetectSIMDLevel();
+
+/* Returns the kernel for the requested level. SIMD_AUTO, or a level the CPU
+ * doesn't support, falls back to the best level that it does. If ChosenLevel
+ * is non-NULL, it receives the level actually used. */
+repulsion_kernel* GetRepulsionKernel(simd_level RequestedLevel, simd_level* ChosenLevel = NULL);
@@ -0,0 +1,247 @@
+#include <cstring>
+#include "snapshot.h"
+
+// Sections of a snapshot start on multiples of this many bytes
+#define SNAPSHOT_ALIGNMENT 8
+
+/* Returns the size of the node state section for NodeCount nodes. */
+inline u64
+SnapshotNodeStateSize(u64 NodeCount)
+{
+    return NodeCount*(6*sizeof(f32) + sizeof(u16) + 2*sizeof(u8));
+}
+
+inline u64
+AlignSnapshotOffset(u64 Offset)
+{
+    return (Offset + SNAPSHOT_ALIGNMENT - 1) & ~(u64)(SNAPSHOT_ALIGNMENT - 1);
+}
+
+/* Copies String to the end of the strings section, at Strings + *Used, and
+ * returns where it went. */
+internal snapshot_string
+PackString(u8* Strings, u64* Used, string String)
+{
+    snapshot_string Result = {SNAPSHOT_NO_STRING, 0};
+    if (String.Start != NULL)
+    {
+        Result.Offset = (u32)*Used;
+        Result.Length = (u32)String.Length;
+        memcpy(Strings + *Used, String.Start, String.Length);
+        *Used += String.Length;
+    }
+    return Result;
+}
+
+/* Returns whether a section of Length bytes starting Offset bytes in lies
+ * within a snapshot of Size bytes, without overflowing. */
+inline bool
+SectionFits(u64 Offset, u64 Length, u64 Size)
+{
+    return (Offset <= Size && Length <= Size - Offset);
+}
+
+/* Returns whether Packed lies within a strings section of StringsSize bytes. */
+internal bool
+StringFits(snapshot_string Packed, u64 StringsSize)
+{
+    bool Result = (Packed.Offset == SNAPSHOT_NO_STRING ||
+                   (u64)Packed.Offset + Packed.Length <= StringsSize);
+    return Result;
+}
+
+/* Returns the string that Packed describes within the strings section at
+ * Strings, which it has to fit in. */
+internal string
+UnpackString(char* Strings, snapshot_string Packed)
+{
+    string Result = {};
+    if (Packed.Offset != SNAPSHOT_NO_STRING)
+    {
+        Result.Start = Strings + Packed.Offset;
+        Result.Length = Packed.Length;
+    }
+    return Result;
+}
+
+void*
+WriteSnapshot(memory_arena* Arena, graph* Graph, integrator_state* Integrator,
+              settle_state* Settle, memory_index* Size)
+{
+    s32 NodeCount = Graph->NodeCount;
+    s32 EdgeCount = Graph->EdgeCount;
+
+    u64 StringsSize = Graph->Name.Length + Graph->JavaID.Length;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        StringsSize += Graph->Nodes[NodeIndex].Name.Length + Graph->Nodes[NodeIndex].JavaID.Length;
+    }
+    for (s32 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        StringsSize += Graph->Edges[EdgeIndex].Transition.Length;
+    }
+
+    snapshot_header Header = {};
+    Header.Magic = SNAPSHOT_MAGIC;
+    Header.Version = SNAPSHOT_VERSION;
+    Header.NodeCount = (u32)NodeCount;
+    Header.EdgeCount = (u32)EdgeCount;
+    Header.StepCount = Graph->StepCount;
+    Header.Random = Graph->Random;
+    Header.Integrator = *Integrator;
+    Header.Settle = *Settle;
+    Header.NodeStateOffset = AlignSnapshotOffset(sizeof(snapshot_header));
+    Header.NodesOffset = AlignSnapshotOffset(Header.NodeStateOffset + SnapshotNodeStateSize(NodeCount));
+    Header.EdgesOffset = AlignSnapshotOffset(Header.NodesOffset + NodeCount*sizeof(snapshot_node));
+    Header.StringsOffset = AlignSnapshotOffset(Header.EdgesOffset + EdgeCount*sizeof(snapshot_edge));
+    Header.StringsSize = StringsSize;
+    Header.Size = Header.StringsOffset + StringsSize;
+
+    u8* Snapshot = (u8*)PushSize(Arena, Header.Size);
+    memset(Snapshot, 0, Header.Size);
+
+    u8* NodeState = Snapshot + Header.NodeStateOffset;
+    f32* Arrays[] = {Graph->PX, Graph->PY, Graph->dPX, Graph->dPY, Graph->ddPX, Graph->ddPY};
+    for (u32 ArrayIndex = 0; ArrayIndex < ArrayCount(Arrays); ++ArrayIndex)
+    {
+        memcpy(NodeState, Arrays[ArrayIndex], NodeCount*sizeof(f32));
+        NodeState += NodeCount*sizeof(f32);
+    }
+    memcpy(NodeState, Graph->StillSteps, NodeCount*sizeof(u16));
+    NodeState += NodeCount*sizeof(u16);
+    memcpy(NodeState, Graph->Types, NodeCount*sizeof(u8));
+    NodeState += NodeCount*sizeof(u8);
+    memcpy(NodeState, Graph->Asleep, NodeCount*sizeof(u8));
+
+    u8* Strings = Snapshot + Header.StringsOffset;
+    u64 StringsUsed = 0;
+    Header.Name = PackString(Strings, &StringsUsed, Graph->Name);
+    Header.JavaID = PackString(Strings, &StringsUsed, Graph->JavaID);
+
+    snapshot_node* Nodes = (snapshot_node*)(Snapshot + Header.NodesOffset);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        graph_node* Node = Graph->Nodes + NodeIndex;
+        Nodes[NodeIndex].DeclarationIndex = (u32)Node->DeclarationIndex;
+        Nodes[NodeIndex].Name = PackString(Strings, &StringsUsed, Node->Name);
+        Nodes[NodeIndex].JavaID = PackString(Strings, &StringsUsed, Node->JavaID);
+    }
+
+    snapshot_edge* Edges = (snapshot_edge*)(Snapshot + Header.EdgesOffset);
+    for (s32 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        Edges[EdgeIndex].Source = (u32)Edge->Source;
+        Edges[EdgeIndex].Dest = (u32)Edge->Dest;
+        Edges[EdgeIndex].Control = (u32)Edge->Control;
+        Edges[EdgeIndex].OtherTransitions = Edge->OtherTransitions;
+        Edges[EdgeIndex].HalfBidirectional = Edge->HalfBidirectional ? 1 : 0;
+        Edges[EdgeIndex].Transition = PackString(Strings, &StringsUsed, Edge->Transition);
+    }
+
+    memcpy(Snapshot, &Header, sizeof(Header));
+    *Size = Header.Size;
+    return Snapshot;
+}
+
+bool
+ReadSnapshot(void* Data, memory_index Size, graph* Graph, integrator_state* Integrator,
+             settle_state* Settle)
+{
+    if (Size < sizeof(snapshot_header)) { return false; }
+    snapshot_header* Header = (snapshot_header*)Data;
+    u64 NodeCount = Header->NodeCount;
+    u64 EdgeCount = Header->EdgeCount;
+
+    // Check that every section lies within the snapshot before reading any.
+    // The counts are at most 2^31, so the section lengths can't overflow.
+    bool Valid = (Header->Magic == SNAPSHOT_MAGIC && Header->Version == SNAPSHOT_VERSION &&
+                  Header->Size <= Size &&
+                  NodeCount <= INT32_MAX && EdgeCount <= INT32_MAX &&
+                  Header->NodeStateOffset % SNAPSHOT_ALIGNMENT == 0 &&
+                  Header->NodesOffset % SNAPSHOT_ALIGNMENT == 0 &&
+                  Header->EdgesOffset % SNAPSHOT_ALIGNMENT == 0 &&
+                  Header->NodeStateOffset >= sizeof(snapshot_header) &&
+                  SectionFits(Header->NodeStateOffset, SnapshotNodeStateSize(NodeCount), Header->Size) &&
+                  SectionFits(Header->NodesOffset, NodeCount*sizeof(snapshot_node), Header->Size) &&
+                  SectionFits(Header->EdgesOffset, EdgeCount*sizeof(snapshot_edge), Header->Size) &&
+                  SectionFits(Header->StringsOffset, Header->StringsSize, Header->Size));
+    if (!Valid || !Graph->Arena || GetArenaSizeRemaining(Graph->Arena) < NodeCount*sizeof(bool))
+    {
+        return false;
+    }
+
+    u8* Snapshot = (u8*)Data;
+    char* Strings = (char*)Snapshot + Header->StringsOffset;
+    u8* Types = Snapshot + Header->NodeStateOffset + NodeCount*(6*sizeof(f32) + sizeof(u16));
+    snapshot_node* Nodes = (snapshot_node*)(Snapshot + Header->NodesOffset);
+    snapshot_edge* Edges = (snapshot_edge*)(Snapshot + Header->EdgesOffset);
+    // Then check every type, index and string within the sections. The
+    // declaration indices have to number the nodes once each, as
+    // ReorderNodes relies on.
+    temporary_memory CheckMemory = BeginTemporaryMemory(Graph->Arena);
+    bool* Placed = PushArray(Graph->Arena, NodeCount, bool);
+    memset(Placed, 0, NodeCount*sizeof(bool));
+    u64 StringsSize = Header->StringsSize;
+    Valid = StringFits(Header->Name, StringsSize) && StringFits(Header->JavaID, StringsSize);
+    for (u64 NodeIndex = 0; Valid && NodeIndex < NodeCount; ++NodeIndex)
+    {
+        snapshot_node* Node = Nodes + NodeIndex;
+        Valid = (Types[NodeIndex] < NODE_TYPE_COUNT &&
+                 Node->DeclarationIndex < NodeCount && !Placed[Node->DeclarationIndex] &&
+                 StringFits(Node->Name, StringsSize) && StringFits(Node->JavaID, StringsSize));
+        if (Valid) { Placed[Node->DeclarationIndex] = true; }
+    }
+    EndTemporaryMemory(CheckMemory);
+    for (u64 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        snapshot_edge* Edge = Edges + EdgeIndex;
+        Valid = Valid && (Edge->Source < NodeCount && Edge->Dest < NodeCount &&
+                          (Edge->Source != Edge->Dest || Edge->Control < NodeCount) &&
+                          StringFits(Edge->Transition, StringsSize));
+    }
+    if (!Valid || !ReserveGraph(Graph, (s32)NodeCount, (s32)EdgeCount)) { return false; }
+
+    Graph->NodeCount = (s32)NodeCount;
+    Graph->EdgeCount = (s32)EdgeCount;
+    Graph->StepCount = Header->StepCount;
+    Graph->Random = Header->Random;
+    Graph->Name = UnpackString(Strings, Header->Name);
+    Graph->JavaID = UnpackString(Strings, Header->JavaID);
+
+    u8* NodeState = Snapshot + Header->NodeStateOffset;
+    f32* Arrays[] = {Graph->PX, Graph->PY, Graph->dPX, Graph->dPY, Graph->ddPX, Graph->ddPY};
+    for (u32 ArrayIndex = 0; ArrayIndex < ArrayCount(Arrays); ++ArrayIndex)
+    {
+        memcpy(Arrays[ArrayIndex], NodeState, NodeCount*sizeof(f32));
+        NodeState += NodeCount*sizeof(f32);
+    }
+    memcpy(Graph->StillSteps, NodeState, NodeCount*sizeof(u16));
+    NodeState += NodeCount*sizeof(u16);
+    memcpy(Graph->Types, NodeState, NodeCount*sizeof(u8));
+    NodeState += NodeCount*sizeof(u8);
+    memcpy(Graph->Asleep, NodeState, NodeCount*sizeof(u8));
+
+    for (u64 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        graph_node* Node = Graph->Nodes + NodeIndex;
+        Node->ID = (node_id)NodeIndex;
+        Node->DeclarationIndex = (node_id)Nodes[NodeIndex].DeclarationIndex;
+        Node->Name = UnpackString(Strings, Nodes[NodeIndex].Name);
+        Node->JavaID = UnpackString(Strings, Nodes[NodeIndex].JavaID);
+    }
+    for (u64 EdgeIndex = 0; EdgeIndex < EdgeCount; ++EdgeIndex)
+    {
+        graph_edge* Edge = Graph->Edges + EdgeIndex;
+        Edge->Source = (node_id)Edges[EdgeIndex].Source;
+        Edge->Dest = (node_id)Edges[EdgeIndex].Dest;
+        Edge->Control = (node_id)Edges[EdgeIndex].Control;
+        Edge->OtherTransitions = Edges[EdgeIndex].OtherTransitions;
+        Edge->HalfBidirectional = (Edges[EdgeIndex].HalfBidirectional != 0);
+        Edge->Transition = UnpackString(Strings, Edges[EdgeIndex].Transition);
+    }
+
+    *Integrator = Header->Integrator;
+    *Settle = Header->Settle;
+    return true;
+}
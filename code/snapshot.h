@@ -0,0 +1,101 @@
+/* snapshot.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * A snapshot is a self-contained binary image of a graph part way through
+ * being laid out: everything SimulateGraph carries from one step to the next
+ * (positions, velocities, sleep state, step count and random numbers, plus
+ * the integrator_state and the platform's settle_state), along with the
+ * nodes, edges and strings needed to draw it. Continuing from a snapshot
+ * gives exactly the layout the run that wrote it would have gone on to.
+ *
+ * A snapshot is a snapshot_header, then these sections, each starting on a
+ * multiple of 8 bytes at the offset the header gives:
+ *  - Node state: PX, PY, dPX, dPY, ddPX and ddPY (NodeCount f32s each), then
+ *    StillSteps (NodeCount u16s), then Types and Asleep (NodeCount u8s each)
+ *  - Nodes: NodeCount snapshot_nodes
+ *  - Edges: EdgeCount snapshot_edges
+ *  - Strings: every name and transition, one after another
+ * Node and edge indices are 32 bits wide whatever node_id is. Everything is
+ * in the byte order of the machine that wrote it.
+ *
+ * Nothing in a snapshot points anywhere, so it can be written straight out to
+ * a file, and read back by mapping that file into memory and pointing the
+ * graph's strings into it, without parsing anything.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+#define SNAPSHOT_MAGIC 0x4e534747
+#define SNAPSHOT_VERSION 1
+// snapshot_string::Offset of a string that is NULL
+#define SNAPSHOT_NO_STRING 0xffffffffu
+
+/* A string in the strings section, by its position and length there. */
+struct snapshot_string
+{
+    u32 Offset;
+    u32 Length;
+};
+
+/* The descriptive data of one node, as on graph_node. */
+struct snapshot_node
+{
+    u32 DeclarationIndex;
+    snapshot_string Name;
+    snapshot_string JavaID;
+};
+
+/* One edge, as on graph_edge. */
+struct snapshot_edge
+{
+    u32 Source;
+    u32 Dest;
+    u32 Control;
+    s32 OtherTransitions;
+    u32 HalfBidirectional;
+    snapshot_string Transition;
+};
+
+struct snapshot_header
+{
+    // SNAPSHOT_MAGIC and SNAPSHOT_VERSION
+    u32 Magic;
+    u32 Version;
+    // Size of the whole snapshot in bytes, header included
+    u64 Size;
+
+    u32 NodeCount;
+    u32 EdgeCount;
+    u32 StepCount;
+    random_series Random;
+    integrator_state Integrator;
+    settle_state Settle;
+    snapshot_string Name;
+    snapshot_string JavaID;
+
+    // Where each section starts, in bytes from the start of the snapshot, and
+    // the size of the strings section
+    u64 NodeStateOffset;
+    u64 NodesOffset;
+    u64 EdgesOffset;
+    u64 StringsOffset;
+    u64 StringsSize;
+};
+
+/* Writes a snapshot of Graph, along with Integrator and Settle, onto the end
+ * of Arena and returns it. Its size in bytes goes in *Size. */
+extern void*
+WriteSnapshot(memory_arena* Arena, graph* Graph, integrator_state* Integrator,
+              settle_state* Settle, memory_index* Size);
+
+/* Loads the snapshot of Size bytes at Data into Graph, Integrator and Settle.
+ * The strings of the graph point into Data afterwards, which therefore has to
+ * stay put for as long as the graph is in use. The graph's arrays grow out
+ * of its Arena to fit. Returns false, leaving everything alone (except perhaps
+ * for the room in the graph), if Data isn't a well-formed snapshot of this
+ * version or the graph can't grow to fit it. */
+extern bool
+ReadSnapshot(void* Data, memory_index Size, graph* Graph, integrator_state* Integrator,
+             settle_state* Settle);
@@ -0,0 +1,124 @@
+/* spatial_hash.hpp
+ * by Andrew Chronister, (c) 2016
+ *
+ * Uniform-grid spatial hash over a set of 2D points, used as the broadphase
+ * for short-range queries such as node-node collision.
+ *
+ * The plane is divided into square cells of a fixed size and every cell is
+ * hashed into a table with (at least) as many buckets as there are points.
+ * Each bucket is a doubly linked list of the points in it, threaded through
+ * flat arrays allocated out of a memory_arena, so the whole structure can be
+ * cheaply rebuilt every simulation step and a point that moves can be filed
+ * under its new cell in constant time.
+ *
+ * Distinct cells can share a bucket, so a query may return points that are
+ * not actually in the requested cell; callers are expected to do their own
+ * exact distance test.
+ */
+#pragma once
+
+// Purpose: memset
+#include <cstring>
+
+// Purpose: Convenience typedefs and macro definitions
+#include "types.h"
+
+// Purpose: Vector types
+#include "math.hpp"
+
+// Purpose: memory management structures
+#include "memory_arena.hpp"
+
+/* A built spatial hash. */
+struct spatial_hash
+{
+    // Side length of a grid cell, and its inverse
+    f32 CellSize;
+    f32 InvCellSize;
+
+    // Number of buckets in the table. Always a power of two.
+    u32 BucketCount;
+    // The first point in each bucket, or -1 if it is empty
+    s32* BucketFirst;
+    // The points after and before each point in its bucket, or -1
+    s32* Next;
+    s32* Prev;
+    // The bucket each point is filed under
+    u32* PointBuckets;
+};
+
+inline ivec2
+SpatialHashCell(spatial_hash* Hash, vec2 P)
+{
+    ivec2 Result = IV2((int)floorf(P.x * Hash->InvCellSize),
+                       (int)floorf(P.y * Hash->InvCellSize));
+    return Result;
+}
+
+inline u32
+SpatialHashBucket(spatial_hash* Hash, ivec2 Cell)
+{
+    // Large primes from Teschner et al., "Optimized Spatial Hashing for
+    // Collision Detection of Deformable Objects"
+    u32 Result = (((u32)Cell.X * 73856093u) ^ ((u32)Cell.Y * 19349663u)) & (Hash->BucketCount - 1);
+    return Result;
+}
+
+/* Builds a spatial hash with cells of side CellSize over the PointCount points
+ * whose coordinates are given by the X and Y arrays. All memory is taken from
+ * Arena. */
+internal spatial_hash
+BuildSpatialHash(memory_arena* Arena, s32 PointCount, f32* X, f32* Y, f32 CellSize)
+{
+    spatial_hash Hash = {};
+    Hash.CellSize = CellSize;
+    Hash.InvCellSize = 1.0f / CellSize;
+
+    Hash.BucketCount = 1;
+    while (Hash.BucketCount < (u32)PointCount) { Hash.BucketCount <<= 1; }
+
+    Hash.BucketFirst = PushArray(Arena, Hash.BucketCount, s32);
+    Hash.Next = PushArray(Arena, PointCount, s32);
+    Hash.Prev = PushArray(Arena, PointCount, s32);
+    Hash.PointBuckets = PushArray(Arena, PointCount, u32);
+
+    memset(Hash.BucketFirst, 0xFF, Hash.BucketCount * sizeof(s32));
+
+    // Filed back to front, so that every bucket lists its points in order
+    for (s32 PointIndex = PointCount - 1; PointIndex >= 0; --PointIndex)
+    {
+        ivec2 Cell = SpatialHashCell(&Hash, V2(X[PointIndex], Y[PointIndex]));
+        u32 Bucket = SpatialHashBucket(&Hash, Cell);
+        Hash.PointBuckets[PointIndex] = Bucket;
+        Hash.Prev[PointIndex] = -1;
+        Hash.Next[PointIndex] = Hash.BucketFirst[Bucket];
+        if (Hash.BucketFirst[Bucket] >= 0) { Hash.Prev[Hash.BucketFirst[Bucket]] = PointIndex; }
+        Hash.BucketFirst[Bucket] = PointIndex;
+    }
+
+    return Hash;
+}
+
+/* Files PointIndex under the cell of P, where it has moved to. Returns
+ * whether it changed buckets; the points after it in its old bucket are
+ * then no longer reachable through it. */
+inline bool
+MoveSpatialHashPoint(spatial_hash* Hash, s32 PointIndex, vec2 P)
+{
+    u32 Bucket = SpatialHashBucket(Hash, SpatialHashCell(Hash, P));
+    u32 OldBucket = Hash->PointBuckets[PointIndex];
+    if (Bucket == OldBucket) { return false; }
+
+    s32 Next = Hash->Next[PointIndex];
+    s32 Prev = Hash->Prev[PointIndex];
+    if (Prev >= 0) { Hash->Next[Prev] = Next; }
+    else { Hash->BucketFirst[OldBucket] = Next; }
+    if (Next >= 0) { Hash->Prev[Next] = Prev; }
+
+    Hash->PointBuckets[PointIndex] = Bucket;
+    Hash->Prev[PointIndex] = -1;
+    Hash->Next[PointIndex] = Hash->BucketFirst[Bucket];
+    if (Hash->BucketFirst[Bucket] >= 0) { Hash->Prev[Hash->BucketFirst[Bucket]] = PointIndex; }
+    Hash->BucketFirst[Bucket] = PointIndex;
+    return true;
+}
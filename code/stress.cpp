@@ -0,0 +1,227 @@
+#include <cmath>
+#include "stress.h"
+
+// Most majorization iterations, and the relative decrease in stress below
+// which the layout counts as converged
+#define STRESS_MAX_ITERATIONS 100
+#define STRESS_TOLERANCE 1e-3f
+// Most conjugate gradient iterations per linear solve. Each solve starts from
+// the previous layout, which is already close, so a few iterations do.
+#define STRESS_SOLVE_ITERATIONS 16
+// Most nodes laid out by majorization. Every iteration takes time in
+// proportion to the square of the node count, so beyond this it takes longer
+// than the simulation it is meant to save.
+#define STRESS_MAX_NODES 2048
+
+/* Computes Out = L In, where L is the weighted Laplacian of the ideal
+ * distances: (L In)_i = sum over j of w_ij (In_i - In_j). Weight holds w_ij,
+ * with zeroes on the diagonal. */
+internal void
+WeightedLaplacianTimes(s32 NodeCount, f32* Weight, f32* In, f32* Out)
+{
+    for (s32 Node1 = 0; Node1 < NodeCount; ++Node1)
+    {
+        f32* Row = Weight + Node1*NodeCount;
+        f32 Sum = 0.0f;
+        for (s32 Node2 = 0; Node2 < NodeCount; ++Node2)
+        {
+            Sum += Row[Node2]*(In[Node1] - In[Node2]);
+        }
+        Out[Node1] = Sum;
+    }
+}
+
+/* Improves X towards a solution of L X = B by Jacobi-preconditioned conjugate
+ * gradients, where L is the weighted Laplacian and Diagonal its diagonal. L is
+ * singular (moving every node by the same amount changes nothing), but B sums
+ * to zero, so the iterations stay within the space where it can be solved. */
+internal void
+SolveWeightedLaplacian(memory_arena* Arena, s32 NodeCount, f32* Weight, f32* Diagonal,
+                       f32* B, f32* X)
+{
+    temporary_memory SolveMemory = BeginTemporaryMemory(Arena);
+    f32* Residual = PushArray(Arena, NodeCount, f32);
+    f32* Preconditioned = PushArray(Arena, NodeCount, f32);
+    f32* Direction = PushArray(Arena, NodeCount, f32);
+    f32* LDirection = PushArray(Arena, NodeCount, f32);
+
+    WeightedLaplacianTimes(NodeCount, Weight, X, LDirection);
+    f32 RZ = 0.0f;
+    f32 BLengthSq = 0.0f;
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Residual[NodeIndex] = B[NodeIndex] - LDirection[NodeIndex];
+        Preconditioned[NodeIndex] = Residual[NodeIndex] / Diagonal[NodeIndex];
+        Direction[NodeIndex] = Preconditioned[NodeIndex];
+        RZ += Residual[NodeIndex]*Preconditioned[NodeIndex];
+        BLengthSq += B[NodeIndex]*B[NodeIndex];
+    }
+
+    for (s32 Iteration = 0; Iteration < STRESS_SOLVE_ITERATIONS; ++Iteration)
+    {
+        f32 ResidualLengthSq = 0.0f;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            ResidualLengthSq += Residual[NodeIndex]*Residual[NodeIndex];
+        }
+        if (ResidualLengthSq <= 1e-8f*BLengthSq) { break; }
+
+        WeightedLaplacianTimes(NodeCount, Weight, Direction, LDirection);
+        f32 DirectionLSq = 0.0f;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            DirectionLSq += Direction[NodeIndex]*LDirection[NodeIndex];
+        }
+        if (DirectionLSq <= 0.0f) { break; }
+
+        f32 Step = RZ / DirectionLSq;
+        f32 NextRZ = 0.0f;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            X[NodeIndex] += Step*Direction[NodeIndex];
+            Residual[NodeIndex] -= Step*LDirection[NodeIndex];
+            Preconditioned[NodeIndex] = Residual[NodeIndex] / Diagonal[NodeIndex];
+            NextRZ += Residual[NodeIndex]*Preconditioned[NodeIndex];
+        }
+
+        f32 Beta = NextRZ / RZ;
+        RZ = NextRZ;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+        {
+            Direction[NodeIndex] = Preconditioned[NodeIndex] + Beta*Direction[NodeIndex];
+        }
+    }
+
+    EndTemporaryMemory(SolveMemory);
+}
+
+s32
+StressLayout(memory_arena* Arena, graph* Graph, adjacency* Adjacency, f32 EdgeLength,
+             vec2 MinSide, vec2 MaxSide)
+{
+    s32 NodeCount = Graph->NodeCount;
+    if (NodeCount < 2) { return 0; }
+
+    // The two matrices, plus a dozen or so vectors of a node's worth each
+    memory_index PairCount = (memory_index)NodeCount*(memory_index)NodeCount;
+    memory_index Needed = 2*PairCount*sizeof(f32) + 16*(memory_index)NodeCount*sizeof(f32);
+    if (NodeCount > STRESS_MAX_NODES || Needed > GetArenaSizeRemaining(Arena)) { return -1; }
+
+    temporary_memory StressMemory = BeginTemporaryMemory(Arena);
+
+    // Hop counts between every pair of nodes, one breadth-first search from
+    // each node, with -1 for pairs in different components
+    f32* Dist = PushArray(Arena, PairCount, f32);
+    s32* Queue = PushArray(Arena, NodeCount, s32);
+    s32 MaxHops = 1;
+    for (s32 RootIndex = 0; RootIndex < NodeCount; ++RootIndex)
+    {
+        f32* Row = Dist + RootIndex*NodeCount;
+        for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex) { Row[NodeIndex] = -1.0f; }
+
+        s32 QueueRead = 0;
+        s32 QueueWrite = 0;
+        Row[RootIndex] = 0.0f;
+        Queue[QueueWrite++] = RootIndex;
+        while (QueueRead < QueueWrite)
+        {
+            s32 Node = Queue[QueueRead++];
+            for (s32 Slot = Adjacency->Start[Node]; Slot < Adjacency->Start[Node + 1]; ++Slot)
+            {
+                s32 Neighbor = Adjacency->Neighbors[Slot];
+                if (Row[Neighbor] >= 0.0f) { continue; }
+                Row[Neighbor] = Row[Node] + 1.0f;
+                MaxHops = Max(MaxHops, (s32)Row[Neighbor]);
+                Queue[QueueWrite++] = Neighbor;
+            }
+        }
+    }
+
+    // Turn the hops into the reciprocals of the ideal distances (which is
+    // all the iterations need) and the weights. The diagonal of the weighted
+    // Laplacian is the total weight on each node.
+    f32* InvDist = Dist;
+    f32* Weight = PushArray(Arena, PairCount, f32);
+    f32* Diagonal = PushArray(Arena, NodeCount, f32);
+    for (s32 Node1 = 0; Node1 < NodeCount; ++Node1)
+    {
+        f32* Row = Dist + Node1*NodeCount;
+        f32* WeightRow = Weight + Node1*NodeCount;
+        Diagonal[Node1] = 0.0f;
+        for (s32 Node2 = 0; Node2 < NodeCount; ++Node2)
+        {
+            f32 Hops = (Row[Node2] < 0.0f) ? (f32)(MaxHops + 1) : Row[Node2];
+            Row[Node2] = (Node2 == Node1) ? 0.0f : 1.0f / (EdgeLength*Hops);
+            WeightRow[Node2] = Row[Node2]*Row[Node2];
+            Diagonal[Node1] += WeightRow[Node2];
+        }
+    }
+
+    f32* X = PushArray(Arena, NodeCount, f32);
+    f32* Y = PushArray(Arena, NodeCount, f32);
+    f32* BX = PushArray(Arena, NodeCount, f32);
+    f32* BY = PushArray(Arena, NodeCount, f32);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        X[NodeIndex] = Graph->PX[NodeIndex];
+        Y[NodeIndex] = Graph->PY[NodeIndex];
+    }
+
+    f32 PreviousStress = 0.0f;
+    s32 Iteration = 0;
+    for (; Iteration < STRESS_MAX_ITERATIONS; ++Iteration)
+    {
+        // The majorizing function is minimized where L X' = L^Z(X) X, with
+        // L^Z(X)_ij = -w_ij d_ij / |X_i - X_j| off the diagonal. The stress
+        // of the current layout comes out of the same distances.
+        f32 Stress = 0.0f;
+        for (s32 Node1 = 0; Node1 < NodeCount; ++Node1)
+        {
+            f32* Row = InvDist + Node1*NodeCount;
+            f32 SumX = 0.0f;
+            f32 SumY = 0.0f;
+            for (s32 Node2 = 0; Node2 < NodeCount; ++Node2)
+            {
+                f32 dX = X[Node1] - X[Node2];
+                f32 dY = Y[Node1] - Y[Node2];
+                f32 Length = sqrtf(dX*dX + dY*dY);
+                f32 Error = Length*Row[Node2] - 1.0f;
+                if (Node2 == Node1 || Length == 0.0f) { continue; }
+                f32 Coefficient = Row[Node2] / Length;
+                SumX += Coefficient*dX;
+                SumY += Coefficient*dY;
+                Stress += Error*Error;
+            }
+            BX[Node1] = SumX;
+            BY[Node1] = SumY;
+        }
+
+        if (Iteration > 0 && PreviousStress - Stress <= STRESS_TOLERANCE*PreviousStress) { break; }
+        PreviousStress = Stress;
+
+        SolveWeightedLaplacian(Arena, NodeCount, Weight, Diagonal, BX, X);
+        SolveWeightedLaplacian(Arena, NodeCount, Weight, Diagonal, BY, Y);
+    }
+
+    // Center the layout in the space, shrinking it if it doesn't fit
+    vec2 Lowest = V2(X[0], Y[0]);
+    vec2 Highest = Lowest;
+    for (s32 NodeIndex = 1; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        Lowest = V2(Min(Lowest.x, X[NodeIndex]), Min(Lowest.y, Y[NodeIndex]));
+        Highest = V2(Max(Highest.x, X[NodeIndex]), Max(Highest.y, Y[NodeIndex]));
+    }
+    vec2 Size = Highest - Lowest;
+    vec2 Room = 0.9f*(MaxSide - MinSide);
+    f32 Scale = Min(1.0f, Min(SafeRatioN(Room.x, Size.x, 1.0f), SafeRatioN(Room.y, Size.y, 1.0f)));
+    vec2 Center = 0.5f*(Lowest + Highest);
+    vec2 SpaceCenter = 0.5f*(MinSide + MaxSide);
+    for (s32 NodeIndex = 0; NodeIndex < NodeCount; ++NodeIndex)
+    {
+        vec2 P = SpaceCenter + Scale*(V2(X[NodeIndex], Y[NodeIndex]) - Center);
+        SetNodeP(Graph, (node_id)NodeIndex, P);
+    }
+
+    EndTemporaryMemory(StressMemory);
+    return Iteration;
+}
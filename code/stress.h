@@ -0,0 +1,39 @@
+/* stress.h
+ * by Andrew Chronister, (c) 2016
+ *
+ * Stress majorization (Gansner, Koren and North, "Graph drawing by stress
+ * majorization"). Every pair of nodes is given an ideal distance proportional
+ * to the length of the shortest path between them, and the layout is moved to
+ * minimize the stress
+ *
+ *     sum over pairs i<j of w_ij (|X_i - X_j| - d_ij)^2,  w_ij = d_ij^-2
+ *
+ * by repeatedly minimizing a quadratic function that majorizes it (SMACOF).
+ * Each of those is a linear solve with the weighted Laplacian of the graph,
+ * and the stress never goes up from one iteration to the next. Unlike the
+ * force simulation this is deterministic given a starting layout, and
+ * typically converges in a few dozen iterations.
+ *
+ * The all-pairs distances take O(n^2) memory and every iteration O(n^2) time,
+ * which is fine for a few thousand nodes but no more, so larger graphs are
+ * left alone.
+ */
+#pragma once
+
+// Purpose: Graph-related structures and function declarations
+#include "graphgen.h"
+
+// Purpose: adjacency structure
+#include "adjacency.hpp"
+
+/* Moves the nodes of Graph, starting from their current positions, to a
+ * layout of minimal stress in which adjacent nodes are ideally EdgeLength
+ * apart. Nodes in different components are treated as being one hop further
+ * apart than the furthest connected pair. The result is centered in the
+ * rectangle from MinSide to MaxSide, and scaled down to fit if need be.
+ * Velocities are left alone. Scratch memory is taken from Arena and released
+ * before returning. Returns the number of iterations taken, or -1, leaving
+ * the graph alone, if it has too many nodes or Arena hasn't room for them. */
+extern s32
+StressLayout(memory_arena* Arena, graph* Graph, adjacency* Adjacency, f32 EdgeLength,
+             vec2 MinSide, vec2 MaxSide);